@@ -10,9 +10,23 @@
 
 import os
 import sys
+import mmap
 import tempfile
 import subprocess
 import struct
+import numpy as np
+
+
+# Shared-memory transport layout, see `IpcIface` in `ipc.hh`
+SHM_MAGIC = b'SNIPCSHM'
+SHM_HDR = struct.Struct('<8sQQQQQQQ')
+SHM_HEAD_OFFSET = 64
+SHM_TAIL_OFFSET = 128
+SHM_SLOTS_OFFSET = 256
+SHM_SLOT = struct.Struct('<QQQQQ')
+SHM_SLOT_SIZE = 64
+SHM_NUM_SLOTS = 32
+SHM_PAGE = 4096
 
 
 class SnitchSim:
@@ -22,20 +36,103 @@ class SnitchSim:
         self.snitch_bin = snitch_bin
         self.sim = None
         self.tmpdir = None
+        self.shm = None
 
-    def start(self):
+    # Start the simulation. With `window_size` or `stage_size`, a shared
+    # memory region is set up in addition to the FIFOs: `window_size` bytes at
+    # `window_base` in simulation memory live directly in it, and accesses to
+    # them are plain host memory accesses. Other accesses are copied through
+    # `stage_size` bytes of staging memory by a lock-free command ring.
+    def start(self, window_base: int = 0, window_size: int = 0, stage_size: int = 0):
         # Create FIFOs
         self.tmpdir = tempfile.TemporaryDirectory()
         tx_fd = os.path.join(self.tmpdir.name, 'tx')
         os.mkfifo(tx_fd)
         rx_fd = os.path.join(self.tmpdir.name, 'rx')
         os.mkfifo(rx_fd)
+        args = [self.sim_bin, self.snitch_bin, f'--ipc,{tx_fd},{rx_fd}']
+        if window_size or stage_size:
+            args.append(self.__shm_create(window_base, window_size, stage_size))
         # Start simulator process
-        ipc_arg = f'--ipc,{tx_fd},{rx_fd}'
-        self.sim = subprocess.Popen([self.sim_bin, self.snitch_bin, ipc_arg])
+        self.sim = subprocess.Popen(args)
         # Open FIFOs
         self.tx = open(tx_fd, 'wb')
         self.rx = open(rx_fd, 'rb')
+        if self.shm is not None:
+            self.kick = os.open(os.path.join(self.tmpdir.name, 'kick'), os.O_WRONLY)
+            self.done = os.open(os.path.join(self.tmpdir.name, 'done'), os.O_RDONLY)
+
+    def __shm_create(self, window_base: int, window_size: int, stage_size: int) -> str:
+        def page_align(x):
+            return (x + SHM_PAGE - 1) // SHM_PAGE * SHM_PAGE
+        stage_offset = page_align(SHM_SLOTS_OFFSET + SHM_NUM_SLOTS * SHM_SLOT_SIZE)
+        stage_size = page_align(stage_size)
+        window_offset = stage_offset + stage_size
+        shm_dir = '/dev/shm' if os.path.isdir('/dev/shm') else self.tmpdir.name
+        fd, path = tempfile.mkstemp(dir=shm_dir, prefix='snitch-ring-')
+        try:
+            os.ftruncate(fd, window_offset + page_align(window_size))
+            self.shm = mmap.mmap(fd, window_offset + page_align(window_size))
+        finally:
+            os.close(fd)
+        self.shm_path = path
+        SHM_HDR.pack_into(self.shm, 0, SHM_MAGIC, SHM_NUM_SLOTS, stage_offset, stage_size,
+                          window_offset, window_size, window_base, 0)
+        self.head = 0
+        self.stage = memoryview(self.shm)[stage_offset:stage_offset + stage_size]
+        self.window = memoryview(self.shm)[window_offset:window_offset + window_size]
+        self.window_base = window_base
+        kick = os.path.join(self.tmpdir.name, 'kick')
+        os.mkfifo(kick)
+        done = os.path.join(self.tmpdir.name, 'done')
+        os.mkfifo(done)
+        return f'--ipc-shm,{path},{kick},{done}'
+
+    # Return the window offset of `[addr, addr + length)`, or `None` if the
+    # range is not fully inside the shared window.
+    def __in_window(self, addr: int, length: int):
+        if self.shm is None:
+            return None
+        off = addr - self.window_base
+        return off if 0 <= off and off + length <= len(self.window) else None
+
+    # Post `cmds` (opcode, addr, len, offset) to the ring, wake up the
+    # simulation, and wait until all of them completed. Returns the results.
+    def __shm_submit(self, cmds: list) -> list:
+        slots = []
+        for opcode, addr, length, offset in cmds:
+            slot = SHM_SLOTS_OFFSET + (self.head % SHM_NUM_SLOTS) * SHM_SLOT_SIZE
+            SHM_SLOT.pack_into(self.shm, slot, opcode, addr, length, offset, 0)
+            slots.append(slot)
+            self.head += 1
+        struct.pack_into('<Q', self.shm, SHM_HEAD_OFFSET, self.head)
+        os.write(self.kick, struct.pack('<Q', self.head))
+        tail, = struct.unpack('<Q', os.read(self.done, 8))
+        assert tail == self.head
+        results = [SHM_SLOT.unpack_from(self.shm, slot)[4] for slot in slots]
+        if (1 << 64) - 1 in results:
+            raise RuntimeError('Shared memory command failed')
+        return results
+
+    # Copy `length` bytes between `addr` and the staging area in as few ring
+    # submissions as possible. Calls `before(offset, pos, n)` to fill the
+    # staging area for writes and `after(offset, pos, n)` to drain it for
+    # reads.
+    def __shm_transfer(self, opcode: int, addr: int, length: int, before=None, after=None):
+        pos = 0
+        while pos < length:
+            cmds, offset = [], 0
+            while pos < length and len(cmds) < SHM_NUM_SLOTS and offset < len(self.stage):
+                n = min(length - pos, len(self.stage) - offset)
+                if before:
+                    before(offset, pos, n)
+                cmds.append((opcode, addr + pos, n, offset, pos))
+                offset += n
+                pos += n
+            self.__shm_submit([c[:4] for c in cmds])
+            if after:
+                for _, _, n, offset, p in cmds:
+                    after(offset, p, n)
 
     def __sim_active(func):
         def inner(self, *args, **kwargs):
@@ -47,6 +144,16 @@ class SnitchSim:
 
     @__sim_active
     def read(self, addr: int, length: int) -> bytes:
+        off = self.__in_window(addr, length)
+        if off is not None:
+            return bytes(self.window[off:off + length])
+        if self.shm is not None:
+            data = bytearray(length)
+
+            def drain(offset, pos, n):
+                data[pos:pos + n] = self.stage[offset:offset + n]
+            self.__shm_transfer(0, addr, length, after=drain)
+            return bytes(data)
         op = struct.pack('QQQ', 0, addr, length)
         self.tx.write(op)
         self.tx.flush()
@@ -54,6 +161,16 @@ class SnitchSim:
 
     @__sim_active
     def write(self, addr: int, data: bytes):
+        data = memoryview(data).cast('B')
+        off = self.__in_window(addr, len(data))
+        if off is not None:
+            self.window[off:off + len(data)] = data
+            return
+        if self.shm is not None:
+            def fill(offset, pos, n):
+                self.stage[offset:offset + n] = data[pos:pos + n]
+            self.__shm_transfer(1, addr, len(data), before=fill)
+            return
         op = struct.pack('QQQ', 1, addr, len(data))
         self.tx.write(op)
         self.tx.write(data)
@@ -61,17 +178,84 @@ class SnitchSim:
 
     @__sim_active
     def poll(self, addr: int, mask32: int, exp32: int):
-        # TODO: check endiannesses
-        op = struct.pack('QQLL', 2, addr, mask32, exp32)
+        if self.shm is not None:
+            return self.__shm_submit([(2, addr, (exp32 << 32) | mask32, 0)])[0]
+        op = struct.pack('<QQLL', 2, addr, mask32, exp32)
         self.tx.write(op)
         self.tx.flush()
-        return int.from_bytes(self.rx.read(4))
+        return int.from_bytes(self.rx.read(4), 'little')
+
+    # Return a numpy array of `shape` and `dtype` that aliases the simulation
+    # memory at `addr`, which must lie inside the shared window. Neither side
+    # copies: host stores are visible to the simulation right away and vice
+    # versa.
+    @__sim_active
+    def array(self, addr: int, shape, dtype=np.uint8) -> np.ndarray:
+        dtype = np.dtype(dtype)
+        count = int(np.prod(shape))
+        off = self.__in_window(addr, count * dtype.itemsize)
+        if off is None:
+            raise ValueError(f'{hex(addr)} is not inside the shared window')
+        return np.frombuffer(self.window, dtype, count, off).reshape(shape)
+
+    # Copy `shape` elements of `dtype` at `addr` out of the simulation memory.
+    @__sim_active
+    def read_array(self, addr: int, shape, dtype=np.uint8) -> np.ndarray:
+        dtype = np.dtype(dtype)
+        data = self.read(addr, int(np.prod(shape)) * dtype.itemsize)
+        return np.frombuffer(data, dtype).reshape(shape).copy()
+
+    # Copy the array `arr` into the simulation memory at `addr`.
+    @__sim_active
+    def write_array(self, addr: int, arr: np.ndarray):
+        self.write(addr, np.ascontiguousarray(arr).view(np.uint8).reshape(-1))
+
+    # Map the first `length` bytes of the host file at `path` to `addr` in the
+    # simulation memory. Accesses of the simulation go directly to the file.
+    @__sim_active
+    def map(self, addr: int, path: str, length: int):
+        path = os.fsencode(os.path.abspath(path))
+        op = struct.pack('QQQQ', 3, addr, length, len(path))
+        self.tx.write(op)
+        self.tx.write(path)
+        self.tx.flush()
+        if struct.unpack('Q', self.rx.read(8))[0] != 0:
+            raise RuntimeError(f'Failed to map `{path}` to {hex(addr)}')
+
+    @__sim_active
+    def unmap(self, addr: int):
+        op = struct.pack('QQQ', 4, addr, 0)
+        self.tx.write(op)
+        self.tx.flush()
+        if struct.unpack('Q', self.rx.read(8))[0] != 0:
+            raise RuntimeError(f'No mapping at {hex(addr)}')
+
+    # Share a new zero-initialized host buffer of `length` bytes with the
+    # simulation at `addr`. Returns a writable `mmap` of the buffer.
+    @__sim_active
+    def share(self, addr: int, length: int) -> mmap.mmap:
+        shm_dir = '/dev/shm' if os.path.isdir('/dev/shm') else self.tmpdir.name
+        fd, path = tempfile.mkstemp(dir=shm_dir, prefix='snitch-')
+        try:
+            os.ftruncate(fd, length)
+            buf = mmap.mmap(fd, length)
+            self.map(addr, path, length)
+        finally:
+            os.close(fd)
+            os.unlink(path)
+        return buf
 
     # Simulator can exit only once TX FIFO closes
     @__sim_active
     def finish(self, wait_for_sim: bool = True):
         self.rx.close()
         self.tx.close()
+        if self.shm is not None:
+            # Arrays returned by `array` keep the region alive
+            os.close(self.kick)
+            os.close(self.done)
+            os.unlink(self.shm_path)
+            self.shm = self.stage = self.window = None
         if (wait_for_sim):
             self.sim.wait()
         else:
@@ -89,4 +273,20 @@ if __name__ == "__main__":
     rstr = sim.read(0xdeadbeef, len(wstr)+5)
     print(f'Read back string: `{rstr}`')
 
+    buf = sim.share(0x10000000, 4096)
+    buf[0:len(wstr)] = wstr
+    rstr = sim.read(0x10000000, len(wstr))
+    print(f'Read back shared string: `{rstr}`')
+    sim.unmap(0x10000000)
+    sim.finish(wait_for_sim=False)
+
+    # Shared-memory transport with a 1 MiB window at 0x10000000
+    sim = SnitchSim(*sys.argv[1:])
+    sim.start(window_base=0x10000000, window_size=1 << 20, stage_size=1 << 16)
+    vec = sim.array(0x10000000, 1024, np.float32)
+    vec[:] = np.arange(1024, dtype=np.float32)
+    print(f'Read back shared array: {sim.read_array(0x10000000, 4, np.float32)}')
+    sim.write_array(0xdead0000, np.arange(64 * 1024, dtype=np.uint32))
+    print(f'Read back staged array: {sim.read_array(0xdead0000 + 4 * 1000, 4, np.uint32)}')
+
     sim.finish(wait_for_sim=False)
@@ -2,29 +2,584 @@
 // Solderpad Hardware License, Version 0.51, see LICENSE for details.
 // SPDX-License-Identifier: SHL-0.51
 
+#include <elf.h>
+#include <fcntl.h>
+#include <svdpi.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <iostream>
 
 #include "sim.hh"
+#include "tb_axi.hh"
 #include "tb_lib.hh"
+#include "tb_perf.hh"
+#include "tb_trace.hh"
+#include "tb_traffic.hh"
 
 namespace sim {
 
 // The global memory all memory ports write into.
 GlobalMemory MEM;
 
+int CLUSTER_PROBE = 0;
+uint64_t CLUSTER_PROBE_CHANGES = 0;
+bool TRACE_ENABLED = true;
+
+ReadMemo REGBUS_READS;
+
+ReadMemo::~ReadMemo() {
+    if (!calls) return;
+    fprintf(stderr,
+            "[TB] tb_memory_read: %lu calls, %lu memory reads, %lu served "
+            "from the memo\n",
+            calls, reads, calls - reads);
+}
+
+PerfProfile PERF;
+
+TrafficMap TRAFFIC;
+
+AxiModelConfig AXI_CONFIG;
+
+// AXI burst model ports, created on their first cycle so that they pick up
+// the configuration parsed by the driver. Their statistics are printed at
+// exit.
+static struct AxiPorts {
+    std::vector<std::pair<size_t, std::unique_ptr<AxiModel>>> ports;
+
+    ~AxiPorts() {
+        for (size_t i = 0; i < ports.size(); i++) {
+            auto &m = ports[i].second;
+            if (!m) continue;
+            auto &st = m->stats;
+            fprintf(stderr,
+                    "[AXI] Port %zu: %lu reads, %lu writes, %lu bytes in %lu "
+                    "cycles, %.1f cycles average read latency, %lu row hits, "
+                    "%lu row misses\n",
+                    i, st.reads, st.writes, st.bytes, m->cycles(),
+                    st.reads ? (double)st.read_latency / st.reads : 0.0,
+                    st.row_hits, st.row_misses);
+        }
+    }
+} AXI_PORTS;
+
+bool GlobalMemory::map_flat(uint64_t base, uint64_t end) {
+    unmap_flat();
+    // Round the window out to whole pages.
+    base &= ~(uint64_t)(PAGE_SIZE - 1);
+    end = (end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    if (end <= base) return false;
+    size_t size = end - base;
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED) return false;
+    flat = reinterpret_cast<uint8_t *>(ptr);
+    flat_base = base;
+    flat_size = size;
+    flat_touched.assign((size / PAGE_SIZE + 63) / 64, 0);
+    // Move sparse pages that now fall into the window.
+    auto kept = allocated.begin();
+    for (auto idx : allocated) {
+        uint64_t addr = idx << ADDR_SHIFT;
+        if (!in_flat(addr, PAGE_SIZE)) {
+            *kept++ = idx;
+            continue;
+        }
+        TableNode *node = table.get();
+        for (size_t level = TABLE_LEVELS - 1; level > 0; level--)
+            node = (TableNode *)node
+                       ->slots[(idx >> (level * TABLE_BITS)) & TABLE_MASK]
+                       .load();
+        uint8_t *page = (uint8_t *)node->slots[idx & TABLE_MASK].exchange(nullptr);
+        memcpy(&flat[addr - flat_base], page, PAGE_SIZE);
+        mark_flat_touched(addr, PAGE_SIZE);
+        delete[] page;
+    }
+    allocated.erase(kept, allocated.end());
+    return true;
+}
+
+void GlobalMemory::unmap_flat() {
+    if (!flat) return;
+    munmap(flat, flat_size);
+    flat = nullptr;
+    flat_base = 0;
+    flat_size = 0;
+    flat_touched.clear();
+}
+
+uint8_t *GlobalMemory::alloc_page(uint64_t idx) {
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    // Walk down the table, creating missing nodes. Another thread may have
+    // allocated the page since the lock-free lookup.
+    TableNode *node = table.get();
+    for (size_t level = TABLE_LEVELS - 1; level > 0; level--) {
+        auto &slot = node->slots[(idx >> (level * TABLE_BITS)) & TABLE_MASK];
+        auto next = (TableNode *)slot.load(std::memory_order_relaxed);
+        if (!next) {
+            next = new TableNode();
+            slot.store(next, std::memory_order_release);
+        }
+        node = next;
+    }
+    auto &slot = node->slots[idx & TABLE_MASK];
+    auto page = (uint8_t *)slot.load(std::memory_order_relaxed);
+    if (!page) {
+        page = new uint8_t[PAGE_SIZE]();
+        slot.store(page, std::memory_order_release);
+        allocated.push_back(idx);
+    }
+    return page;
+}
+
+static void free_node(GlobalMemory::TableNode *node, size_t level) {
+    for (auto &slot : node->slots) {
+        void *ptr = slot.exchange(nullptr);
+        if (!ptr) continue;
+        if (level > 0) {
+            free_node((GlobalMemory::TableNode *)ptr, level - 1);
+            delete (GlobalMemory::TableNode *)ptr;
+        } else {
+            delete[](uint8_t *) ptr;
+        }
+    }
+}
+
+void GlobalMemory::free_table() {
+    free_node(table.get(), TABLE_LEVELS - 1);
+    allocated.clear();
+}
+
+std::vector<uint64_t> GlobalMemory::touched_pages() {
+    std::vector<uint64_t> result;
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex);
+        result = allocated;
+    }
+    for (size_t w = 0; w < flat_touched.size(); w++) {
+        for (uint64_t bits = flat_touched[w]; bits; bits &= bits - 1) {
+            uint64_t idx = w * 64 + __builtin_ctzll(bits);
+            result.push_back((flat_base >> ADDR_SHIFT) + idx);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void GlobalMemory::clear() {
+    free_table();
+    if (flat) {
+        // Dropping private anonymous pages makes them read as zero again.
+        for (size_t w = 0; w < flat_touched.size(); w++) {
+            for (uint64_t bits = flat_touched[w]; bits; bits &= bits - 1) {
+                uint64_t idx = w * 64 + __builtin_ctzll(bits);
+                madvise(&flat[idx * PAGE_SIZE], PAGE_SIZE, MADV_DONTNEED);
+            }
+        }
+        std::fill(flat_touched.begin(), flat_touched.end(), 0);
+    }
+    generation++;
+}
+
+uint32_t GlobalMemory::wait_change(uint64_t addr, uint32_t mask,
+                                   uint32_t expected) {
+    Watchpoint wp{addr, mask, expected, false};
+    uint32_t value;
+    std::unique_lock<std::mutex> lock(watch_mutex);
+    watchpoints.push_back(&wp);
+    num_watchpoints++;
+    // Writes from now on fire the watchpoint, so check the current value once.
+    read(addr, sizeof(value), (uint8_t *)&value);
+    if ((value & mask) == (expected & mask)) {
+        watch_cv.wait(lock, [&] { return wp.fired; });
+        read(addr, sizeof(value), (uint8_t *)&value);
+    }
+    watchpoints.erase(std::find(watchpoints.begin(), watchpoints.end(), &wp));
+    num_watchpoints--;
+    return value;
+}
+
+void GlobalMemory::check_watchpoints(uint64_t addr, size_t len) {
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    bool fired = false;
+    for (auto wp : watchpoints) {
+        if (wp->fired || wp->addr >= addr + len ||
+            addr >= wp->addr + sizeof(uint32_t))
+            continue;
+        uint32_t value;
+        read(wp->addr, sizeof(value), (uint8_t *)&value);
+        if ((value & wp->mask) != (wp->expected & wp->mask)) {
+            wp->fired = true;
+            fired = true;
+        }
+    }
+    if (fired) watch_cv.notify_all();
+}
+
+void Sim::parse_args(int argc, char **argv) {
+    // Batch runs construct a `Sim` per binary, start each from the defaults.
+    bool flat_mem = true;
+    AXI_CONFIG = AxiModelConfig();
+    PERF.path = nullptr;
+    PERF.at_cycles.clear();
+    PERF.every = 0;
+    TRAFFIC.path = nullptr;
+    TRAFFIC.bucket_cycles = TrafficMap::DEFAULT_BUCKET_CYCLES;
+    for (auto i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--mem=sparse") == 0) {
+            flat_mem = false;
+        } else if (strcmp(argv[i], "--mem=flat") == 0) {
+            flat_mem = true;
+        } else if (strcmp(argv[i], "--fesvr-load") == 0) {
+            fesvr_loading = true;
+        } else if (strncmp(argv[i], "--axi-latency=", 14) == 0) {
+            AXI_CONFIG.latency = strtoul(argv[i] + 14, NULL, 0);
+        } else if (strncmp(argv[i], "--axi-bandwidth=", 16) == 0) {
+            AXI_CONFIG.bandwidth = strtoul(argv[i] + 16, NULL, 0);
+        } else if (strncmp(argv[i], "--axi-banks=", 12) == 0) {
+            AXI_CONFIG.banks = std::max(1UL, strtoul(argv[i] + 12, NULL, 0));
+        } else if (strncmp(argv[i], "--axi-row-size=", 15) == 0) {
+            AXI_CONFIG.row_size = strtoul(argv[i] + 15, NULL, 0);
+        } else if (strncmp(argv[i], "--axi-row-hit=", 14) == 0) {
+            AXI_CONFIG.row_hit = strtoul(argv[i] + 14, NULL, 0);
+        } else if (strncmp(argv[i], "--axi-row-miss=", 15) == 0) {
+            AXI_CONFIG.row_miss = strtoul(argv[i] + 15, NULL, 0);
+        } else if (strncmp(argv[i], "--axi-outstanding=", 18) == 0) {
+            AXI_CONFIG.max_reads = AXI_CONFIG.max_writes =
+                std::max(1UL, strtoul(argv[i] + 18, NULL, 0));
+        } else if (strncmp(argv[i], "--perf-dump=", 12) == 0) {
+            PERF.path = argv[i] + 12;
+        } else if (strncmp(argv[i], "--perf-at=", 10) == 0) {
+            for (char *p = argv[i] + 10; *p;) {
+                PERF.at_cycles.push_back(strtoul(p, &p, 0));
+                if (*p == ',') p++;
+                else break;
+            }
+        } else if (strncmp(argv[i], "--perf-every=", 13) == 0) {
+            PERF.every = strtoul(argv[i] + 13, NULL, 0);
+        } else if (strncmp(argv[i], "--traffic=", 10) == 0) {
+            TRAFFIC.path = argv[i] + 10;
+        } else if (strncmp(argv[i], "--traffic-bucket=", 17) == 0) {
+            TRAFFIC.bucket_cycles =
+                std::max(1UL, strtoul(argv[i] + 17, NULL, 0));
+        }
+    }
+    // Batch runs construct a `Sim` per binary and keep the existing window.
+    if (flat_mem && !MEM.flat) {
+        if (MEM.map_flat(BOOTDATA.global_mem_start, BOOTDATA.global_mem_end)) {
+            fprintf(stderr, "[TB] Flat memory 0x%lx-0x%lx\n",
+                    BOOTDATA.global_mem_start, BOOTDATA.global_mem_end);
+        } else {
+            fprintf(stderr,
+                    "[TB] Failed to map flat memory, using sparse pages\n");
+        }
+    }
+}
+
+template <typename Ehdr, typename Phdr>
+static size_t load_segments(const uint8_t *buf, size_t size,
+                            std::vector<std::pair<addr_t, size_t>> &segs) {
+    static const uint8_t zeros[GlobalMemory::PAGE_SIZE] = {0};
+    auto eh = reinterpret_cast<const Ehdr *>(buf);
+    if (eh->e_phoff + (size_t)eh->e_phnum * sizeof(Phdr) > size) return 0;
+    auto ph = reinterpret_cast<const Phdr *>(buf + eh->e_phoff);
+    size_t loaded = 0;
+    for (unsigned i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0) continue;
+        if (ph[i].p_offset + ph[i].p_filesz > size) continue;
+        MEM.write(ph[i].p_paddr, ph[i].p_filesz, buf + ph[i].p_offset,
+                  nullptr);
+        // Clear the `.bss`-like tail page by page.
+        for (size_t off = ph[i].p_filesz; off < ph[i].p_memsz;) {
+            size_t n = std::min<size_t>(ph[i].p_memsz - off, sizeof(zeros));
+            MEM.write(ph[i].p_paddr + off, n, zeros, nullptr);
+            off += n;
+        }
+        segs.emplace_back(ph[i].p_paddr, ph[i].p_memsz);
+        loaded += ph[i].p_memsz;
+    }
+    return loaded;
+}
+
+// Size of `struct putc_buffer` in the snRuntime's `start.c`, one per core
+// from `_edram` on.
+static size_t putc_buffer_size(bool rv64) { return rv64 ? 1088 : 1096; }
+
+// Name the regions of the traffic heatmap after the allocated sections of the
+// ELF. The putc buffers and the heap follow `_edram`. Stacks live in the TCDM
+// and never reach the global memory.
+template <typename Ehdr, typename Shdr, typename Sym>
+static void traffic_regions(const uint8_t *buf, size_t size) {
+    auto eh = reinterpret_cast<const Ehdr *>(buf);
+    if (eh->e_shoff + (size_t)eh->e_shnum * sizeof(Shdr) > size ||
+        eh->e_shstrndx >= eh->e_shnum)
+        return;
+    auto sh = reinterpret_cast<const Shdr *>(buf + eh->e_shoff);
+    auto name = [&](const Shdr &strtab, size_t off) -> const char * {
+        if (strtab.sh_offset + off >= size) return "";
+        return reinterpret_cast<const char *>(buf + strtab.sh_offset + off);
+    };
+    uint64_t edram = 0;
+    for (unsigned i = 0; i < eh->e_shnum; i++) {
+        // `.tbss` takes no space, it overlaps the sections behind it.
+        bool tbss = sh[i].sh_type == SHT_NOBITS && (sh[i].sh_flags & SHF_TLS);
+        if ((sh[i].sh_flags & SHF_ALLOC) && !tbss)
+            TRAFFIC.add_region(name(sh[eh->e_shstrndx], sh[i].sh_name),
+                               sh[i].sh_addr, sh[i].sh_size);
+        if (sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= eh->e_shnum ||
+            sh[i].sh_offset + sh[i].sh_size > size)
+            continue;
+        auto sym = reinterpret_cast<const Sym *>(buf + sh[i].sh_offset);
+        for (size_t j = 0; j < sh[i].sh_size / sizeof(Sym); j++) {
+            if (strcmp(name(sh[sh[i].sh_link], sym[j].st_name), "_edram") == 0)
+                edram = sym[j].st_value;
+        }
+    }
+    if (!edram || edram >= BOOTDATA.global_mem_end) return;
+    uint64_t putc_size = BOOTDATA.core_count *
+                         std::max<uint64_t>(BOOTDATA.cluster_count, 1) *
+                         putc_buffer_size(sizeof(Ehdr) == sizeof(Elf64_Ehdr));
+    TRAFFIC.add_region("putc_buffers", edram, putc_size);
+    if (edram + putc_size < BOOTDATA.global_mem_end)
+        TRAFFIC.add_region("heap", edram + putc_size,
+                           BOOTDATA.global_mem_end - edram - putc_size);
+}
+
+// Map a little-endian ELF and pass it to `fn(buf, size, elf64)`. Returns -1
+// if the file is unusable, and the result of `fn` otherwise.
+template <typename F>
+static long with_elf(const char *path, F fn) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < EI_NIDENT) {
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+    void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return -1;
+    auto buf = reinterpret_cast<const uint8_t *>(ptr);
+    long result = -1;
+    if (memcmp(buf, ELFMAG, SELFMAG) == 0 && buf[EI_DATA] == ELFDATA2LSB) {
+        if (buf[EI_CLASS] == ELFCLASS32 && size >= sizeof(Elf32_Ehdr))
+            result = fn(buf, size, false);
+        else if (buf[EI_CLASS] == ELFCLASS64 && size >= sizeof(Elf64_Ehdr))
+            result = fn(buf, size, true);
+    }
+    munmap(ptr, size);
+    return result;
+}
+
+long Sim::preload_elf(const char *path) {
+    // Only little-endian ELFs are loaded here, fesvr handles everything else.
+    return with_elf(path, [&](const uint8_t *buf, size_t size, bool elf64) {
+        return elf64
+                   ? load_segments<Elf64_Ehdr, Elf64_Phdr>(buf, size, preloaded)
+                   : load_segments<Elf32_Ehdr, Elf32_Phdr>(buf, size, preloaded);
+    });
+}
+
 // Override HTIF to populate bootloader with system specification and entry
 // symbol.
 void Sim::start() {
+    auto t0 = std::chrono::steady_clock::now();
+    const auto &targs = target_args();
+    if (!disable_preloading && !fesvr_loading && !targs.empty() &&
+        targs[0] != "none") {
+        long loaded = preload_elf(targs[0].c_str());
+        if (loaded >= 0) {
+            auto t1 = std::chrono::steady_clock::now();
+            fprintf(stderr, "[TB] Preloaded %ld bytes of `%s` in %.3f ms\n",
+                    loaded, targs[0].c_str(),
+                    std::chrono::duration<double, std::milli>(t1 - t0).count());
+        }
+    }
+    if (TRAFFIC.enabled() && !targs.empty() && targs[0] != "none") {
+        with_elf(targs[0].c_str(),
+                 [](const uint8_t *buf, size_t size, bool elf64) {
+                     if (elf64)
+                         traffic_regions<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(
+                             buf, size);
+                     else
+                         traffic_regions<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(
+                             buf, size);
+                     return 0L;
+                 });
+    }
+    // fesvr still parses the ELF for its symbols and loads anything that
+    // has not been preloaded.
     htif_t::start();
+    // Let the driver know when the target talks to fesvr.
+    MEM.watch(get_tohost_addr(), get_fromhost_addr());
+    auto t2 = std::chrono::steady_clock::now();
+    fprintf(stderr, "[TB] Program load finished in %.3f ms\n",
+            std::chrono::duration<double, std::milli>(t2 - t0).count());
 }
 
 void Sim::read_chunk(addr_t taddr, size_t len, void *dst) {
     MEM.read(taddr, len, reinterpret_cast<uint8_t *>(dst));
+    TRAFFIC.record(0, taddr, len, false, true);
 }
 
 void Sim::write_chunk(addr_t taddr, size_t len, const void *src) {
-    uint8_t strb[8] = {1, 1, 1, 1, 1, 1, 1, 1};
-    MEM.write(taddr, len, reinterpret_cast<const uint8_t *>(src), strb);
+    host_writes++;
+    MEM.write(taddr, len, reinterpret_cast<const uint8_t *>(src), nullptr);
+    TRAFFIC.record(0, taddr, len, true, true);
 }
 
 }  // namespace sim
+
+// DPI calls.
+extern "C" void tb_cluster_probe(int value) {
+    sim::CLUSTER_PROBE = value;
+    sim::CLUSTER_PROBE_CHANGES++;
+}
+
+extern "C" int tb_trace_enabled() { return sim::TRACE_ENABLED; }
+
+extern "C" int tb_perf_enabled() { return sim::PERF.enabled(); }
+
+extern "C" void tb_perf_cycle(int hart_base, int num_cores, int probe,
+                              const svOpenArrayHandle events,
+                              const svOpenArrayHandle counters,
+                              const svOpenArrayHandle enable,
+                              const svOpenArrayHandle hart_select) {
+    sim::PERF.cycle(hart_base, num_cores, probe,
+                    (const uint32_t *)svGetArrayPtr(events),
+                    svSize(counters, 1),
+                    (const uint64_t *)svGetArrayPtr(counters),
+                    (const uint32_t *)svGetArrayPtr(enable),
+                    (const uint32_t *)svGetArrayPtr(hart_select));
+}
+
+extern "C" void tb_perf_finish() { sim::PERF.finish(); }
+
+extern "C" int tb_traffic_enabled() { return sim::TRAFFIC.enabled(); }
+
+extern "C" void tb_traffic_record(long long cycle, long long addr, int len,
+                                  svBit write) {
+    sim::TRAFFIC.record(cycle, addr, len, write);
+}
+
+extern "C" void tb_traffic_finish() { sim::TRAFFIC.finish(); }
+
+// Binary instruction traces (`TB_TRACE_BINARY`), one writer per hart. The
+// writers are flushed by `tb_trace_close` or at exit.
+static std::map<int, std::unique_ptr<sim::trace::TraceWriter>> TRACE_WRITERS;
+
+static sim::trace::TraceWriter *trace_writer(int hart) {
+    auto &writer = TRACE_WRITERS[hart];
+    if (!writer) {
+        char path[64];
+        mkdir("logs", 0755);
+        snprintf(path, sizeof(path), "logs/trace_hart_%05x.bin", hart);
+        writer = std::make_unique<sim::trace::TraceWriter>(path, hart);
+        fprintf(stderr, "[Tracer] Logging Hart %d to %s\n", hart, path);
+        if (!writer->ok()) fprintf(stderr, "[Tracer] Cannot open %s\n", path);
+    }
+    return writer->ok() ? writer.get() : nullptr;
+}
+
+// Unpack the 64-bit fields of a packed trace port struct. The first field
+// holds the most significant bits.
+static void trace_fields(sim::trace::Source source, const svBitVecVal *extras,
+                         uint64_t *fields) {
+    size_t num = sim::trace::SOURCE_FIELDS[source].size();
+    for (size_t i = 0; i < num; i++) {
+        size_t word = (num - 1 - i) * 2;
+        fields[i] = extras[word] | (uint64_t)extras[word + 1] << 32;
+    }
+}
+
+extern "C" void tb_trace_snitch(int hart, long long time, long long cycle,
+                                int priv, int pc, int insn,
+                                const svBitVecVal *extras) {
+    auto writer = trace_writer(hart);
+    if (!writer) return;
+    uint64_t fields[64];
+    trace_fields(sim::trace::SrcSnitch, extras, fields);
+    writer->record(sim::trace::SrcSnitch, time, cycle, priv, true,
+                   (uint32_t)pc, (uint32_t)insn, fields);
+}
+
+extern "C" void tb_trace_fpu(int hart, long long time, long long cycle,
+                             int priv, long long insn,
+                             const svBitVecVal *extras) {
+    auto writer = trace_writer(hart);
+    if (!writer) return;
+    uint64_t fields[64];
+    trace_fields(sim::trace::SrcFpu, extras, fields);
+    writer->record(sim::trace::SrcFpu, time, cycle, priv, false, 0, insn,
+                   fields);
+}
+
+extern "C" void tb_trace_close(int hart) { TRACE_WRITERS.erase(hart); }
+
+extern "C" int tb_axi_model_new(int data_bytes) {
+    sim::AXI_PORTS.ports.emplace_back(data_bytes, nullptr);
+    return sim::AXI_PORTS.ports.size() - 1;
+}
+
+static sim::AxiModel &axi_port(int port) {
+    auto &p = sim::AXI_PORTS.ports.at(port);
+    if (!p.second)
+        p.second = std::make_unique<sim::AxiModel>(p.first, sim::AXI_CONFIG);
+    return *p.second;
+}
+
+const char *sim::unsaved_state() {
+    if (sim::PERF.enabled()) return "--perf-dump";
+    if (sim::TRAFFIC.enabled()) return "--traffic";
+    if (!sim::AXI_PORTS.ports.empty())
+        return "the AXI burst model (TB_AXI_MODEL=1)";
+    if (!TRACE_WRITERS.empty()) return "binary traces (TRACE_FORMAT=bin)";
+    return nullptr;
+}
+
+extern "C" void tb_axi_model_reset(int port) {
+    axi_port(port).reset(sim::AXI_CONFIG);
+}
+
+extern "C" void tb_axi_model_cycle(
+    int port, svBit aw_fire, long long aw_id, long long aw_addr, int aw_len,
+    int aw_size, int aw_burst, svBit w_fire, const svOpenArrayHandle w_data,
+    const svOpenArrayHandle w_strb, svBit b_fire, svBit ar_fire,
+    long long ar_id, long long ar_addr, int ar_len, int ar_size, int ar_burst,
+    svBit r_fire, svBit *aw_ready, svBit *w_ready, svBit *ar_ready,
+    svBit *b_valid, long long *b_id, svBit *r_valid, long long *r_id,
+    const svOpenArrayHandle r_data, svBit *r_last) {
+    sim::AxiModel::Inputs in = {
+        aw_fire != 0,
+        (uint64_t)aw_id,
+        (uint64_t)aw_addr,
+        (unsigned)aw_len,
+        (unsigned)aw_size,
+        (unsigned)aw_burst,
+        w_fire != 0,
+        (const uint8_t *)svGetArrayPtr(w_data),
+        (const uint8_t *)svGetArrayPtr(w_strb),
+        b_fire != 0,
+        ar_fire != 0,
+        (uint64_t)ar_id,
+        (uint64_t)ar_addr,
+        (unsigned)ar_len,
+        (unsigned)ar_size,
+        (unsigned)ar_burst,
+        r_fire != 0,
+    };
+    sim::AxiModel::Outputs out = {};
+    out.r_data = (uint8_t *)svGetArrayPtr(r_data);
+    axi_port(port).cycle(in, out);
+    *aw_ready = out.aw_ready;
+    *w_ready = out.w_ready;
+    *ar_ready = out.ar_ready;
+    *b_valid = out.b_valid;
+    *b_id = out.b_id;
+    *r_valid = out.r_valid;
+    *r_id = out.r_id;
+    *r_last = out.r_last;
+}
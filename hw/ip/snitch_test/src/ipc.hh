@@ -6,14 +6,19 @@
 
 #pragma once
 
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <map>
+#include <string>
 #include <tb_lib.hh>
 
 class IpcIface {
@@ -21,16 +26,24 @@ class IpcIface {
     static const int IPC_BUF_SIZE = 4096;
     static const int IPC_BUF_SIZE_STRB = IPC_BUF_SIZE / 8 + 1;
     static const int IPC_ERR_DOUBLE_ARG = 30;
-    static const long IPC_POLL_PERIOD_NS = 100000L;
+
+    // Log every command (`--ipc-debug`). Off by default, as the logging costs
+    // more than the commands themselves.
+    static inline bool debug = false;
 
     // Possible IPC operations
     enum ipc_opcode_e {
         Read = 0,
         Write = 1,
         Poll = 2,
+        Map = 3,
+        Unmap = 4,
     };
 
-    // Operations are 3 doubles, followed by data streams in either direction
+    // Operations are 3 doubles, followed by data streams in either direction.
+    // `Map` is followed by a 64b path length and the path of a file (e.g., in
+    // `/dev/shm`) whose first `len` bytes are mapped at `addr`. `Map` and
+    // `Unmap` answer with a 64b status, zero on success.
     typedef struct {
         uint64_t opcode;
         uint64_t addr;
@@ -43,11 +56,86 @@ class IpcIface {
         char* rx;
     } ipc_targs_t;
 
+    // Shared-memory transport. The host creates a file (e.g., in `/dev/shm`)
+    // that starts with this header, followed by the command slots. The
+    // staging area and the window follow at the given page-aligned offsets.
+    // The window is mapped into simulation memory at `window_base`, so the
+    // host accesses it without any copy or command. Commands (`Read`,
+    // `Write`, `Poll`) are posted to the ring by advancing `head`; `Read` and
+    // `Write` copy `len` bytes between `addr` and the staging area at
+    // `offset`. The FIFOs only carry wakeups: the host writes `head` to the
+    // kick FIFO after posting, the simulation answers with `tail` on the done
+    // FIFO once all posted commands completed. Their syscalls order the ring
+    // accesses on both ends, so the host needs no atomics.
+    static constexpr uint64_t IPC_SHM_MAGIC = 0x4d48534350494e53ULL;  // "SNIPCSHM"
+
+    typedef struct {
+        uint64_t magic;
+        uint64_t num_slots;  // power of two
+        uint64_t stage_offset;
+        uint64_t stage_size;
+        uint64_t window_offset;
+        uint64_t window_size;
+        uint64_t window_base;
+        uint64_t reserved;
+        alignas(64) uint64_t head;  // written by the host
+        alignas(64) uint64_t tail;  // written by the simulation
+        alignas(64) uint64_t pad[8];
+    } ipc_shm_hdr_t;
+
+    typedef struct {
+        uint64_t opcode;
+        uint64_t addr;
+        uint64_t len;  // `Poll`: 32b mask, 32b expected value
+        uint64_t offset;
+        uint64_t result;  // `Poll`: read word, `-1` on a bad command
+        uint64_t pad[3];
+    } ipc_shm_slot_t;
+
+    static_assert(sizeof(ipc_shm_hdr_t) == 256, "host relies on the layout");
+    static_assert(sizeof(ipc_shm_slot_t) == 64, "host relies on the layout");
+
+    typedef struct {
+        char* shm;
+        char* kick;
+        char* done;
+    } ipc_shm_targs_t;
+
     // Thread to asynchronously handle FIFOs
     ipc_targs_t targs;
     pthread_t thread;
     bool active;
 
+    // Thread to handle the shared-memory ring
+    ipc_shm_targs_t shm_targs;
+    pthread_t shm_thread;
+    bool shm_active;
+
+    // Map `len` bytes of the file at `path` into simulation memory at `addr`.
+    static int map_file(uint64_t addr, uint64_t len, const char* path,
+                        std::map<uint64_t, std::pair<void*, size_t>>& maps) {
+        int fd = open(path, O_RDWR);
+        if (fd < 0) return -1;
+        void* ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (ptr == MAP_FAILED) return -1;
+        if (!sim::MEM.add_mapping(addr, len, (uint8_t*)ptr)) {
+            munmap(ptr, len);
+            return -1;
+        }
+        maps[addr] = {ptr, len};
+        return 0;
+    }
+
+    static int unmap_file(uint64_t addr,
+                          std::map<uint64_t, std::pair<void*, size_t>>& maps) {
+        auto it = maps.find(addr);
+        if (it == maps.end() || !sim::MEM.remove_mapping(addr)) return -1;
+        munmap(it->second.first, it->second.second);
+        maps.erase(it);
+        return 0;
+    }
+
     static void* ipc_thread_handle(void* in) {
         ipc_targs_t* targs = (ipc_targs_t*)in;
         // Open FIFOs
@@ -57,14 +145,17 @@ class IpcIface {
         uint8_t buf_data[IPC_BUF_SIZE];
         uint8_t buf_strb[IPC_BUF_SIZE_STRB];
         std::fill_n(buf_strb, IPC_BUF_SIZE_STRB, 0xFF);
+        // Host files currently mapped into simulation memory
+        std::map<uint64_t, std::pair<void*, size_t>> maps;
         // Handle commands
         ipc_op_t op;
         while (fread(&op, sizeof(ipc_op_t), 1, tx)) {
             switch (op.opcode) {
                 case Read:
                     // Read full blocks until one full block or less left
-                    printf("[IPC] Read from 0x%lx len %lu ...\n", op.addr,
-                           op.len);
+                    if (debug)
+                        printf("[IPC] Read from 0x%lx len %lu ...\n", op.addr,
+                               op.len);
                     for (uint64_t i = op.len; i > IPC_BUF_SIZE;
                          i -= IPC_BUF_SIZE) {
                         sim::MEM.read(op.addr, IPC_BUF_SIZE, buf_data);
@@ -76,7 +167,9 @@ class IpcIface {
                     break;
                 case Write:
                     // Write full blocks until one full block or less left
-                    printf("[IPC] Write to 0x%lx len %lu ...\n", op.addr, op.len);
+                    if (debug)
+                        printf("[IPC] Write to 0x%lx len %lu ...\n", op.addr,
+                               op.len);
                     for (uint64_t i = op.len; i > IPC_BUF_SIZE;
                          i -= IPC_BUF_SIZE) {
                         fread(buf_data, IPC_BUF_SIZE, 1, tx);
@@ -86,40 +179,181 @@ class IpcIface {
                     fread(buf_data, op.len, 1, tx);
                     sim::MEM.write(op.addr, op.len, buf_data, buf_strb);
                     break;
-                case Poll:
+                case Poll: {
                     // Unpack 32b checking mask and expected value from length
                     uint32_t mask = op.len & 0xFFFFFFFF;
                     uint32_t expected = (op.len >> 32) & 0xFFFFFFFF;
-                    printf("[IPC] Poll on 0x%lx mask 0x%x expected 0x%x ...\n",
-                           op.addr, mask, expected);
-                    uint32_t read;
-                    do {
-                        sim::MEM.read(op.addr, sizeof(uint32_t),
-                                      (uint8_t*)(void*)&read);
-                        nanosleep(
-                            (const struct timespec[]){{0, IPC_POLL_PERIOD_NS}},
-                            NULL);
-                    } while ((read & mask) == (expected & mask));
+                    if (debug)
+                        printf(
+                            "[IPC] Poll on 0x%lx mask 0x%x expected 0x%x ...\n",
+                            op.addr, mask, expected);
+                    // Sleep until a write to the word changes it
+                    uint32_t read = sim::MEM.wait_change(op.addr, mask, expected);
                     // Send back read 32b word
                     fwrite(&read, sizeof(uint32_t), 1, rx);
                     fflush(rx);
                     break;
+                }
+                case Map: {
+                    uint64_t path_len, status = -1;
+                    fread(&path_len, sizeof(uint64_t), 1, tx);
+                    std::string path(path_len, '\0');
+                    fread(&path[0], path_len, 1, tx);
+                    if (debug)
+                        printf("[IPC] Map `%s` to 0x%lx len %lu ...\n",
+                               path.c_str(), op.addr, op.len);
+                    if (map_file(op.addr, op.len, path.c_str(), maps) == 0)
+                        status = 0;
+                    fwrite(&status, sizeof(uint64_t), 1, rx);
+                    fflush(rx);
+                    break;
+                }
+                case Unmap: {
+                    uint64_t status = -1;
+                    if (debug) printf("[IPC] Unmap 0x%lx ...\n", op.addr);
+                    if (unmap_file(op.addr, maps) == 0) status = 0;
+                    fwrite(&status, sizeof(uint64_t), 1, rx);
+                    fflush(rx);
+                    break;
+                }
             }
-            printf("[IPC] ... done\n");
+            if (debug) printf("[IPC] ... done\n");
         }
-        // TX FIFO closed at other end: close both FIFOs and join main thread
+        // TX FIFO closed at other end: drop mappings, close both FIFOs and
+        // join main thread
+        while (!maps.empty()) unmap_file(maps.begin()->first, maps);
         fclose(tx);
         fclose(rx);
         pthread_exit(NULL);
     }
 
+    // Execute one command of the shared-memory ring.
+    static void shm_execute(ipc_shm_slot_t& slot, uint8_t* stage,
+                            uint64_t stage_size) {
+        slot.result = 0;
+        if (debug)
+            printf("[IPC] Command %lu on 0x%lx len 0x%lx ...\n", slot.opcode,
+                   slot.addr, slot.len);
+        switch (slot.opcode) {
+            case Read:
+            case Write:
+                if (slot.offset > stage_size ||
+                    slot.len > stage_size - slot.offset) {
+                    slot.result = -1;
+                } else if (slot.opcode == Read) {
+                    sim::MEM.read(slot.addr, slot.len, stage + slot.offset);
+                } else {
+                    sim::MEM.write(slot.addr, slot.len, stage + slot.offset,
+                                   nullptr);
+                }
+                break;
+            case Poll:
+                // Woken up by the write path through a watchpoint
+                slot.result = sim::MEM.wait_change(
+                    slot.addr, slot.len & 0xFFFFFFFF, slot.len >> 32);
+                break;
+            default:
+                slot.result = -1;
+                break;
+        }
+        if (debug) printf("[IPC] ... done\n");
+    }
+
+    static void* shm_thread_handle(void* in) {
+        ipc_shm_targs_t* targs = (ipc_shm_targs_t*)in;
+        // Map the shared region and check its layout
+        int fd = open(targs->shm, O_RDWR);
+        struct stat st;
+        uint8_t* base = (uint8_t*)MAP_FAILED;
+        if (fd >= 0 && fstat(fd, &st) == 0 &&
+            (size_t)st.st_size >= sizeof(ipc_shm_hdr_t))
+            base = (uint8_t*)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, fd, 0);
+        if (fd >= 0) close(fd);
+        if (base == MAP_FAILED) {
+            fprintf(stderr, "[IPC] Cannot map shared memory `%s`\n",
+                    targs->shm);
+            exit(1);
+        }
+        ipc_shm_hdr_t* hdr = (ipc_shm_hdr_t*)base;
+        uint64_t size = st.st_size;
+        uint64_t slots_end =
+            sizeof(ipc_shm_hdr_t) + hdr->num_slots * sizeof(ipc_shm_slot_t);
+        if (hdr->magic != IPC_SHM_MAGIC || hdr->num_slots == 0 ||
+            (hdr->num_slots & (hdr->num_slots - 1)) || slots_end > size ||
+            hdr->stage_offset > size ||
+            hdr->stage_size > size - hdr->stage_offset ||
+            hdr->window_offset > size ||
+            hdr->window_size > size - hdr->window_offset) {
+            fprintf(stderr, "[IPC] Bad shared memory layout in `%s`\n",
+                    targs->shm);
+            exit(1);
+        }
+        ipc_shm_slot_t* slots = (ipc_shm_slot_t*)(base + sizeof(ipc_shm_hdr_t));
+        uint8_t* stage = base + hdr->stage_offset;
+        if (hdr->window_size &&
+            !sim::MEM.add_mapping(hdr->window_base, hdr->window_size,
+                                  base + hdr->window_offset)) {
+            fprintf(stderr, "[IPC] Cannot map window at 0x%lx\n",
+                    hdr->window_base);
+            exit(1);
+        }
+        printf("[IPC] Shared memory `%s`: %lu slots, %lu B staging, %lu B "
+               "window at 0x%lx\n",
+               targs->shm, hdr->num_slots, hdr->stage_size, hdr->window_size,
+               hdr->window_base);
+        // Open the wakeup FIFOs in the same order as the host
+        int kick = open(targs->kick, O_RDONLY);
+        int done = open(targs->done, O_WRONLY);
+        // Handle commands until the kick FIFO is closed
+        uint64_t tail = hdr->tail, head, commands = 0;
+        while (read(kick, &head, sizeof(head)) == sizeof(head)) {
+            head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+            for (; tail != head; tail++, commands++) {
+                shm_execute(slots[tail & (hdr->num_slots - 1)], stage,
+                            hdr->stage_size);
+                __atomic_store_n(&hdr->tail, tail + 1, __ATOMIC_RELEASE);
+            }
+            if (write(done, &tail, sizeof(tail)) != sizeof(tail)) break;
+        }
+        printf("[IPC] Shared memory transport handled %lu commands\n",
+               commands);
+        if (hdr->window_size) sim::MEM.remove_mapping(hdr->window_base);
+        munmap(base, size);
+        close(kick);
+        close(done);
+        pthread_exit(NULL);
+    }
+
    public:
     // Conditionally construct IPC iff any arguments specify it
     IpcIface(int argc, char** argv) {
         static constexpr char IPC_FLAG[6] = "--ipc";
+        static constexpr char IPC_SHM_FLAG[10] = "--ipc-shm";
         active = false;
+        shm_active = false;
+        for (auto i = 1; i < argc; ++i)
+            if (strcmp(argv[i], "--ipc-debug") == 0) debug = true;
         for (auto i = 1; i < argc; ++i) {
-            if (strncmp(argv[i], IPC_FLAG, strlen(IPC_FLAG)) == 0) {
+            if (strcmp(argv[i], "--ipc-debug") == 0) {
+                continue;
+            } else if (strncmp(argv[i], IPC_SHM_FLAG, strlen(IPC_SHM_FLAG)) == 0) {
+                if (shm_active) {
+                    fprintf(stderr, "[IPC] Duplicate IPC thread args: %s",
+                            argv[i]);
+                    exit(IPC_ERR_DOUBLE_ARG);
+                }
+                // `--ipc-shm,<shm>,<kick>,<done>`
+                char* ipc_args = argv[i] + strlen(IPC_SHM_FLAG) + 1;
+                shm_targs.shm = strtok(ipc_args, ",");
+                shm_targs.kick = strtok(NULL, ",");
+                shm_targs.done = strtok(NULL, ",");
+                // Writes must notify the thread's polls from the start
+                sim::MEM.num_observers++;
+                pthread_create(&shm_thread, NULL, *shm_thread_handle,
+                               (void*)&shm_targs);
+                shm_active = true;
+            } else if (strncmp(argv[i], IPC_FLAG, strlen(IPC_FLAG)) == 0) {
                 // Check for duplicate args
                 if (active) {
                     fprintf(stderr, "[IPC] Duplicate IPC thread args: %s",
@@ -130,6 +364,8 @@ class IpcIface {
                 char* ipc_args = argv[i] + strlen(IPC_FLAG) + 1;
                 targs.tx = strtok(ipc_args, ",");
                 targs.rx = strtok(NULL, ",");
+                // Writes must notify the thread's polls from the start
+                sim::MEM.num_observers++;
                 // Initialize IO thread which will handle TX, RX pipes
                 pthread_create(&thread, NULL, *ipc_thread_handle,
                                (void*)&targs);
@@ -146,7 +382,14 @@ class IpcIface {
         if (active) {
             pthread_join(thread, NULL);
             printf("[IPC] Thread joined\n");
+            sim::MEM.num_observers--;
             active = false;
         }
+        if (shm_active) {
+            pthread_join(shm_thread, NULL);
+            printf("[IPC] Shared memory thread joined\n");
+            sim::MEM.num_observers--;
+            shm_active = false;
+        }
     }
 };
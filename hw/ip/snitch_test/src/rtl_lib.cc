@@ -31,6 +31,7 @@ Sim::Sim(int argc, char **argv) : htif_t(argc, argv) {
             disable_preloading = true;
         }
     }
+    parse_args(argc, argv);
     host = context_t::current();
     target.init(sim_thread_main, this);
     target.switch_to();
@@ -112,7 +113,7 @@ void tb_memory_read(long long addr, int len, const svOpenArrayHandle data) {
     //           << " bytes)\n";
     void *data_ptr = svGetArrayPtr(data);
     assert(data_ptr);
-    sim::MEM.read(addr, len, (uint8_t *)data_ptr);
+    sim::REGBUS_READS.read(addr, len, (uint8_t *)data_ptr);
 }
 
 void tb_memory_write(long long addr, int len, const svOpenArrayHandle data,
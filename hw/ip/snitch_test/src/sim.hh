@@ -6,11 +6,19 @@
 #include <fesvr/context.h>
 #include <fesvr/htif.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -21,6 +29,9 @@ using namespace std::chrono_literals;
 struct Sim : htif_t {
     Sim(int argc, char **argv);
 
+    // Parse the testbench arguments shared by all simulators.
+    void parse_args(int argc, char **argv);
+
     virtual void start();
 
     int run();
@@ -30,9 +41,18 @@ struct Sim : htif_t {
     void read_chunk(addr_t taddr, size_t len, void *dst);
     void write_chunk(addr_t taddr, size_t len, const void *src);
     bool is_address_preloaded(addr_t taddr, size_t len) override {
-        return disable_preloading;
+        if (disable_preloading) return true;
+        for (const auto &seg : preloaded) {
+            if (taddr >= seg.first && taddr - seg.first + len <= seg.second)
+                return true;
+        }
+        return false;
     }
 
+    // Copy all loadable segments of an ELF straight into the global memory.
+    // Returns the number of bytes loaded, or -1 if the file is unusable.
+    long preload_elf(const char *path);
+
     void idle();
 
     // Force alignment to 8 byte.
@@ -44,13 +64,29 @@ struct Sim : htif_t {
 
     int entry_point() { return get_entry_point(); }
 
+    // Number of memory writes issued by fesvr so far.
+    uint64_t host_writes = 0;
+    // Set by the driver when the binary exceeded its cycle budget.
+    bool timed_out = false;
+
    private:
     context_t *host;
     context_t target;
     bool vlt_vcd = false;
     bool disable_preloading = false;
+    bool fesvr_loading = false;
+    // Address ranges loaded by `preload_elf`, skipped by fesvr.
+    std::vector<std::pair<addr_t, size_t>> preloaded;
 };
 
 void sim_thread_main(void *arg);
 
+// Run every binary of the manifest given as `--batch=<manifest>` in `argv[1]`
+// on one model. Verilator only.
+int run_batch(int argc, char **argv);
+
+// Name of an active testbench feature whose state snapshots do not capture,
+// or null if the simulation can be saved and restored.
+const char *unsaved_state();
+
 }  // namespace sim
@@ -0,0 +1,340 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Solderpad Hardware License, Version 0.51, see LICENSE for details.
+// SPDX-License-Identifier: SHL-0.51
+
+#pragma once
+#include <deque>
+
+#include "tb_lib.hh"
+#include "tb_traffic.hh"
+
+namespace sim {
+
+// Timing of the AXI burst memory model. All times are in cycles of the port
+// clock.
+struct AxiModelConfig {
+    // Cycles from accepting a request until it can be scheduled.
+    uint64_t latency = 0;
+    // Data bytes transferred per cycle, zero for the full bus width.
+    uint64_t bandwidth = 0;
+    // DRAM banks. Each bank keeps one row open; addresses are interleaved
+    // across banks at row granularity. A row size of zero disables the row
+    // buffer model.
+    uint64_t banks = 1;
+    uint64_t row_size = 0;
+    uint64_t row_hit = 0;
+    uint64_t row_miss = 0;
+    // Maximum outstanding reads and writes.
+    uint64_t max_reads = 64;
+    uint64_t max_writes = 64;
+    // Requests the scheduler considers each cycle.
+    uint64_t window = 16;
+};
+extern AxiModelConfig AXI_CONFIG;
+
+// AXI slave that takes whole bursts and returns them with DRAM-like timing.
+// Reads sample the memory when they are accepted, writes update it as their
+// data beats arrive. Responses with the same ID are returned in order;
+// different IDs may overtake each other, e.g., when a row hit is scheduled
+// before an older row miss.
+class AxiModel {
+   public:
+    AxiModel(size_t data_bytes, const AxiModelConfig &cfg)
+        : data_bytes(data_bytes),
+          cfg(cfg),
+          bandwidth(cfg.bandwidth ? cfg.bandwidth : data_bytes),
+          bank_free(std::max<uint64_t>(cfg.banks, 1), 0),
+          open_row(std::max<uint64_t>(cfg.banks, 1), UINT64_MAX) {}
+
+    enum Burst { Fixed = 0, Incr = 1, Wrap = 2 };
+
+    // Inputs sampled at a clock edge. `*_fire` flags a handshake on the
+    // channel in the cycle that ends at this edge.
+    struct Inputs {
+        bool aw_fire;
+        uint64_t aw_id, aw_addr;
+        unsigned aw_len, aw_size, aw_burst;
+        bool w_fire;
+        const uint8_t *w_data, *w_strb;
+        bool b_fire;
+        bool ar_fire;
+        uint64_t ar_id, ar_addr;
+        unsigned ar_len, ar_size, ar_burst;
+        bool r_fire;
+    };
+
+    // Outputs driven for the next cycle.
+    struct Outputs {
+        bool aw_ready, w_ready, ar_ready;
+        bool b_valid;
+        uint64_t b_id;
+        bool r_valid, r_last;
+        uint64_t r_id;
+        uint8_t *r_data;  // `data_bytes` long
+    };
+
+    // Drop all transactions and pick up `config`, which may differ between
+    // the binaries of a batch.
+    void reset(const AxiModelConfig &config) {
+        cfg = config;
+        bandwidth = cfg.bandwidth ? cfg.bandwidth : data_bytes;
+        reads.clear();
+        writes.clear();
+        w_beats.clear();
+        r_current = b_current = nullptr;
+        num_reads = num_writes = 0;
+        bank_free.assign(std::max<uint64_t>(cfg.banks, 1), 0);
+        open_row.assign(std::max<uint64_t>(cfg.banks, 1), UINT64_MAX);
+        bus_free = 0;
+        run_start = now;
+    }
+
+    // Advance the model by one cycle.
+    void cycle(const Inputs &in, Outputs &out) {
+        // Retire the handshakes of the last cycle.
+        if (in.r_fire) retire_read_beat();
+        if (in.b_fire) retire_write();
+        if (in.ar_fire) {
+            auto t = std::make_unique<Txn>(make_txn(
+                in.ar_id, in.ar_addr, in.ar_len, in.ar_size, in.ar_burst));
+            t->data.resize((t->beats.size()) * data_bytes);
+            for (size_t i = 0; i < t->beats.size(); i++) {
+                MEM.read(t->beats[i], data_bytes, &t->data[i * data_bytes]);
+                TRAFFIC.record(now - run_start, t->beats[i], data_bytes, false);
+            }
+            reads.push_back(std::move(t));
+            num_reads++;
+            stats.reads++;
+        }
+        if (in.aw_fire) {
+            writes.push_back(std::make_unique<Txn>(make_txn(
+                in.aw_id, in.aw_addr, in.aw_len, in.aw_size, in.aw_burst)));
+            num_writes++;
+            stats.writes++;
+        }
+        if (in.w_fire) {
+            w_beats.emplace_back(2 * data_bytes);
+            memcpy(&w_beats.back()[0], in.w_data, data_bytes);
+            memcpy(&w_beats.back()[data_bytes], in.w_strb, data_bytes);
+        }
+        match_write_data();
+        schedule();
+        drive(out);
+        now++;
+    }
+
+    struct Stats {
+        uint64_t reads = 0, writes = 0, bytes = 0;
+        uint64_t row_hits = 0, row_misses = 0;
+        uint64_t read_latency = 0;  // Sum of accept-to-first-beat cycles
+    } stats;
+
+    uint64_t cycles() const { return now; }
+
+   private:
+    static constexpr uint64_t NEVER = UINT64_MAX;
+
+    struct Txn {
+        uint64_t id;
+        // Bus-aligned address of each beat.
+        std::vector<uint64_t> beats;
+        size_t bytes;
+        uint64_t accepted;
+        // Cycle the request can be scheduled at the earliest. Writes also
+        // wait for all of their data.
+        uint64_t eligible = NEVER;
+        // Cycle of the first data beat and cycles per beat, once scheduled.
+        uint64_t first_beat = NEVER;
+        uint64_t beat_cycles = 1;
+        // Write beats received, read beats returned.
+        size_t done = 0;
+        std::vector<uint8_t> data;
+        bool scheduled() const { return first_beat != NEVER; }
+        uint64_t beat_ready(size_t i) const { return first_beat + i * beat_cycles; }
+    };
+
+    Txn make_txn(uint64_t id, uint64_t addr, unsigned len, unsigned size,
+                 unsigned burst) {
+        Txn t;
+        t.id = id;
+        t.accepted = now;
+        uint64_t beat_bytes = (uint64_t)1 << size;
+        uint64_t num_beats = (uint64_t)len + 1;
+        uint64_t aligned = addr & ~(beat_bytes - 1);
+        uint64_t wrap_bytes = beat_bytes * num_beats;
+        uint64_t lower = addr & ~(wrap_bytes - 1);
+        for (uint64_t i = 0; i < num_beats; i++) {
+            uint64_t a;
+            switch (burst) {
+                case Fixed:
+                    a = addr;
+                    break;
+                case Wrap:
+                    a = lower + (aligned - lower + i * beat_bytes) % wrap_bytes;
+                    break;
+                default:
+                    a = i ? aligned + i * beat_bytes : addr;
+                    break;
+            }
+            t.beats.push_back(a & ~(uint64_t)(data_bytes - 1));
+        }
+        t.bytes = num_beats * beat_bytes;
+        t.eligible = now + cfg.latency;
+        return t;
+    }
+
+    // Write buffered W beats into the oldest writes still expecting data.
+    void match_write_data() {
+        for (auto &t : writes) {
+            if (w_beats.empty()) break;
+            if (t->done == t->beats.size()) continue;
+            while (t->done < t->beats.size() && !w_beats.empty()) {
+                auto &beat = w_beats.front();
+                MEM.write(t->beats[t->done], data_bytes, &beat[0],
+                          &beat[data_bytes]);
+                TRAFFIC.record(now - run_start, t->beats[t->done],
+                               std::count_if(&beat[data_bytes],
+                                             &beat[2 * data_bytes],
+                                             [](uint8_t s) { return s != 0; }),
+                               true);
+                w_beats.pop_front();
+                t->done++;
+            }
+            // Schedule the write once all of its data arrived.
+            if (t->done == t->beats.size())
+                t->eligible = std::max(t->eligible, now);
+        }
+    }
+
+    // Pick at most one request per cycle: the oldest row hit on a free bank,
+    // otherwise the oldest request on a free bank.
+    void schedule() {
+        Txn *pick = nullptr;
+        bool pick_hit = false;
+        size_t seen = 0;
+        auto consider = [&](Txn *t, bool is_write) {
+            if (t->scheduled() || seen >= cfg.window) return;
+            if (is_write && t->done < t->beats.size()) return;
+            seen++;
+            if (t->eligible > now) return;
+            uint64_t bank = bank_of(t->beats[0]);
+            if (bank_free[bank] > now) return;
+            bool hit = cfg.row_size && open_row[bank] == row_of(t->beats[0]);
+            if (!pick || (hit && !pick_hit) ||
+                (hit == pick_hit && t->accepted < pick->accepted)) {
+                pick = t;
+                pick_hit = hit;
+            }
+        };
+        for (auto &t : reads) consider(t.get(), false);
+        seen = 0;
+        for (auto &t : writes) consider(t.get(), true);
+        if (!pick) return;
+
+        uint64_t bank = bank_of(pick->beats[0]);
+        uint64_t penalty = 0;
+        if (cfg.row_size) {
+            penalty = pick_hit ? cfg.row_hit : cfg.row_miss;
+            (pick_hit ? stats.row_hits : stats.row_misses)++;
+            open_row[bank] = row_of(pick->beats[0]);
+        }
+        uint64_t beat_bytes = pick->bytes / pick->beats.size();
+        uint64_t transfer = (pick->bytes + bandwidth - 1) / bandwidth;
+        pick->beat_cycles = std::max<uint64_t>(1, (beat_bytes + bandwidth - 1) / bandwidth);
+        pick->first_beat = std::max(now + penalty, bus_free);
+        bus_free = pick->first_beat + transfer;
+        bank_free[bank] = bus_free;
+        stats.bytes += pick->bytes;
+    }
+
+    uint64_t bank_of(uint64_t addr) const {
+        return cfg.row_size ? (addr / cfg.row_size) % bank_free.size() : 0;
+    }
+    uint64_t row_of(uint64_t addr) const {
+        return addr / (cfg.row_size * bank_free.size());
+    }
+
+    // Among the transactions of `list` without an older one of the same ID,
+    // return the one satisfying `ready` with the earliest data.
+    template <typename F>
+    Txn *first_ready(std::deque<std::unique_ptr<Txn>> &list, F ready) {
+        Txn *best = nullptr;
+        std::vector<uint64_t> blocked;
+        for (auto &t : list) {
+            if (std::find(blocked.begin(), blocked.end(), t->id) !=
+                blocked.end())
+                continue;
+            blocked.push_back(t->id);
+            if (ready(*t) && (!best || t->first_beat < best->first_beat))
+                best = t.get();
+        }
+        return best;
+    }
+
+    void drive(Outputs &out) {
+        out.aw_ready = num_writes < cfg.max_writes;
+        out.ar_ready = num_reads < cfg.max_reads;
+        out.w_ready = w_beats.size() < 256;
+        // Return one read burst at a time, without interleaving.
+        if (!r_current)
+            r_current = first_ready(reads, [&](const Txn &t) {
+                return t.scheduled() && t.beat_ready(0) <= now;
+            });
+        out.r_valid = r_current && r_current->beat_ready(r_current->done) <= now;
+        if (out.r_valid) {
+            out.r_id = r_current->id;
+            out.r_last = r_current->done + 1 == r_current->beats.size();
+            memcpy(out.r_data, &r_current->data[r_current->done * data_bytes],
+                   data_bytes);
+        }
+        // Keep the offered response stable until it is accepted.
+        if (!b_current)
+            b_current = first_ready(writes, [&](const Txn &t) {
+                return t.scheduled() &&
+                       t.beat_ready(t.beats.size() - 1) <= now;
+            });
+        out.b_valid = b_current != nullptr;
+        if (out.b_valid) out.b_id = b_current->id;
+    }
+
+    void retire_read_beat() {
+        if (!r_current) return;
+        if (r_current->done == 0)
+            stats.read_latency += now - 1 - r_current->accepted;
+        if (++r_current->done < r_current->beats.size()) return;
+        erase(reads, r_current);
+        r_current = nullptr;
+        num_reads--;
+    }
+
+    void retire_write() {
+        if (!b_current) return;
+        erase(writes, b_current);
+        b_current = nullptr;
+        num_writes--;
+    }
+
+    static void erase(std::deque<std::unique_ptr<Txn>> &list, Txn *t) {
+        list.erase(std::find_if(list.begin(), list.end(),
+                                [&](const std::unique_ptr<Txn> &p) {
+                                    return p.get() == t;
+                                }));
+    }
+
+    size_t data_bytes;
+    AxiModelConfig cfg;
+    uint64_t bandwidth;
+    uint64_t now = 0;
+    // Cycle of the last reset, the traffic heatmap counts from there.
+    uint64_t run_start = 0;
+    uint64_t bus_free = 0;
+    std::vector<uint64_t> bank_free;
+    std::vector<uint64_t> open_row;
+    std::deque<std::unique_ptr<Txn>> reads, writes;
+    std::deque<std::vector<uint8_t>> w_beats;
+    Txn *r_current = nullptr;
+    Txn *b_current = nullptr;
+    uint64_t num_reads = 0, num_writes = 0;
+};
+
+}  // namespace sim
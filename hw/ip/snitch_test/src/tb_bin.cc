@@ -8,13 +8,16 @@
 #include "sim.hh"
 
 int main(int argc, char **argv, char **env) {
+    // Run all binaries of a manifest, see `sim::run_batch`.
+    bool batch = argc >= 2 && strncmp(argv[1], "--batch=", 8) == 0;
+
     // Write binary path to logs/binary for the `make annotate` target
     FILE *fd;
-    fd = fopen("logs/.rtlbinary", "w");
+    fd = batch ? NULL : fopen("logs/.rtlbinary", "w");
     if (fd != NULL && argc >= 2) {
         fprintf(fd, "%s\n", argv[1]);
         fclose(fd);
-    } else {
+    } else if (!batch) {
         fprintf(stderr,
                 "Warning: Failed to write binary name to logs/.rtlbinary\n");
     }
@@ -22,6 +25,8 @@ int main(int argc, char **argv, char **env) {
     // Initialize IPC bridge if specified
     IpcIface ipc_iface(argc, argv);
 
+    if (batch) return sim::run_batch(argc, argv);
+
     auto sim = std::make_unique<sim::Sim>(argc, argv);
     return sim->run();
 }
@@ -10,12 +10,52 @@
 
 namespace sim {
 
+// Concurrency model: the simulation thread (DPI), the fesvr coroutine and
+// host threads such as the IPC transports may access the memory at the same
+// time.
+// - `read`, `write` and the atomic accessors are safe to call concurrently.
+//   Accesses to already allocated pages and to the flat window take no lock.
+//   Allocating a sparse page takes `alloc_mutex`.
+// - Plain `read`/`write` are byte copies. Concurrent accesses to the same
+//   bytes may tear. Words that threads synchronize on (doorbells, flags)
+//   should use `load32`/`store32`/`load64`/`store64`, which are atomic for
+//   naturally aligned words.
+// - Host mappings can be added and removed at any time. Accesses hold
+//   `mapping_mutex` shared while there are mappings, so a removed mapping is
+//   no longer accessed once `remove_mapping` returns.
+// - Writes only maintain `generation` and evaluate watchpoints while an
+//   observer is registered (`num_observers`). Host threads that write the
+//   memory or wait on it register before they start. Observers on the
+//   simulation thread may register at any time.
+// - `map_flat`, `unmap_flat` and `clear` must only be called while no other
+//   thread accesses the memory, e.g., before the simulation starts.
 struct GlobalMemory {
     static constexpr size_t ADDR_SHIFT = 12;
     static constexpr size_t PAGE_SIZE = (size_t)1 << ADDR_SHIFT;
 
-    std::unordered_map<uint64_t, std::unique_ptr<uint8_t[]>> pages;
-    std::set<uint64_t> touched;
+    // Sparse backing store: a radix table over the page index whose pages
+    // are allocated on first write. Nodes and pages are published with
+    // release stores, so lookups take no lock.
+    static constexpr size_t TABLE_BITS = 13;
+    static constexpr size_t TABLE_LEVELS = 4;  // 52b page index
+    static constexpr uint64_t TABLE_MASK = ((uint64_t)1 << TABLE_BITS) - 1;
+    struct TableNode {
+        std::atomic<void *> slots[(size_t)1 << TABLE_BITS];
+    };
+    std::unique_ptr<TableNode> table{new TableNode()};
+    std::mutex alloc_mutex;
+    // Indices of the allocated sparse pages, guarded by `alloc_mutex`.
+    std::vector<uint64_t> allocated;
+
+    // Flat backing store: one anonymous mapping reserved for the whole
+    // `[flat_base, flat_base + flat_size)` window. The OS only commits the
+    // pages that are actually touched, so this is cheap even for large DRAM
+    // windows. Accesses outside of the window fall back to `pages`.
+    uint8_t *flat = nullptr;
+    uint64_t flat_base = 0;
+    size_t flat_size = 0;
+    // Bitmap of flat pages that have been written.
+    std::vector<uint64_t> flat_touched;
 
     // A mapping of host memory into Manticore memory.
     struct Mapping {
@@ -23,99 +63,409 @@ struct GlobalMemory {
         size_t size;
         uint8_t *into;  // host memory
     };
-    std::vector<Mapping> mappings;
+    // Non-overlapping mappings, indexed by their base address. Guarded by
+    // `mapping_mutex`, `num_mappings` mirrors their count.
+    std::map<uint64_t, Mapping> mappings;
+    std::shared_mutex mapping_mutex;
+    std::atomic<size_t> num_mappings{0};
 
-    uint8_t *find_mapping(uint64_t addr) const {
-        for (const auto &m : mappings) {
-            if (m.base <= addr && m.base + m.size > addr) {
-                return m.into + (addr - m.base);
-            }
+    // Writes to any of the 64b words at `watch_addrs` set `watch_hit`, zero
+    // entries are unused. The Verilator driver watches `tohost`/`fromhost`
+    // this way to only switch to fesvr when there is HTIF work.
+    std::atomic<uint64_t> watch_addrs[2] = {};
+    std::atomic<bool> watch_hit{false};
+
+    // Memos and pollers that need to learn about writes. While there are
+    // none, writes skip the bookkeeping below.
+    std::atomic<unsigned> num_observers{0};
+
+    // Incremented by every change of the memory contents while there are
+    // observers, so readers can tell whether data they read earlier is still
+    // current.
+    std::atomic<uint64_t> generation{0};
+
+    // Host threads blocked in `wait_change` register a watchpoint. Writes
+    // that overlap a watched word evaluate its condition and wake the waiter
+    // once it holds. Only threads counted in `num_observers` may wait.
+    struct Watchpoint {
+        uint64_t addr;
+        uint32_t mask;
+        uint32_t expected;
+        bool fired;
+    };
+    std::atomic<unsigned> num_watchpoints{0};
+    std::mutex watch_mutex;
+    std::condition_variable watch_cv;
+    std::vector<Watchpoint *> watchpoints;  // guarded by `watch_mutex`
+
+    ~GlobalMemory() {
+        unmap_flat();
+        free_table();
+    }
+
+    // Reserve the flat backing store for `[base, end)`. Pages already
+    // allocated in the sparse store inside the window are migrated.
+    bool map_flat(uint64_t base, uint64_t end);
+    void unmap_flat();
+
+    // Return the sorted indices of all pages that have been written.
+    std::vector<uint64_t> touched_pages();
+
+    // Zero all written pages and forget about them. Host mappings are kept.
+    void clear();
+
+    // Block until `(word & mask) != (expected & mask)` for the 32b word at
+    // `addr`, and return the word.
+    uint32_t wait_change(uint64_t addr, uint32_t mask, uint32_t expected);
+
+    // Evaluate the watchpoints overlapping `[addr, addr + len)`.
+    void check_watchpoints(uint64_t addr, size_t len);
+
+    // Redirect `[base, base + size)` to host memory at `into`. Fails if the
+    // range overlaps an existing mapping.
+    bool add_mapping(uint64_t base, size_t size, uint8_t *into) {
+        if (size == 0) return false;
+        std::lock_guard<std::shared_mutex> lock(mapping_mutex);
+        auto next = mappings.lower_bound(base);
+        if (next != mappings.end() && next->first < base + size) return false;
+        if (next != mappings.begin()) {
+            auto &prev = std::prev(next)->second;
+            if (prev.base + prev.size > base) return false;
+        }
+        mappings.emplace(base, Mapping{base, size, into});
+        num_mappings = mappings.size();
+        generation++;
+        return true;
+    }
+
+    // Remove the mapping starting at `base`. Waits for accesses in flight.
+    bool remove_mapping(uint64_t base) {
+        std::lock_guard<std::shared_mutex> lock(mapping_mutex);
+        bool removed = mappings.erase(base) != 0;
+        num_mappings = mappings.size();
+        generation++;
+        return removed;
+    }
+
+    uint8_t *find_mapping(uint64_t addr) {
+        std::shared_lock<std::shared_mutex> lock(mapping_mutex);
+        auto m = find_mapping_entry(addr);
+        return m ? m->into + (addr - m->base) : nullptr;
+    }
+
+    // Whether any mapping overlaps `[addr, addr + len)`.
+    bool overlaps_mapping(uint64_t addr, size_t len) {
+        if (!num_mappings.load(std::memory_order_acquire)) return false;
+        std::shared_lock<std::shared_mutex> lock(mapping_mutex);
+        // Mappings do not overlap, so only the last one that starts before
+        // the end of the range can reach into it.
+        auto it = mappings.lower_bound(addr + len);
+        if (it == mappings.begin()) return false;
+        const auto &m = std::prev(it)->second;
+        return m.base + m.size > addr;
+    }
+
+    // Watch the 64b words at `a` and `b`, zero for none.
+    void watch(uint64_t a, uint64_t b) {
+        watch_addrs[0].store(a, std::memory_order_relaxed);
+        watch_addrs[1].store(b, std::memory_order_relaxed);
+    }
+
+    bool in_flat(uint64_t addr, size_t len) const {
+        return flat && addr >= flat_base && addr - flat_base <= flat_size &&
+               len <= flat_size - (addr - flat_base);
+    }
+
+    // Copy `len` bytes honoring the byte strobes. A missing strobe array or
+    // one without any cleared byte degrades to a plain `memcpy`.
+    static void copy_strobed(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *strb, size_t len) {
+        if (!strb || !memchr(strb, 0, len)) {
+            memcpy(dst, src, len);
+            return;
+        }
+        for (size_t i = 0; i < len; i++) {
+            if (strb[i]) dst[i] = src[i];
+        }
+    }
+
+    void mark_flat_touched(uint64_t addr, size_t len) {
+        uint64_t first = (addr - flat_base) >> ADDR_SHIFT;
+        uint64_t last = (addr - flat_base + len - 1) >> ADDR_SHIFT;
+        for (uint64_t i = first; i <= last; i++) {
+            uint64_t bit = (uint64_t)1 << (i % 64);
+            // Skip the atomic update for pages that are already marked.
+            if (!(__atomic_load_n(&flat_touched[i / 64], __ATOMIC_RELAXED) &
+                  bit))
+                __atomic_fetch_or(&flat_touched[i / 64], bit,
+                                  __ATOMIC_RELAXED);
         }
-        return nullptr;
     }
 
     // Copy a chunk of data into memory.
     void write(size_t addr, size_t len, const uint8_t *data,
                const uint8_t *strb) {
-        // std::cout << "[GlobalMemory] Write " << std::hex << addr << std::dec
-        //           << " (" << len << " bytes)\n";
-        size_t end = addr + len;
-        size_t data_idx = 0;
-        while (addr < end) {
-            size_t byte_start = addr;
-            addr >>= ADDR_SHIFT;
-            auto &page = pages[addr];
-            uint64_t page_idx = addr;
-            if (!page) {
-                // std::cout << "[TB] Allocate page " << std::hex << (addr <<
-                // ADDR_SHIFT) << "\n";
-                page = std::make_unique<uint8_t[]>(PAGE_SIZE);
-                std::fill(&page[0], &page[PAGE_SIZE], 0);
-            }
-            // std::cout << "[TB] Write to page " << std::hex << (addr <<
-            // ADDR_SHIFT)
-            // << "\n";
-            addr += 1;
-            addr <<= ADDR_SHIFT;
-            size_t byte_end = std::min(addr, end);
-            bool any_changed = false;
-            for (size_t i = byte_start; i < byte_end; i++, data_idx++) {
-                if (!strb || strb[data_idx]) {
-                    // std::cout << "[TB] Write byte " << std::hex << i << " = "
-                    // << (uint32_t)data[data_idx] << "\n";
-                    auto host = find_mapping(i);
-                    if (host) {
-                        *host = data[data_idx];
-                    } else {
-                        page[i % PAGE_SIZE] = data[data_idx];
-                        any_changed = true;
-                    }
+        if (len == 0) return;
+        check_watch_addrs(addr, len);
+        if (!num_mappings.load(std::memory_order_acquire)) {
+            write_backing(addr, len, data, strb);
+        } else {
+            // Split the access into runs that are either fully inside one
+            // host mapping or fully outside of all of them.
+            std::shared_lock<std::shared_mutex> lock(mapping_mutex);
+            for_each_run(addr, len, [&](uint64_t a, size_t n, size_t off,
+                                        const Mapping *m) {
+                const uint8_t *s = strb ? &strb[off] : nullptr;
+                if (m) {
+                    copy_strobed(m->into + (a - m->base), &data[off], s, n);
+                } else {
+                    write_backing(a, n, &data[off], s);
                 }
-            }
-            if (any_changed) touched.insert(page_idx);
+            });
         }
-        std::cout << std::dec;
+        if (num_observers.load(std::memory_order_relaxed))
+            notify_observers(addr, len);
     }
 
     // Copy a chunk of data out of the memory.
     void read(size_t addr, size_t len, uint8_t *data) {
-        // std::cout << "[GlobalMemory] Read " << std::hex << addr << std::dec
-        //           << " (" << len << " bytes)\n";
-        size_t end = addr + len;
+        if (len == 0) return;
+        if (!num_mappings.load(std::memory_order_acquire)) {
+            read_backing(addr, len, data);
+            return;
+        }
+        std::shared_lock<std::shared_mutex> lock(mapping_mutex);
+        for_each_run(addr, len, [&](uint64_t a, size_t n, size_t off,
+                                    const Mapping *m) {
+            if (m) {
+                memcpy(&data[off], m->into + (a - m->base), n);
+            } else {
+                read_backing(a, n, &data[off]);
+            }
+        });
+    }
+
+    // Atomic accesses to naturally aligned words, e.g., for doorbells shared
+    // between the simulation and host threads. Stores fire watchpoints like
+    // `write` does.
+    uint32_t load32(uint64_t addr) { return atomic_load<uint32_t>(addr); }
+    uint64_t load64(uint64_t addr) { return atomic_load<uint64_t>(addr); }
+    void store32(uint64_t addr, uint32_t value) {
+        atomic_store<uint32_t>(addr, value);
+    }
+    void store64(uint64_t addr, uint64_t value) {
+        atomic_store<uint64_t>(addr, value);
+    }
+
+   private:
+    // Return the host address of the `len` bytes at `addr`, which must not
+    // cross a page or mapping boundary. Allocates a sparse page if `alloc`
+    // is set, otherwise returns null for unallocated pages.
+    uint8_t *host_addr(uint64_t addr, size_t len, bool alloc) {
+        if (num_mappings.load(std::memory_order_acquire)) {
+            std::shared_lock<std::shared_mutex> lock(mapping_mutex);
+            if (auto m = find_mapping_entry(addr))
+                return m->into + (addr - m->base);
+        }
+        if (in_flat(addr, len)) {
+            if (alloc) mark_flat_touched(addr, len);
+            return &flat[addr - flat_base];
+        }
+        uint8_t *page =
+            alloc ? sparse_page(addr) : lookup_page(addr >> ADDR_SHIFT);
+        return page ? &page[addr % PAGE_SIZE] : nullptr;
+    }
+
+    template <typename T>
+    T atomic_load(uint64_t addr) {
+        assert(addr % sizeof(T) == 0);
+        T *ptr = (T *)host_addr(addr, sizeof(T), false);
+        return ptr ? __atomic_load_n(ptr, __ATOMIC_SEQ_CST) : 0;
+    }
+
+    template <typename T>
+    void atomic_store(uint64_t addr, T value) {
+        assert(addr % sizeof(T) == 0);
+        check_watch_addrs(addr, sizeof(T));
+        __atomic_store_n((T *)host_addr(addr, sizeof(T), true), value,
+                         __ATOMIC_SEQ_CST);
+        if (num_observers.load(std::memory_order_relaxed))
+            notify_observers(addr, sizeof(T));
+    }
+
+    void check_watch_addrs(uint64_t addr, size_t len) {
+        for (auto &a : watch_addrs) {
+            uint64_t w = a.load(std::memory_order_relaxed);
+            if (w && w < addr + len && addr < w + sizeof(uint64_t))
+                watch_hit.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void notify_observers(uint64_t addr, size_t len) {
+        generation.fetch_add(1, std::memory_order_release);
+        // Order the data before the check, `wait_change` reads it after
+        // registering its watchpoint.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (num_watchpoints.load(std::memory_order_relaxed))
+            check_watchpoints(addr, len);
+    }
+
+    const Mapping *find_mapping_entry(uint64_t addr) const {
+        auto it = mappings.upper_bound(addr);
+        if (it == mappings.begin()) return nullptr;
+        const auto &m = std::prev(it)->second;
+        return addr - m.base < m.size ? &m : nullptr;
+    }
+
+    // Call `f(addr, len, offset, mapping)` for each maximal run of
+    // `[addr, addr + len)` that is covered by one mapping (or by none).
+    template <typename F>
+    void for_each_run(uint64_t addr, size_t len, F f) const {
+        uint64_t end = addr + len;
+        auto it = mappings.upper_bound(addr);
+        if (it != mappings.begin()) {
+            const auto &m = std::prev(it)->second;
+            if (addr - m.base < m.size) --it;
+        }
+        while (addr < end) {
+            if (it != mappings.end() && it->first <= addr) {
+                const auto &m = it->second;
+                uint64_t run_end = std::min(end, m.base + m.size);
+                f(addr, run_end - addr, len - (end - addr), &m);
+                addr = run_end;
+                ++it;
+            } else {
+                uint64_t run_end =
+                    it != mappings.end() ? std::min(end, it->first) : end;
+                f(addr, run_end - addr, len - (end - addr), nullptr);
+                addr = run_end;
+            }
+        }
+    }
+
+    // Return the sparse page with index `idx`, or null if it was never
+    // written.
+    uint8_t *lookup_page(uint64_t idx) const {
+        const TableNode *node = table.get();
+        for (size_t level = TABLE_LEVELS - 1; level > 0; level--) {
+            node = (const TableNode *)node
+                       ->slots[(idx >> (level * TABLE_BITS)) & TABLE_MASK]
+                       .load(std::memory_order_acquire);
+            if (!node) return nullptr;
+        }
+        return (uint8_t *)node->slots[idx & TABLE_MASK].load(
+            std::memory_order_acquire);
+    }
+
+    // Return the sparse page holding `addr`, allocating it if needed.
+    uint8_t *sparse_page(uint64_t addr) {
+        if (auto page = lookup_page(addr >> ADDR_SHIFT)) return page;
+        return alloc_page(addr >> ADDR_SHIFT);
+    }
+
+    uint8_t *alloc_page(uint64_t idx);
+    void free_table();
+
+    // Access the backing stores, ignoring host mappings.
+    void write_backing(uint64_t addr, size_t len, const uint8_t *data,
+                       const uint8_t *strb) {
+        // Fast path: the whole access lies in the flat window.
+        if (in_flat(addr, len)) {
+            copy_strobed(&flat[addr - flat_base], data, strb, len);
+            mark_flat_touched(addr, len);
+            return;
+        }
+        uint64_t end = addr + len;
+        size_t data_idx = 0;
+        while (addr < end) {
+            uint64_t byte_end = std::min((addr | (PAGE_SIZE - 1)) + 1, end);
+            size_t chunk = byte_end - addr;
+            const uint8_t *chunk_strb = strb ? &strb[data_idx] : nullptr;
+            if (in_flat(addr, chunk)) {
+                copy_strobed(&flat[addr - flat_base], &data[data_idx],
+                             chunk_strb, chunk);
+                mark_flat_touched(addr, chunk);
+            } else {
+                copy_strobed(&sparse_page(addr)[addr % PAGE_SIZE],
+                             &data[data_idx], chunk_strb, chunk);
+            }
+            addr = byte_end;
+            data_idx += chunk;
+        }
+    }
+
+    void read_backing(uint64_t addr, size_t len, uint8_t *data) const {
+        if (in_flat(addr, len)) {
+            memcpy(data, &flat[addr - flat_base], len);
+            return;
+        }
+        uint64_t end = addr + len;
         size_t data_idx = 0;
         while (addr < end) {
-            size_t byte_start = addr;
-            addr >>= ADDR_SHIFT;
-            auto &page = pages[addr];
-            // std::cout << "[TB] Read from page " << std::hex << (addr <<
-            // ADDR_SHIFT)
-            // << "\n";
-            addr += 1;
-            addr <<= ADDR_SHIFT;
-            size_t byte_end = std::min(addr, end);
-            for (size_t i = byte_start; i < byte_end; i++, data_idx++) {
-                auto host = find_mapping(i);
-                if (host) {
-                    data[data_idx] = *host;
+            uint64_t byte_end = std::min((addr | (PAGE_SIZE - 1)) + 1, end);
+            size_t chunk = byte_end - addr;
+            if (in_flat(addr, chunk)) {
+                memcpy(&data[data_idx], &flat[addr - flat_base], chunk);
+            } else {
+                if (auto page = lookup_page(addr >> ADDR_SHIFT)) {
+                    memcpy(&data[data_idx], &page[addr % PAGE_SIZE], chunk);
                 } else {
-                    if (page) {
-                        // std::cout << "[TB] Read byte " << std::hex << i <<
-                        // "\n";
-                        data[data_idx] = page[i % PAGE_SIZE];
-                    } else {
-                        data[data_idx] = 0;
-                    }
+                    memset(&data[data_idx], 0, chunk);
                 }
             }
+            addr = byte_end;
+            data_idx += chunk;
         }
-        std::cout << std::dec;
     }
 };
 
 // The global memory all memory ports write into.
 extern GlobalMemory MEM;
 
-// The boot data generated along with the system RTL.
+// One-entry memo in front of `MEM.read` for combinational read ports such as
+// `tb_memory_regbus`, which the simulator may evaluate several times per
+// beat while the address settles. The entry is reused until the memory
+// changes. Ranges that overlap host mappings are never memoized because the
+// host writes them directly. Only used from the simulation thread, which
+// registers it as an observer on the first read.
+struct ReadMemo {
+    bool registered = false;
+    uint64_t addr = 0;
+    uint64_t generation = UINT64_MAX;
+    std::vector<uint8_t> data;
+    // DPI calls and the ones that had to read the memory.
+    uint64_t calls = 0;
+    uint64_t reads = 0;
+
+    ~ReadMemo();
+
+    void read(uint64_t addr, size_t len, uint8_t *out) {
+        if (!registered) {
+            MEM.num_observers++;
+            registered = true;
+        }
+        calls++;
+        uint64_t gen = MEM.generation.load(std::memory_order_acquire);
+        if (gen == generation && addr == this->addr && len == data.size()) {
+            memcpy(out, data.data(), len);
+            return;
+        }
+        reads++;
+        MEM.read(addr, len, out);
+        if (MEM.overlaps_mapping(addr, len)) {
+            generation = UINT64_MAX;
+            return;
+        }
+        this->addr = addr;
+        generation = gen;
+        data.assign(out, out + len);
+    }
+};
+extern ReadMemo REGBUS_READS;
+
+// The boot data generated along with the system RTL. `core_count` is per
+// cluster, `hartid_base` and `tcdm_start` belong to the first cluster, the
+// others follow `tcdm_offset` apart.
 struct BootData {
     uint64_t boot_addr;
     uint64_t core_count;
@@ -125,7 +475,17 @@ struct BootData {
     uint64_t tcdm_offset;
     uint64_t global_mem_start;
     uint64_t global_mem_end;
+    uint64_t cluster_count;
 };
 extern const BootData BOOTDATA;
 
+// Cluster status (`SPATZ_STATUS`, toggled by `start_kernel`/`stop_kernel`) as
+// last reported by the testharness, and the number of changes so far.
+extern int CLUSTER_PROBE;
+extern uint64_t CLUSTER_PROBE_CHANGES;
+
+// Whether the per-hart instruction tracers currently write their `.dasm`
+// logs. Always set unless the driver restricts tracing to a window.
+extern bool TRACE_ENABLED;
+
 }  // namespace sim
@@ -36,10 +36,43 @@ module tb_memory_axi #(
   localparam int NumBytes = AxiDataWidth/8;
   localparam int BusAlign = $clog2(NumBytes);
 
-  REG_BUS #(
-    .ADDR_WIDTH ( AxiAddrWidth ),
-    .DATA_WIDTH ( AxiDataWidth )
-  ) regb(clk_i);
+`ifdef TB_AXI_BURST_MODEL
+  localparam bit BurstModel = 1'b1;
+`else
+  localparam bit BurstModel = 1'b0;
+`endif
+
+  import "DPI-C" function int tb_axi_model_new(input int data_bytes);
+  import "DPI-C" function void tb_axi_model_reset(input int port);
+  import "DPI-C" function void tb_axi_model_cycle(
+    input  int     port,
+    input  bit     aw_fire,
+    input  longint aw_id,
+    input  longint aw_addr,
+    input  int     aw_len,
+    input  int     aw_size,
+    input  int     aw_burst,
+    input  bit     w_fire,
+    input  byte    w_data[],
+    input  bit     w_strb[],
+    input  bit     b_fire,
+    input  bit     ar_fire,
+    input  longint ar_id,
+    input  longint ar_addr,
+    input  int     ar_len,
+    input  int     ar_size,
+    input  int     ar_burst,
+    input  bit     r_fire,
+    output bit     aw_ready,
+    output bit     w_ready,
+    output bit     ar_ready,
+    output bit     b_valid,
+    output longint b_id,
+    output bit     r_valid,
+    output longint r_id,
+    output byte    r_data[],
+    output bit     r_last
+  );
 
   AXI_BUS #(
     .AXI_ADDR_WIDTH ( AxiAddrWidth ),
@@ -88,42 +121,121 @@ module tb_memory_axi #(
     .out (axi_wo_atomics_cut)
   );
 
-  // Convert AXI to a trivial register interface.
-  axi_to_reg_intf #(
-    .ADDR_WIDTH ( AxiAddrWidth ),
-    .DATA_WIDTH ( AxiDataWidth ),
-    .ID_WIDTH   ( AxiIdWidth   ),
-    .USER_WIDTH ( AxiUserWidth ),
-    .DECOUPLE_W ( 1            ),
-    .AXI_MAX_WRITE_TXNS ( 32'd128 ),
-    .AXI_MAX_READ_TXNS  ( 32'd128 )
-  ) i_axi_to_reg (
-    .clk_i,
-    .rst_ni,
-    .testmode_i ( 1'b0 ),
-    .in         ( axi_wo_atomics_cut ),
-    .reg_o      ( regb )
-  );
+  if (BurstModel) begin : gen_burst_model
+    // Whole bursts go to the C++ AXI model (`tb_axi.hh`), which applies the
+    // DRAM timing set with the `--axi-*` testbench arguments. It is called
+    // once per cycle and its outputs are registered.
+    int port;
+    initial port = tb_axi_model_new(NumBytes);
+
+    logic aw_ready_q, w_ready_q, ar_ready_q, b_valid_q, r_valid_q, r_last_q;
+    logic [AxiIdWidth-1:0]   b_id_q, r_id_q;
+    logic [AxiDataWidth-1:0] r_data_q;
+
+    // verilog_lint: waive-start always-ff-non-blocking
+    always_ff @(posedge clk_i) begin
+      if (!rst_ni) begin
+        tb_axi_model_reset(port);
+        aw_ready_q <= 1'b0;
+        w_ready_q  <= 1'b0;
+        ar_ready_q <= 1'b0;
+        b_valid_q  <= 1'b0;
+        r_valid_q  <= 1'b0;
+      end else begin
+        automatic byte    w_data[NumBytes];
+        automatic bit     w_strb[NumBytes];
+        automatic byte    r_data[NumBytes];
+        automatic bit     aw_ready, w_ready, ar_ready, b_valid, r_valid, r_last;
+        automatic longint b_id, r_id;
+        for (int i = 0; i < NumBytes; i++) begin
+          w_data[i] = axi_wo_atomics_cut.w_data[i*8+:8];
+          w_strb[i] = axi_wo_atomics_cut.w_strb[i];
+        end
+        tb_axi_model_cycle(port,
+          aw_ready_q & axi_wo_atomics_cut.aw_valid,
+          longint'(axi_wo_atomics_cut.aw_id), longint'(axi_wo_atomics_cut.aw_addr),
+          int'(axi_wo_atomics_cut.aw_len), int'(axi_wo_atomics_cut.aw_size),
+          int'(axi_wo_atomics_cut.aw_burst),
+          w_ready_q & axi_wo_atomics_cut.w_valid, w_data, w_strb,
+          b_valid_q & axi_wo_atomics_cut.b_ready,
+          ar_ready_q & axi_wo_atomics_cut.ar_valid,
+          longint'(axi_wo_atomics_cut.ar_id), longint'(axi_wo_atomics_cut.ar_addr),
+          int'(axi_wo_atomics_cut.ar_len), int'(axi_wo_atomics_cut.ar_size),
+          int'(axi_wo_atomics_cut.ar_burst),
+          r_valid_q & axi_wo_atomics_cut.r_ready,
+          aw_ready, w_ready, ar_ready, b_valid, b_id, r_valid, r_id, r_data, r_last);
+        aw_ready_q <= aw_ready;
+        w_ready_q  <= w_ready;
+        ar_ready_q <= ar_ready;
+        b_valid_q  <= b_valid;
+        b_id_q     <= b_id[AxiIdWidth-1:0];
+        r_valid_q  <= r_valid;
+        r_id_q     <= r_id[AxiIdWidth-1:0];
+        r_last_q   <= r_last;
+        for (int i = 0; i < NumBytes; i++) begin
+          r_data_q[i*8+:8] <= r_data[i];
+        end
+      end
+    end
+    // verilog_lint: waive-stop always-ff-non-blocking
+
+    assign axi_wo_atomics_cut.aw_ready = aw_ready_q;
+    assign axi_wo_atomics_cut.w_ready  = w_ready_q;
+    assign axi_wo_atomics_cut.ar_ready = ar_ready_q;
+    assign axi_wo_atomics_cut.b_valid  = b_valid_q;
+    assign axi_wo_atomics_cut.b_id     = b_id_q;
+    assign axi_wo_atomics_cut.b_resp   = axi_pkg::RESP_OKAY;
+    assign axi_wo_atomics_cut.b_user   = '0;
+    assign axi_wo_atomics_cut.r_valid  = r_valid_q;
+    assign axi_wo_atomics_cut.r_id     = r_id_q;
+    assign axi_wo_atomics_cut.r_data   = r_data_q;
+    assign axi_wo_atomics_cut.r_last   = r_last_q;
+    assign axi_wo_atomics_cut.r_resp   = axi_pkg::RESP_OKAY;
+    assign axi_wo_atomics_cut.r_user   = '0;
+
+  end else begin : gen_regbus
+    REG_BUS #(
+      .ADDR_WIDTH ( AxiAddrWidth ),
+      .DATA_WIDTH ( AxiDataWidth )
+    ) regb(clk_i);
+
+    // Convert AXI to a trivial register interface.
+    axi_to_reg_intf #(
+      .ADDR_WIDTH ( AxiAddrWidth ),
+      .DATA_WIDTH ( AxiDataWidth ),
+      .ID_WIDTH   ( AxiIdWidth   ),
+      .USER_WIDTH ( AxiUserWidth ),
+      .DECOUPLE_W ( 1            ),
+      .AXI_MAX_WRITE_TXNS ( 32'd128 ),
+      .AXI_MAX_READ_TXNS  ( 32'd128 )
+    ) i_axi_to_reg (
+      .clk_i,
+      .rst_ni,
+      .testmode_i ( 1'b0 ),
+      .in         ( axi_wo_atomics_cut ),
+      .reg_o      ( regb )
+    );
 
-  `REG_BUS_TYPEDEF_ALL(regbus,
-    logic [AxiAddrWidth-1:0], logic [AxiDataWidth-1:0], logic [NumBytes-1:0])
-
-  regbus_req_t regbus_req;
-  regbus_rsp_t regbus_rsp;
-
-  `REG_BUS_ASSIGN_TO_REQ(regbus_req, regb)
-  `REG_BUS_ASSIGN_FROM_RSP(regb, regbus_rsp)
-
-  tb_memory_regbus #(
-    .AddrWidth (AxiAddrWidth),
-    .DataWidth (AxiDataWidth),
-    .req_t (regbus_req_t),
-    .rsp_t (regbus_rsp_t)
-  ) i_tb_memory_regbus (
-    .clk_i,
-    .rst_ni,
-    .req_i (regbus_req),
-    .rsp_o (regbus_rsp)
-  );
+    `REG_BUS_TYPEDEF_ALL(regbus,
+      logic [AxiAddrWidth-1:0], logic [AxiDataWidth-1:0], logic [NumBytes-1:0])
+
+    regbus_req_t regbus_req;
+    regbus_rsp_t regbus_rsp;
+
+    `REG_BUS_ASSIGN_TO_REQ(regbus_req, regb)
+    `REG_BUS_ASSIGN_FROM_RSP(regb, regbus_rsp)
+
+    tb_memory_regbus #(
+      .AddrWidth (AxiAddrWidth),
+      .DataWidth (AxiDataWidth),
+      .req_t (regbus_req_t),
+      .rsp_t (regbus_rsp_t)
+    ) i_tb_memory_regbus (
+      .clk_i,
+      .rst_ni,
+      .req_i (regbus_req),
+      .rsp_o (regbus_rsp)
+    );
+  end
 
 endmodule
@@ -32,6 +32,14 @@ module tb_memory_regbus #(
     input byte data[],
     input bit strb[]
   );
+  import "DPI-C" function int tb_traffic_enabled();
+  import "DPI-C" function void tb_traffic_finish();
+  import "DPI-C" function void tb_traffic_record(
+    input longint cycle,
+    input longint addr,
+    input int len,
+    input bit write
+  );
 
   localparam int NumBytes = DataWidth/8;
   localparam int BusAlign = $clog2(NumBytes);
@@ -47,7 +55,15 @@ module tb_memory_regbus #(
   assign regb.error = 0;
   assign regb.ready = 1;
 
-  // Handle write requests on the register bus.
+  // Cycles since reset, for the traffic heatmap (`tb_traffic.hh`).
+  longint unsigned cycle_q;
+  always_ff @(posedge clk_i or negedge rst_ni) begin
+    if (!rst_ni) cycle_q <= 0;
+    else cycle_q <= cycle_q + 1;
+  end
+
+  // Handle write requests on the register bus. Reads are counted here as
+  // well, once per beat, rather than in the memoized read below.
   always_ff @(posedge clk_i) begin
     if (rst_ni && regb.valid) begin
       automatic byte data[NumBytes];
@@ -61,12 +77,19 @@ module tb_memory_regbus #(
         end
         tb_memory_write((regb.addr >> BusAlign) << BusAlign, NumBytes, data, strb);
       end
+      if (tb_traffic_enabled()) begin
+        tb_traffic_record(cycle_q, (regb.addr >> BusAlign) << BusAlign,
+                          regb.write ? $countones(regb.wstrb) : NumBytes, regb.write);
+      end
     end
   end
 
-  // Handle read requests combinatorial on the register bus.
+  // Handle read requests combinatorial on the register bus. The simulator may
+  // evaluate this several times per beat; the testbench memoizes the reads
+  // (`ReadMemo` in `tb_lib.hh`).
   always_comb begin
-    if (regb.valid) begin
+    regb.rdata = '0;
+    if (regb.valid && !regb.write) begin
       automatic byte data[NumBytes];
       tb_memory_read((regb.addr >> BusAlign) << BusAlign, NumBytes, data);
       for (int i = 0; i < NumBytes; i++) begin
@@ -75,4 +98,8 @@ module tb_memory_regbus #(
     end
   end
 
+  // Write the traffic heatmap at the end of the simulation. The Verilator
+  // driver does so itself at the end of each run.
+  final tb_traffic_finish();
+
 endmodule
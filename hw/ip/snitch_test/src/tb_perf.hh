@@ -0,0 +1,178 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Solderpad Hardware License, Version 0.51, see LICENSE for details.
+// SPDX-License-Identifier: SHL-0.51
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+// Counter profile of the cluster peripherals, sampled over a backdoor
+// (`TB_PERF_COUNTERS`). Each peripheral reports the increments of all events
+// for all of its harts every cycle, along with its programmed counters. The
+// testbench keeps the totals and samples them at `start_kernel()`,
+// `stop_kernel()`, the requested cycles and the end of the run, without any
+// code on the target.
+class PerfProfile {
+   public:
+    // Events in the order of the `PERF_COUNTER_ENABLE` bits.
+    static const unsigned NUM_EVENTS = 31;
+
+    // Configuration, set by the driver.
+    const char *path = nullptr;
+    std::vector<uint64_t> at_cycles;
+    uint64_t every = 0;
+
+    bool enabled() const { return path != nullptr; }
+
+    // One cycle of the peripheral of the cluster starting at `hart_base`.
+    // `events` holds the cluster-wide increments followed by those of each
+    // hart, `NUM_EVENTS` each.
+    void cycle(int hart_base, int num_cores, int probe, const uint32_t *events,
+               int num_counters, const uint64_t *counters,
+               const uint32_t *enable, const uint32_t *hart_select) {
+        auto &c = clusters[hart_base];
+        if (c.totals.empty()) {
+            c.num_cores = num_cores;
+            c.totals.assign((num_cores + 1) * NUM_EVENTS, 0);
+            std::sort(at_cycles.begin(), at_cycles.end());
+        }
+        for (size_t i = 0; i < c.totals.size(); i++) c.totals[i] += events[i];
+        c.counters.assign(counters, counters + num_counters);
+        c.enable.assign(enable, enable + num_counters);
+        c.hart_select.assign(hart_select, hart_select + num_counters);
+        c.cycle++;
+
+        if (probe != c.probe) {
+            c.probe = probe;
+            sample(hart_base, c, probe ? "start_kernel" : "stop_kernel");
+        }
+        bool due = every && c.cycle % every == 0;
+        while (c.next_at < at_cycles.size() && at_cycles[c.next_at] <= c.cycle) {
+            due = true;
+            c.next_at++;
+        }
+        if (due) sample(hart_base, c, "cycle");
+    }
+
+    // Take the final samples and write the profile. Clears the state for the
+    // next run of a batch.
+    void finish() {
+        if (clusters.empty()) return;
+        for (auto &c : clusters) sample(c.first, c.second, "exit");
+        FILE *file = fopen(path, "w");
+        if (file) {
+            fprintf(file, "{\n    \"samples\": [%s\n    ]\n}\n", samples.c_str());
+            fclose(file);
+            fprintf(stderr, "[TB] Wrote %zu performance counter samples to %s\n",
+                    num_samples, path);
+        } else {
+            fprintf(stderr, "[TB] Cannot write %s\n", path);
+        }
+        clusters.clear();
+        samples.clear();
+        num_samples = 0;
+    }
+
+    ~PerfProfile() { finish(); }
+
+   private:
+    struct Cluster {
+        int num_cores = 0;
+        int probe = 0;
+        uint64_t cycle = 0;
+        size_t next_at = 0;
+        // Cluster-wide totals, then the totals of each hart.
+        std::vector<uint64_t> totals;
+        std::vector<uint64_t> counters;
+        std::vector<uint32_t> enable, hart_select;
+    };
+
+    static const char *event_name(unsigned event) {
+        static const char *names[NUM_EVENTS] = {
+            "cycle",           "tcdm_accessed",     "tcdm_congested",
+            "issue_fpu",       "issue_fpu_seq",     "issue_core_to_fpu",
+            "retired_instr",   "retired_load",      "retired_i",
+            "retired_acc",     "dma_aw_stall",      "dma_ar_stall",
+            "dma_r_stall",     "dma_w_stall",       "dma_buf_w_stall",
+            "dma_buf_r_stall", "dma_aw_done",       "dma_aw_bw",
+            "dma_ar_done",     "dma_ar_bw",         "dma_r_done",
+            "dma_r_bw",        "dma_w_done",        "dma_w_bw",
+            "dma_b_done",      "dma_busy",          "icache_miss",
+            "icache_hit",      "icache_prefetch",   "icache_double_hit",
+            "icache_stall"};
+        return names[event];
+    }
+
+    // Events counted per hart, all others are cluster-wide.
+    static bool per_hart(unsigned event) {
+        return (event >= 3 && event <= 9) || event >= 26;
+    }
+
+    void sample(int hart_base, const Cluster &c, const char *point) {
+        char buf[128];
+        std::string s = num_samples ? ",\n        {" : "\n        {";
+        snprintf(buf, sizeof(buf),
+                 "\n            \"point\": \"%s\",\n            \"cluster\": "
+                 "%d,\n            \"cycle\": %lu,\n            \"events\": {",
+                 point, hart_base, c.cycle);
+        s += buf;
+        bool first = true;
+        for (unsigned e = 0; e < NUM_EVENTS; e++) {
+            if (per_hart(e)) continue;
+            snprintf(buf, sizeof(buf), "%s\"%s\": %lu", first ? "" : ", ",
+                     event_name(e), c.totals[e]);
+            s += buf;
+            first = false;
+        }
+        s += "},\n            \"harts\": [";
+        for (int h = 0; h < c.num_cores; h++) {
+            snprintf(buf, sizeof(buf), "%s\n                {\"hart\": %d",
+                     h ? "," : "", hart_base + h);
+            s += buf;
+            for (unsigned e = 0; e < NUM_EVENTS; e++) {
+                if (!per_hart(e)) continue;
+                snprintf(buf, sizeof(buf), ", \"%s\": %lu", event_name(e),
+                         c.totals[(h + 1) * NUM_EVENTS + e]);
+                s += buf;
+            }
+            s += "}";
+        }
+        s += "\n            ],\n            \"counters\": [";
+        for (size_t i = 0; i < c.counters.size(); i++) {
+            snprintf(buf, sizeof(buf),
+                     "%s\n                {\"index\": %zu, \"value\": %lu, "
+                     "\"hart\": %u, \"events\": [",
+                     i ? "," : "", i, c.counters[i],
+                     hart_base + c.hart_select[i]);
+            s += buf;
+            // The enable register lists the events from the most significant
+            // bit down.
+            first = true;
+            for (unsigned e = 0; e < NUM_EVENTS; e++) {
+                if (!(c.enable[i] >> (NUM_EVENTS - 1 - e) & 1)) continue;
+                s += first ? "\"" : ", \"";
+                s += event_name(e);
+                s += "\"";
+                first = false;
+            }
+            s += "]}";
+        }
+        s += "\n            ]\n        }";
+        samples += s;
+        num_samples++;
+    }
+
+    std::map<int, Cluster> clusters;
+    std::string samples;
+    size_t num_samples = 0;
+};
+extern PerfProfile PERF;
+
+}  // namespace sim
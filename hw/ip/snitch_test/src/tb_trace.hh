@@ -0,0 +1,244 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Solderpad Hardware License, Version 0.51, see LICENSE for details.
+// SPDX-License-Identifier: SHL-0.51
+
+// Binary instruction trace, written by the testbench in place of the text
+// `.dasm` traces and read back by `util/trace/tracedec`.
+//
+// A trace file starts with `TRACE_MAGIC`, the hart ID (u32), and for each
+// source the number of extra fields (u32) followed by their names (u8 length
+// and characters). The records follow back to back:
+//
+//   u8      source, bit 7 set if the record has a valid PC
+//   varint  time minus the time of the previous record
+//   varint  cycle
+//   u8      privilege level
+//   varint  PC (only if valid)
+//   varint  instruction
+//   varint  each extra field of the source, in the order of the header
+//
+// Varints are LEB128: seven bits per byte, least significant group first.
+// Most extra fields are flags or register indices and take a single byte.
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace sim {
+namespace trace {
+
+static const char TRACE_MAGIC[8] = {'S', 'N', 'T', 'R', 'A', 'C', 'E', '1'};
+
+enum Source : uint8_t { SrcSnitch = 0, SrcFpu = 1, NumSources };
+static const uint8_t PC_VALID = 0x80;
+
+// Field names in the order of `snitch_pkg::snitch_trace_port_t` and
+// `snitch_pkg::fpu_trace_port_t`.
+static const std::vector<std::string> SOURCE_FIELDS[NumSources] = {
+    {"source",      "stall",        "exception",   "rs1",
+     "rs2",         "rd",           "is_load",     "is_store",
+     "is_branch",   "pc_d",         "opa",         "opb",
+     "opa_select",  "opb_select",   "write_rd",    "csr_addr",
+     "writeback",   "gpr_rdata_1",  "ls_size",     "ld_result_32",
+     "lsu_rd",      "retire_load",  "alu_result",  "ls_amo",
+     "retire_acc",  "acc_pid",      "acc_pdata_32", "fpu_offload",
+     "is_seq_insn"},
+    {"source",      "acc_q_hs",     "fpu_out_hs",  "lsu_q_hs",
+     "op_in",       "rs1",          "rs2",         "rs3",
+     "rd",          "op_sel_0",     "op_sel_1",    "op_sel_2",
+     "src_fmt",     "dst_fmt",      "int_fmt",     "acc_qdata_0",
+     "acc_qdata_1", "acc_qdata_2",  "op_0",        "op_1",
+     "op_2",        "use_fpu",      "fpu_in_rd",   "fpu_in_acc",
+     "ls_size",     "is_load",      "is_store",    "lsu_qaddr",
+     "lsu_rd",      "acc_wb_ready", "fpu_out_acc", "fpr_waddr",
+     "fpr_wdata",   "fpr_we"},
+};
+
+inline void put_varint(std::vector<uint8_t> &buf, uint64_t value) {
+    while (value >= 0x80) {
+        buf.push_back((uint8_t)value | 0x80);
+        value >>= 7;
+    }
+    buf.push_back((uint8_t)value);
+}
+
+// Decode a varint, returns false if it runs past `end`.
+inline bool get_varint(const uint8_t *&ptr, const uint8_t *end,
+                       uint64_t &value) {
+    value = 0;
+    for (unsigned shift = 0; ptr < end && shift < 64; shift += 7) {
+        uint8_t byte = *ptr++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// One decoded record.
+struct Record {
+    uint8_t source;
+    bool pc_valid;
+    uint8_t priv;
+    uint64_t time, cycle, pc, insn;
+    uint64_t fields[64];
+};
+
+// Look up a field by name, returns -1 if the trace does not have it.
+inline int field_index(const std::vector<std::string> &names,
+                       const char *name) {
+    for (size_t i = 0; i < names.size(); i++)
+        if (names[i] == name) return i;
+    return -1;
+}
+
+// Indices of the snitch fields used by the trace tools.
+struct SnitchFields {
+    int source, stall, exception, rs1, rs2, rd, is_load, is_store, is_branch,
+        pc_d, opa, opb, opa_select, opb_select, write_rd, csr_addr, writeback,
+        gpr_rdata_1, ls_size, ld_result_32, lsu_rd, retire_load, alu_result,
+        retire_acc, acc_pid, acc_pdata_32, fpu_offload, is_seq_insn;
+    // Name of the first missing field, if any.
+    const char *missing = nullptr;
+
+    explicit SnitchFields(const std::vector<std::string> &names) {
+#define SNITCH_FIELD(name)                                \
+    if ((name = field_index(names, #name)) < 0 && !missing) \
+        missing = #name;
+        SNITCH_FIELD(source) SNITCH_FIELD(stall) SNITCH_FIELD(exception)
+        SNITCH_FIELD(rs1) SNITCH_FIELD(rs2) SNITCH_FIELD(rd)
+        SNITCH_FIELD(is_load) SNITCH_FIELD(is_store) SNITCH_FIELD(is_branch)
+        SNITCH_FIELD(pc_d) SNITCH_FIELD(opa) SNITCH_FIELD(opb)
+        SNITCH_FIELD(opa_select) SNITCH_FIELD(opb_select)
+        SNITCH_FIELD(write_rd) SNITCH_FIELD(csr_addr) SNITCH_FIELD(writeback)
+        SNITCH_FIELD(gpr_rdata_1) SNITCH_FIELD(ls_size)
+        SNITCH_FIELD(ld_result_32) SNITCH_FIELD(lsu_rd)
+        SNITCH_FIELD(retire_load) SNITCH_FIELD(alu_result)
+        SNITCH_FIELD(retire_acc) SNITCH_FIELD(acc_pid)
+        SNITCH_FIELD(acc_pdata_32) SNITCH_FIELD(fpu_offload)
+        SNITCH_FIELD(is_seq_insn)
+#undef SNITCH_FIELD
+    }
+};
+
+// Buffered writer of one hart's trace.
+class TraceWriter {
+   public:
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    TraceWriter(const char *path, uint32_t hart) : file(fopen(path, "wb")) {
+        if (!file) return;
+        buf.reserve(BUFFER_SIZE + 1024);
+        buf.insert(buf.end(), TRACE_MAGIC, TRACE_MAGIC + sizeof(TRACE_MAGIC));
+        put_u32(hart);
+        for (auto &fields : SOURCE_FIELDS) {
+            put_u32(fields.size());
+            for (auto &name : fields) {
+                buf.push_back(name.size());
+                buf.insert(buf.end(), name.begin(), name.end());
+            }
+        }
+    }
+    ~TraceWriter() {
+        if (!file) return;
+        flush();
+        fclose(file);
+    }
+
+    bool ok() const { return file != nullptr; }
+
+    void record(Source source, uint64_t time, uint64_t cycle, uint8_t priv,
+                bool pc_valid, uint64_t pc, uint64_t insn,
+                const uint64_t *fields) {
+        buf.push_back(source | (pc_valid ? PC_VALID : 0));
+        put_varint(buf, time - last_time);
+        last_time = time;
+        put_varint(buf, cycle);
+        buf.push_back(priv);
+        if (pc_valid) put_varint(buf, pc);
+        put_varint(buf, insn);
+        for (size_t i = 0; i < SOURCE_FIELDS[source].size(); i++)
+            put_varint(buf, fields[i]);
+        if (buf.size() >= BUFFER_SIZE) flush();
+    }
+
+    void flush() {
+        fwrite(buf.data(), 1, buf.size(), file);
+        buf.clear();
+    }
+
+   private:
+    void put_u32(uint32_t value) {
+        for (int i = 0; i < 4; i++) buf.push_back(value >> (8 * i));
+    }
+
+    FILE *file;
+    std::vector<uint8_t> buf;
+    uint64_t last_time = 0;
+};
+
+// Reader over a trace held in memory, e.g., an `mmap`ed file.
+class TraceReader {
+   public:
+    TraceReader(const uint8_t *data, size_t size)
+        : ptr(data), end(data + size) {
+        valid = size >= sizeof(TRACE_MAGIC) + 4 &&
+                std::equal(TRACE_MAGIC, TRACE_MAGIC + sizeof(TRACE_MAGIC),
+                           (const char *)data);
+        if (!valid) return;
+        ptr += sizeof(TRACE_MAGIC);
+        hart = get_u32();
+        for (auto &names : fields) {
+            uint32_t num = get_u32();
+            valid = valid && num <= 64;
+            for (uint32_t i = 0; valid && i < num; i++) {
+                if (ptr >= end || end - ptr - 1 < *ptr) valid = false;
+                if (!valid) break;
+                uint8_t len = *ptr++;
+                names.emplace_back((const char *)ptr, len);
+                ptr += len;
+            }
+        }
+    }
+
+    // Decode the next record, returns false at the end of the trace or on a
+    // truncated record.
+    bool next(Record &rec) {
+        if (!valid || end - ptr < 2) return false;
+        uint8_t tag = *ptr++;
+        rec.source = tag & ~PC_VALID;
+        rec.pc_valid = tag & PC_VALID;
+        if (rec.source >= NumSources) return valid = false;
+        uint64_t delta;
+        if (!get_varint(ptr, end, delta)) return false;
+        rec.time = time += delta;
+        if (!get_varint(ptr, end, rec.cycle) || ptr >= end) return false;
+        rec.priv = *ptr++;
+        rec.pc = 0;
+        if (rec.pc_valid && !get_varint(ptr, end, rec.pc)) return false;
+        if (!get_varint(ptr, end, rec.insn)) return false;
+        for (size_t i = 0; i < fields[rec.source].size(); i++)
+            if (!get_varint(ptr, end, rec.fields[i])) return false;
+        return true;
+    }
+
+    bool valid;
+    uint32_t hart = 0;
+    std::vector<std::string> fields[NumSources];
+
+   private:
+    uint32_t get_u32() {
+        uint32_t value = 0;
+        for (int i = 0; i < 4 && ptr < end; i++) value |= (uint32_t)*ptr++ << (8 * i);
+        return value;
+    }
+
+    const uint8_t *ptr, *end;
+    uint64_t time = 0;
+};
+
+}  // namespace trace
+}  // namespace sim
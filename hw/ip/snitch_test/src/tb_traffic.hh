@@ -0,0 +1,204 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Solderpad Hardware License, Version 0.51, see LICENSE for details.
+// SPDX-License-Identifier: SHL-0.51
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sim {
+
+// Heatmap of the traffic to the global memory (`--traffic=<file>`). Counts
+// the bytes read and written per page and per region of the binary (its
+// allocated ELF sections, the putc buffers and the heap behind them) in
+// buckets of `bucket_cycles`. Accesses of the target are reported by the
+// memory models, accesses of fesvr (HTIF) are counted separately. Only
+// called from the simulation thread.
+class TrafficMap {
+   public:
+    // Configuration, set by the driver.
+    const char *path = nullptr;
+    static constexpr uint64_t DEFAULT_BUCKET_CYCLES = 10000;
+    uint64_t bucket_cycles = DEFAULT_BUCKET_CYCLES;
+
+    bool enabled() const { return path != nullptr; }
+
+    void add_region(const std::string &name, uint64_t base, uint64_t size) {
+        if (!size) return;
+        regions.push_back(Region{name, base, size, {}});
+        std::sort(regions.begin(), regions.end(),
+                  [](const Region &a, const Region &b) { return a.base < b.base; });
+    }
+
+    // Count an access of `len` bytes at `addr` in `cycle`. Host accesses
+    // happen between cycles and are counted in the last cycle seen.
+    void record(uint64_t cycle, uint64_t addr, uint64_t len, bool write,
+                bool host = false) {
+        if (!enabled() || !len) return;
+        if (host)
+            cycle = last_cycle;
+        else
+            last_cycle = std::max(last_cycle, cycle);
+        uint64_t bucket = cycle / std::max<uint64_t>(bucket_cycles, 1);
+        int kind = (host ? 2 : 0) + (write ? 1 : 0);
+        region_of(addr).buckets[bucket].bytes[kind] += len;
+        pages[addr >> PAGE_SHIFT][bucket].bytes[kind] += len;
+    }
+
+    // Write the heatmap as CSV if the path ends in `.csv`, as JSON otherwise,
+    // and clear it for the next run of a batch.
+    void finish() {
+        if (!enabled() || (pages.empty() && regions.empty())) return;
+        FILE *file = fopen(path, "w");
+        if (!file) {
+            fprintf(stderr, "[TB] Cannot write %s\n", path);
+        } else {
+            std::string p(path);
+            bool csv = p.size() >= 4 && p.compare(p.size() - 4, 4, ".csv") == 0;
+            csv ? write_csv(file) : write_json(file);
+            fclose(file);
+            fprintf(stderr, "[TB] Wrote the memory traffic of %zu pages to %s\n",
+                    pages.size(), path);
+        }
+        regions.clear();
+        other.buckets.clear();
+        pages.clear();
+        last_cycle = 0;
+    }
+
+    ~TrafficMap() { finish(); }
+
+   private:
+    static constexpr unsigned PAGE_SHIFT = 12;
+
+    // Bytes read and written by the target, then by the host.
+    struct Counts {
+        uint64_t bytes[4] = {0};
+        Counts &operator+=(const Counts &o) {
+            for (int i = 0; i < 4; i++) bytes[i] += o.bytes[i];
+            return *this;
+        }
+    };
+    using Buckets = std::map<uint64_t, Counts>;
+
+    struct Region {
+        std::string name;
+        uint64_t base, size;
+        Buckets buckets;
+    };
+
+    Region &region_of(uint64_t addr) {
+        auto it = std::upper_bound(
+            regions.begin(), regions.end(), addr,
+            [](uint64_t a, const Region &r) { return a < r.base; });
+        if (it != regions.begin() && addr - std::prev(it)->base < std::prev(it)->size)
+            return *std::prev(it);
+        return other;
+    }
+
+    const char *region_name(uint64_t addr) {
+        return region_of(addr).name.c_str();
+    }
+
+    static Counts total(const Buckets &buckets) {
+        Counts sum;
+        for (auto &b : buckets) sum += b.second;
+        return sum;
+    }
+
+    static void json_counts(FILE *file, const Counts &c) {
+        fprintf(file,
+                "\"read\": %lu, \"write\": %lu, \"host_read\": %lu, "
+                "\"host_write\": %lu",
+                c.bytes[0], c.bytes[1], c.bytes[2], c.bytes[3]);
+    }
+
+    // Buckets as `[bucket, read, write, host_read, host_write]` rows.
+    static void json_buckets(FILE *file, const Buckets &buckets) {
+        fprintf(file, "\"buckets\": [");
+        bool first = true;
+        for (auto &b : buckets) {
+            auto &c = b.second.bytes;
+            fprintf(file, "%s[%lu, %lu, %lu, %lu, %lu]", first ? "" : ", ",
+                    b.first, c[0], c[1], c[2], c[3]);
+            first = false;
+        }
+        fprintf(file, "]");
+    }
+
+    std::vector<uint64_t> sorted_pages() const {
+        std::vector<uint64_t> keys;
+        for (auto &p : pages) keys.push_back(p.first);
+        std::sort(keys.begin(), keys.end());
+        return keys;
+    }
+
+    void write_json(FILE *file) {
+        fprintf(file, "{\n    \"bucket_cycles\": %lu,\n    \"regions\": [",
+                bucket_cycles);
+        std::vector<const Region *> all;
+        for (auto &r : regions) all.push_back(&r);
+        all.push_back(&other);
+        for (size_t i = 0; i < all.size(); i++) {
+            auto &r = *all[i];
+            fprintf(file,
+                    "%s\n        {\"name\": \"%s\", \"base\": \"0x%lx\", "
+                    "\"size\": %lu, ",
+                    i ? "," : "", r.name.c_str(), r.base, r.size);
+            json_counts(file, total(r.buckets));
+            fprintf(file, ", ");
+            json_buckets(file, r.buckets);
+            fprintf(file, "}");
+        }
+        fprintf(file, "\n    ],\n    \"pages\": [");
+        bool first = true;
+        for (auto page : sorted_pages()) {
+            auto &buckets = pages[page];
+            uint64_t addr = page << PAGE_SHIFT;
+            fprintf(file, "%s\n        {\"page\": \"0x%lx\", \"region\": \"%s\", ",
+                    first ? "" : ",", addr, region_name(addr));
+            json_counts(file, total(buckets));
+            fprintf(file, ", ");
+            json_buckets(file, buckets);
+            fprintf(file, "}");
+            first = false;
+        }
+        fprintf(file, "\n    ]\n}\n");
+    }
+
+    // One row per region or page and bucket.
+    void write_csv(FILE *file) {
+        fprintf(file,
+                "kind,name,base,bucket,start_cycle,read,write,host_read,"
+                "host_write\n");
+        auto rows = [&](const char *kind, const char *name, uint64_t base,
+                        const Buckets &buckets) {
+            for (auto &b : buckets) {
+                auto &c = b.second.bytes;
+                fprintf(file, "%s,%s,0x%lx,%lu,%lu,%lu,%lu,%lu,%lu\n", kind,
+                        name, base, b.first, b.first * bucket_cycles, c[0],
+                        c[1], c[2], c[3]);
+            }
+        };
+        for (auto &r : regions) rows("region", r.name.c_str(), r.base, r.buckets);
+        rows("region", other.name.c_str(), other.base, other.buckets);
+        for (auto page : sorted_pages()) {
+            uint64_t addr = page << PAGE_SHIFT;
+            rows("page", region_name(addr), addr, pages[page]);
+        }
+    }
+
+    std::vector<Region> regions;
+    Region other{"other", 0, 0, {}};
+    std::unordered_map<uint64_t, Buckets> pages;
+    uint64_t last_cycle = 0;
+};
+extern TrafficMap TRAFFIC;
+
+}  // namespace sim
@@ -4,38 +4,286 @@
 
 #include <printf.h>
 
+#include <fstream>
+#include <sstream>
+
 #include "Vtestharness.h"
 #include "Vtestharness__Dpi.h"
 #include "sim.hh"
 #include "tb_lib.hh"
+#include "tb_perf.hh"
+#include "tb_traffic.hh"
 #include "verilated.h"
+#ifdef SIM_SAVABLE
+#include "verilated_save.h"
+#endif
+#ifdef SIM_TRACE_FST
+#include "verilated_fst_c.h"
+#elif defined(SIM_TRACE)
+#include "verilated_vcd_c.h"
+#endif
 namespace sim {
 
 Sim* s;
 
-// Number of cycles between HTIF checks.
-const int HTIFTimeInterval = 200;
+// When to switch to the HTIF interface.
+enum HTIFPolicy {
+    // Every `HTIFTimeInterval` half-cycles.
+    HTIFFixed,
+    // Double the interval up to `HTIFMaxInterval` while fesvr is idle.
+    HTIFBackoff,
+    // Only after the target wrote `tohost`/`fromhost`, or after
+    // `HTIFMaxInterval` half-cycles.
+    HTIFWatch,
+};
+HTIFPolicy HTIFTimePolicy = HTIFFixed;
+// Number of half-cycles between HTIF checks.
+uint64_t HTIFTimeInterval = 200;
+uint64_t HTIFMaxInterval = 1 << 20;
+// Number of switches to the HTIF interface.
+uint64_t HTIFSwitches = 0;
+
+// Snapshot taken at the first `start_kernel()`, or at `CheckpointCycle`.
+const char *CheckpointFile = nullptr;
+uint64_t CheckpointCycle = 0;
+// Snapshot to continue from, optionally reloading the binary's segments.
+const char *RestoreFile = nullptr;
+bool RestoreReload = false;
+
+// Cycles in which waves and instruction traces are captured.
+enum TraceWindowMode {
+    // The whole simulation.
+    TraceAll,
+    // From `start_kernel()` to `stop_kernel()`, shifted by the offsets.
+    TraceKernel,
+    // From `TraceStartCycle` to `TraceStopCycle`.
+    TraceCycles,
+};
+TraceWindowMode TraceWindow = TraceAll;
+uint64_t TraceStartCycle = 0;
+uint64_t TraceStopCycle = UINT64_MAX;
+// Cycles to delay the start of each kernel window and to extend its end.
+uint64_t TraceStartOffset = 0;
+uint64_t TraceStopOffset = 0;
+// Waveform file, `.fst` or `.vcd` depending on how the model was verilated.
+const char *WavesFile = nullptr;
+
+// Cycle budget of each binary in batch mode, zero for none.
+uint64_t BatchMaxCycles = 0;
+// Whether several binaries run one after the other on the same model.
+bool BatchMode = false;
+
+// The model and the waveform writer outlive a single `Sim`, so that batch
+// runs reuse them.
+std::unique_ptr<Vtestharness> Top;
+#ifdef SIM_TRACE
+#ifdef SIM_TRACE_FST
+std::unique_ptr<VerilatedFstC> Waves;
+#else
+std::unique_ptr<VerilatedVcdC> Waves;
+#endif
+#endif
+
+// Thrown on the host side once a binary exceeded `BatchMaxCycles`.
+struct CycleBudgetExceeded {};
+
 void sim_thread_main(void *arg) { ((Sim *)arg)->main(); }
 
 // Sim time.
-int TIME = 0;
+uint64_t TIME = 0;
+// Time at which the current binary started. Reset is asserted for the first
+// eight half-cycles after it.
+uint64_t RUN_START = 0;
 
 Sim::Sim(int argc, char **argv) : htif_t(argc, argv) {
     Verilated::commandArgs(argc, argv);
+    parse_args(argc, argv);
+    // Options of an earlier binary of the batch do not carry over.
+    HTIFTimePolicy = HTIFFixed;
+    HTIFTimeInterval = 200;
+    HTIFMaxInterval = 1 << 20;
+    TraceWindow = TraceAll;
+    TraceStartCycle = 0;
+    TraceStopCycle = UINT64_MAX;
+    TraceStartOffset = 0;
+    TraceStopOffset = 0;
+    WavesFile = nullptr;
+    for (auto i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--htif-policy=fixed") == 0) {
+            HTIFTimePolicy = HTIFFixed;
+        } else if (strcmp(argv[i], "--htif-policy=backoff") == 0) {
+            HTIFTimePolicy = HTIFBackoff;
+        } else if (strcmp(argv[i], "--htif-policy=watch") == 0) {
+            HTIFTimePolicy = HTIFWatch;
+        } else if (strncmp(argv[i], "--htif-interval=", 16) == 0) {
+            HTIFTimeInterval = std::max(1UL, strtoul(argv[i] + 16, NULL, 0));
+        } else if (strncmp(argv[i], "--htif-max-interval=", 20) == 0) {
+            HTIFMaxInterval = strtoul(argv[i] + 20, NULL, 0);
+        } else if (strncmp(argv[i], "--checkpoint=", 13) == 0) {
+            CheckpointFile = argv[i] + 13;
+        } else if (strncmp(argv[i], "--checkpoint-cycle=", 19) == 0) {
+            CheckpointCycle = strtoul(argv[i] + 19, NULL, 0);
+        } else if (strncmp(argv[i], "--restore=", 10) == 0) {
+            RestoreFile = argv[i] + 10;
+        } else if (strcmp(argv[i], "--restore-reload") == 0) {
+            RestoreReload = true;
+        } else if (strcmp(argv[i], "--trace-window=all") == 0) {
+            TraceWindow = TraceAll;
+        } else if (strcmp(argv[i], "--trace-window=kernel") == 0) {
+            TraceWindow = TraceKernel;
+        } else if (strncmp(argv[i], "--trace-window=", 15) == 0) {
+            // `<start>:<stop>` in cycles, either bound may be omitted.
+            char *end;
+            TraceWindow = TraceCycles;
+            TraceStartCycle = strtoul(argv[i] + 15, &end, 0);
+            if (*end == ':' && end[1]) TraceStopCycle = strtoul(end + 1, NULL, 0);
+        } else if (strncmp(argv[i], "--trace-start-offset=", 21) == 0) {
+            TraceStartOffset = strtoul(argv[i] + 21, NULL, 0);
+        } else if (strncmp(argv[i], "--trace-stop-offset=", 20) == 0) {
+            TraceStopOffset = strtoul(argv[i] + 20, NULL, 0);
+        } else if (strncmp(argv[i], "--waves=", 8) == 0) {
+            WavesFile = argv[i] + 8;
+        }
+    }
+#ifndef SIM_TRACE
+    if (WavesFile) {
+        fprintf(stderr,
+                "[TB] Waves need a model verilated with tracing "
+                "(VLT_TRACE=vcd|fst)\n");
+        exit(1);
+    }
+#endif
+    TRACE_ENABLED = TraceWindow == TraceAll;
+#ifndef SIM_SAVABLE
+    if (CheckpointFile || RestoreFile) {
+        fprintf(stderr,
+                "[TB] Snapshots need a model verilated with --savable "
+                "(bin/spatz_cluster.vlt-save)\n");
+        exit(1);
+    }
+#endif
+    const char *feature = unsaved_state();
+    if ((CheckpointFile || RestoreFile) && feature) {
+        fprintf(stderr, "[TB] Snapshots do not support %s\n", feature);
+        exit(1);
+    }
+    // The memory comes from the snapshot, fesvr only needs the symbols.
+    if (RestoreFile) disable_preloading = true;
+    HTIFMaxInterval = std::max(HTIFMaxInterval, HTIFTimeInterval);
+}
+
+void Sim::idle() {
+    target.switch_to();
+    if (timed_out) throw CycleBudgetExceeded();
+}
+
+static void close_waves() {
+#ifdef SIM_TRACE
+    if (Waves) Waves->close();
+    Waves.reset();
+#endif
 }
 
-void Sim::idle() { target.switch_to(); }
+#ifdef SIM_SAVABLE
+static const uint64_t SnapshotMagic = 0x31544e5a54415053;  // "SPATZNT1"
+
+// Serialize the time, the cluster status, all written memory pages and the
+// model itself. The host side state of fesvr, such as the files the target
+// opened through its syscall proxy, and the queues and counters of the DPI
+// models are not part of the snapshot, see `unsaved_state`.
+static void save_snapshot(const char *path, Vtestharness &top) {
+    auto t0 = std::chrono::steady_clock::now();
+    // The DPI models register themselves during the first evaluation.
+    if (auto feature = unsaved_state()) {
+        fprintf(stderr, "[TB] Snapshots do not support %s\n", feature);
+        exit(1);
+    }
+    VerilatedSave os;
+    os.open(path);
+    if (!os.isOpen()) {
+        fprintf(stderr, "[TB] Cannot open snapshot `%s`\n", path);
+        exit(1);
+    }
+    auto pages = MEM.touched_pages();
+    uint64_t header[] = {SnapshotMagic, TIME, (uint64_t)CLUSTER_PROBE,
+                         CLUSTER_PROBE_CHANGES, pages.size()};
+    os.write(header, sizeof(header));
+    uint8_t buf[GlobalMemory::PAGE_SIZE];
+    for (auto page : pages) {
+        MEM.read(page << GlobalMemory::ADDR_SHIFT, sizeof(buf), buf);
+        os.write(&page, sizeof(page));
+        os.write(buf, sizeof(buf));
+    }
+    os << top;
+    os.close();
+    auto t1 = std::chrono::steady_clock::now();
+    fprintf(stderr, "[TB] Saved snapshot `%s` at cycle %lu (%zu pages, %.3f ms)\n",
+            path, TIME / 2, pages.size(),
+            std::chrono::duration<double, std::milli>(t1 - t0).count());
+}
+
+static void restore_snapshot(const char *path, Vtestharness &top) {
+    auto t0 = std::chrono::steady_clock::now();
+    VerilatedRestore os;
+    os.open(path);
+    uint64_t header[5] = {0};
+    if (os.isOpen()) os.read(header, sizeof(header));
+    if (header[0] != SnapshotMagic) {
+        fprintf(stderr, "[TB] `%s` is not a snapshot\n", path);
+        exit(1);
+    }
+    TIME = header[1];
+    CLUSTER_PROBE = header[2];
+    CLUSTER_PROBE_CHANGES = header[3];
+    uint64_t num_pages = header[4];
+    MEM.clear();
+    uint8_t buf[GlobalMemory::PAGE_SIZE];
+    for (uint64_t i = 0; i < num_pages; i++) {
+        uint64_t page;
+        os.read(&page, sizeof(page));
+        os.read(buf, sizeof(buf));
+        MEM.write(page << GlobalMemory::ADDR_SHIFT, sizeof(buf), buf, nullptr);
+    }
+    os >> top;
+    os.close();
+    auto t1 = std::chrono::steady_clock::now();
+    fprintf(stderr,
+            "[TB] Restored snapshot `%s` at cycle %lu (%lu pages, %.3f ms)\n",
+            path, TIME / 2, num_pages,
+            std::chrono::duration<double, std::milli>(t1 - t0).count());
+}
+#endif
 
 /// Execute the simulation.
 int Sim::run() {
     host = context_t::current();
     target.init(sim_thread_main, this);
 
-    int exit_code = htif_t::run();
-    if (exit_code == 0)
+    int exit_code;
+    try {
+        exit_code = htif_t::run();
+    } catch (CycleBudgetExceeded &) {
+        // The target context is abandoned mid-cycle, the next run resets the
+        // model.
+        exit_code = -1;
+    }
+    uint64_t fixed_switches = (TIME - RUN_START) / HTIFTimeInterval;
+    fprintf(stderr,
+            "[TB] HTIF switches: %lu (%lu with a fixed interval of %lu, %lu "
+            "saved)\n",
+            HTIFSwitches, fixed_switches, HTIFTimeInterval,
+            fixed_switches > HTIFSwitches ? fixed_switches - HTIFSwitches : 0);
+    if (timed_out)
+      fprintf(stderr, "[FAILURE] Exceeded the budget of %lu cycles\n",
+              BatchMaxCycles);
+    else if (exit_code == 0)
       fprintf(stderr, "[SUCCESS] Program finished successfully\n");
     else
       fprintf(stderr, "[FAILURE] Finished with exit code %2d\n", exit_code);
+    // Verilator does not run the `final` blocks that take the last sample.
+    PERF.finish();
+    TRAFFIC.finish();
+    if (!BatchMode) close_waves();
     return exit_code;
 }
 
@@ -45,26 +293,265 @@ void Sim::main() {
 
     // Create a pointer to ourselves
     s = this;
+    RUN_START = TIME;
+    HTIFSwitches = 0;
 
-    // Allocate the simulation state.
-    auto top = std::make_unique<Vtestharness>();
+    // Allocate the simulation state, unless an earlier run of the batch
+    // already did.
+    if (!Top) Top = std::make_unique<Vtestharness>();
+    auto &top = Top;
 
-    bool clk_i = 0, rst_ni = 0;
+    bool clk_i = TIME & 1, rst_ni = 0;
+    uint64_t interval = HTIFTimeInterval;
+    uint64_t last_switch = TIME;
+    bool host_busy = false;
+
+#ifdef SIM_SAVABLE
+    if (RestoreFile) {
+        restore_snapshot(RestoreFile, *top);
+        // Overwrite the restored memory with the segments of this binary.
+        if (RestoreReload) preload_elf(target_args()[0].c_str());
+        // The clock is toggled before each evaluation.
+        clk_i = TIME & 1;
+        last_switch = TIME;
+    }
+    uint64_t probe_changes = CLUSTER_PROBE_CHANGES;
+    bool checkpoint_due = false;
+#endif
+
+#ifdef SIM_TRACE
+    if (WavesFile && !Waves) {
+#ifdef SIM_TRACE_FST
+        Waves = std::make_unique<VerilatedFstC>();
+#else
+        Waves = std::make_unique<VerilatedVcdC>();
+#endif
+        top->trace(Waves.get(), 99);
+        Waves->open(WavesFile);
+    }
+#endif
+
+    // Current trace window in cycles of this binary. A restored snapshot may
+    // already be inside a kernel.
+    uint64_t window_start = 0, window_stop = UINT64_MAX;
+    if (TraceWindow == TraceCycles) {
+        window_start = TraceStartCycle;
+        window_stop = TraceStopCycle;
+    } else if (TraceWindow == TraceKernel) {
+        window_start = CLUSTER_PROBE ? (TIME - RUN_START) / 2 + TraceStartOffset
+                                     : UINT64_MAX;
+    }
+    uint64_t trace_probe_changes = CLUSTER_PROBE_CHANGES;
 
     while (!Verilated::gotFinish()) {
         clk_i = !clk_i;
-        rst_ni = TIME >= 8;
+        rst_ni = TIME - RUN_START >= 8;
         top->clk_i = clk_i;
         top->rst_ni = rst_ni;
         // Evaluate the DUT.
         top->eval();
         // Increase global time.
         TIME++;
-        // Switch to the HTIF interface in regular intervals.
-        if (TIME % HTIFTimeInterval == 0) {
+#ifdef SIM_SAVABLE
+        // Take the snapshot after the first rising edge of the cluster status
+        // or at the requested cycle, on a falling clock edge.
+        if (CheckpointFile) {
+            if (CheckpointCycle ? TIME / 2 >= CheckpointCycle
+                                : CLUSTER_PROBE_CHANGES != probe_changes &&
+                                      CLUSTER_PROBE)
+                checkpoint_due = true;
+            probe_changes = CLUSTER_PROBE_CHANGES;
+            if (checkpoint_due && !clk_i) {
+                save_snapshot(CheckpointFile, *top);
+                CheckpointFile = nullptr;
+            }
+        }
+#endif
+        // Give up on binaries that exceed their cycle budget.
+        uint64_t cycle = (TIME - RUN_START) / 2;
+        if (BatchMaxCycles && cycle >= BatchMaxCycles && !timed_out) {
+            timed_out = true;
+            host->switch_to();
+        }
+        // Follow the cluster status and open or close the trace window.
+        if (TraceWindow == TraceKernel &&
+            CLUSTER_PROBE_CHANGES != trace_probe_changes) {
+            trace_probe_changes = CLUSTER_PROBE_CHANGES;
+            if (CLUSTER_PROBE) {
+                window_start = cycle + TraceStartOffset;
+                window_stop = UINT64_MAX;
+            } else {
+                window_stop = cycle + TraceStopOffset;
+            }
+        }
+        bool in_window = cycle >= window_start && cycle < window_stop;
+        if (in_window != TRACE_ENABLED) {
+            TRACE_ENABLED = in_window;
+            fprintf(stderr, "[TB] Trace window %s at cycle %lu\n",
+                    in_window ? "opened" : "closed", cycle);
+        }
+#ifdef SIM_TRACE
+        if (Waves && in_window) Waves->dump(TIME);
+#endif
+        // Switch to the HTIF interface according to the policy.
+        uint64_t elapsed = TIME - last_switch;
+        bool do_switch;
+        switch (HTIFTimePolicy) {
+            case HTIFBackoff:
+                do_switch = elapsed >= interval;
+                break;
+            case HTIFWatch:
+                // Keep polling at the base rate while fesvr has work, e.g.,
+                // responses queued until the target clears `fromhost`.
+                do_switch = MEM.watch_hit || elapsed >= HTIFMaxInterval ||
+                            (host_busy && elapsed >= HTIFTimeInterval);
+                break;
+            default:
+                do_switch = TIME % HTIFTimeInterval == 0;
+                break;
+        }
+        if (do_switch) {
+            uint64_t writes = host_writes;
             host->switch_to();
+            HTIFSwitches++;
+            last_switch = TIME;
+            host_busy = host_writes != writes;
+            MEM.watch_hit = false;
+            interval = host_busy ? HTIFTimeInterval
+                                 : std::min(2 * interval, HTIFMaxInterval);
+        }
+    }
+    close_waves();
+}
+
+struct BatchResult {
+    std::string binary;
+    int exit_code;
+    bool timed_out;
+    uint64_t cycles;
+    double seconds;
+};
+
+static std::string json_escape(const std::string &str) {
+    std::string out;
+    for (char c : str) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// Write the results so far as CSV if `path` ends in `.csv`, as JSON
+// otherwise.
+static void write_batch_report(const char *path,
+                               const std::vector<BatchResult> &results) {
+    FILE *fd = fopen(path, "w");
+    if (!fd) {
+        fprintf(stderr, "[TB] Cannot write batch report `%s`\n", path);
+        return;
+    }
+    size_t len = strlen(path);
+    bool csv = len >= 4 && strcmp(path + len - 4, ".csv") == 0;
+    if (csv) fprintf(fd, "binary,status,exit_code,cycles,seconds\n");
+    else fprintf(fd, "[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        auto &r = results[i];
+        const char *status =
+            r.timed_out ? "timeout" : r.exit_code ? "fail" : "pass";
+        if (csv) {
+            fprintf(fd, "%s,%s,%d,%lu,%.3f\n", r.binary.c_str(), status,
+                    r.exit_code, r.cycles, r.seconds);
+        } else {
+            fprintf(fd,
+                    "  {\"binary\": \"%s\", \"status\": \"%s\", "
+                    "\"exit_code\": %d, \"cycles\": %lu, \"seconds\": %.3f}%s\n",
+                    json_escape(r.binary).c_str(), status, r.exit_code,
+                    r.cycles, r.seconds, i + 1 < results.size() ? "," : "");
+        }
+    }
+    if (!csv) fprintf(fd, "]\n");
+    fclose(fd);
+}
+
+int run_batch(int argc, char **argv) {
+    const char *manifest = argv[1] + 8;
+    const char *report = nullptr;
+    // Options after the manifest apply to every binary.
+    std::vector<std::string> shared;
+    for (auto i = 2; i < argc; ++i) {
+        if (strncmp(argv[i], "--batch-report=", 15) == 0) {
+            report = argv[i] + 15;
+        } else if (strncmp(argv[i], "--batch-max-cycles=", 19) == 0) {
+            BatchMaxCycles = strtoul(argv[i] + 19, NULL, 0);
+        } else if (strncmp(argv[i], "--checkpoint", 12) == 0 ||
+                   strncmp(argv[i], "--restore", 9) == 0) {
+            fprintf(stderr, "[TB] Snapshots are not supported in batch mode\n");
+            return 1;
+        } else {
+            shared.push_back(argv[i]);
         }
     }
+
+    // One binary per line, followed by its own arguments. Empty lines and
+    // lines starting with `#` are skipped.
+    std::ifstream in(manifest);
+    if (!in) {
+        fprintf(stderr, "[TB] Cannot open batch manifest `%s`\n", manifest);
+        return 1;
+    }
+    std::vector<std::vector<std::string>> entries;
+    for (std::string line; std::getline(in, line);) {
+        std::istringstream words(line);
+        std::vector<std::string> entry;
+        for (std::string word; words >> word;) entry.push_back(word);
+        if (!entry.empty() && entry[0][0] != '#') entries.push_back(entry);
+    }
+
+    BatchMode = true;
+    std::vector<BatchResult> results;
+    for (auto &entry : entries) {
+        // Only the pages the previous binary wrote need to be cleared, the
+        // model itself is reset through `rst_ni`.
+        if (!results.empty()) {
+            MEM.clear();
+            CLUSTER_PROBE = 0;
+        }
+        std::vector<std::string> args = {argv[0]};
+        args.insert(args.end(), entry.begin(), entry.end());
+        args.insert(args.end(), shared.begin(), shared.end());
+        std::vector<char *> sim_argv;
+        for (auto &arg : args) sim_argv.push_back(&arg[0]);
+        sim_argv.push_back(nullptr);
+
+        fprintf(stderr, "[TB] Batch %zu/%zu: %s\n", results.size() + 1,
+                entries.size(), entry[0].c_str());
+        auto t0 = std::chrono::steady_clock::now();
+        auto sim = std::make_unique<Sim>(args.size(), sim_argv.data());
+        int exit_code = sim->run();
+        auto t1 = std::chrono::steady_clock::now();
+        results.push_back(
+            {entry[0], exit_code, sim->timed_out, (TIME - RUN_START) / 2,
+             std::chrono::duration<double>(t1 - t0).count()});
+        // Keep the report current in case a later binary crashes the model.
+        if (report) write_batch_report(report, results);
+        if (Verilated::gotFinish()) {
+            fprintf(stderr, "[TB] Model called $finish, stopping the batch\n");
+            break;
+        }
+    }
+    close_waves();
+
+    size_t passed = 0, timeouts = 0;
+    for (auto &r : results) {
+        passed += !r.timed_out && r.exit_code == 0;
+        timeouts += r.timed_out;
+    }
+    fprintf(stderr,
+            "[TB] Batch finished: %zu passed, %zu failed, %zu timed out, %zu "
+            "not run\n",
+            passed, results.size() - passed - timeouts, timeouts,
+            entries.size() - results.size());
+    return passed == entries.size() ? 0 : 1;
 }
 }  // namespace sim
 
@@ -77,7 +564,7 @@ void tb_memory_read(long long addr, int len, const svOpenArrayHandle data) {
     //           << " bytes)\n";
     void *data_ptr = svGetArrayPtr(data);
     assert(data_ptr);
-    sim::MEM.read(addr, len, (uint8_t *)data_ptr);
+    sim::REGBUS_READS.read(addr, len, (uint8_t *)data_ptr);
 }
 
 void tb_memory_write(long long addr, int len, const svOpenArrayHandle data,
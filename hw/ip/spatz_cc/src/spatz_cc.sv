@@ -476,22 +476,35 @@ module spatz_cc
   // Tracer
   // --------------------------
   // pragma translate_off
-  int           f;
+  int           f = 0;
   string        fn;
   logic  [63:0] cycle;
 
-  initial begin
-    // We need to schedule the assignment into a safe region, otherwise
-    // `hart_id_i` won't have a value assigned at the beginning of the first
-    // delta cycle.
-    /* verilator lint_off STMTDLY */
-    @(posedge clk_i);
-    /* verilator lint_on STMTDLY */
-    $system("mkdir logs -p");
-    $sformat(fn, "logs/trace_hart_%05x.dasm", hart_id_i);
-    f = $fopen(fn, "w");
-    $display("[Tracer] Logging Hart %d to %s", hart_id_i, fn);
-  end
+`ifdef TB_TRACE_WINDOW
+  // The testbench restricts tracing to a window of interest, e.g., the
+  // region between `start_kernel()` and `stop_kernel()`.
+  import "DPI-C" function int tb_trace_enabled();
+`endif
+
+`ifdef TB_TRACE_BINARY
+  // The testbench writes compact binary records instead of the text lines,
+  // see `tb_trace.hh` and `util/trace/tracedec`.
+  import "DPI-C" function void tb_trace_snitch(input int hart, input longint time_,
+    input longint cycle, input int priv, input int pc, input int insn,
+    input bit [$bits(snitch_pkg::snitch_trace_port_t)-1:0] extras);
+  import "DPI-C" function void tb_trace_fpu(input int hart, input longint time_,
+    input longint cycle, input int priv, input longint insn,
+    input bit [$bits(snitch_pkg::fpu_trace_port_t)-1:0] extras);
+  import "DPI-C" function void tb_trace_close(input int hart);
+`endif
+
+  function automatic bit trace_enabled();
+`ifdef TB_TRACE_WINDOW
+    return tb_trace_enabled() != 0;
+`else
+    return 1'b1;
+`endif
+  endfunction
 
   // verilog_lint: waive-start always-ff-non-blocking
   always_ff @(posedge clk_i) begin
@@ -501,7 +514,17 @@ module spatz_cc
     automatic snitch_pkg::fpu_trace_port_t extras_fpu;
     automatic snitch_pkg::fpu_sequencer_trace_port_t extras_fpu_seq_out;
 
-    if (rst_ni) begin
+    if (rst_ni && trace_enabled()) begin
+
+`ifndef TB_TRACE_BINARY
+      // Open the trace on the first traced cycle, when `hart_id_i` is known.
+      if (f == 0) begin
+        $system("mkdir logs -p");
+        $sformat(fn, "logs/trace_hart_%05x.dasm", hart_id_i);
+        f = $fopen(fn, "w");
+        $display("[Tracer] Logging Hart %d to %s", hart_id_i, fn);
+      end
+`endif
 
       cycle = '0;
 
@@ -550,10 +573,15 @@ module spatz_cc
       // we are not stalled <==> we have issued and processed an instruction (including offloads)
       // OR we are retiring (issuing a writeback from) a load or accelerator instruction
       if (!i_snitch.stall || i_snitch.retire_load || i_snitch.retire_acc) begin
+`ifdef TB_TRACE_BINARY
+        tb_trace_snitch(hart_id_i, $time, cycle, i_snitch.priv_lvl_q, i_snitch.pc_q,
+          i_snitch.inst_data_i, extras_snitch);
+`else
         $sformat(trace_entry, "%t %1d %8d 0x%h DASM(%h) #; %s\n",
           $time, cycle, i_snitch.priv_lvl_q, i_snitch.pc_q, i_snitch.inst_data_i,
           snitch_pkg::print_snitch_trace(extras_snitch));
         $fwrite(f, trace_entry);
+`endif
       end
       if (FPEn) begin
         // Trace FPU iff:
@@ -563,10 +591,15 @@ module spatz_cc
         // OR an FPU result, LSU result or bus value is ready to be written back to an FPR register
         if (extras_fpu.acc_q_hs || extras_fpu.fpu_out_hs
             || extras_fpu.lsu_q_hs || extras_fpu.fpr_we) begin
+`ifdef TB_TRACE_BINARY
+          tb_trace_fpu(hart_id_i, $time, cycle, i_snitch.priv_lvl_q, extras_fpu.op_in,
+            extras_fpu);
+`else
           $sformat(trace_entry, "%t %1d %8d 0x%h DASM(%h) #; %s\n",
             $time, cycle, i_snitch.priv_lvl_q, 32'hz, extras_fpu.op_in,
             snitch_pkg::print_fpu_trace(extras_fpu));
           $fwrite(f, trace_entry);
+`endif
         end
       end
     end else begin
@@ -575,7 +608,10 @@ module spatz_cc
   end
 
   final begin
-    $fclose(f);
+    if (f != 0) $fclose(f);
+`ifdef TB_TRACE_BINARY
+    tb_trace_close(hart_id_i);
+`endif
   end
   // verilog_lint: waive-stop always-ff-non-blocking
   // pragma translate_on
@@ -243,4 +243,74 @@ module spatz_cluster_peripheral
 
   `FF(perf_counter_q, perf_counter_d, '0, clk_i, rst_ni)
 
+  // pragma translate_off
+`ifdef TB_PERF_COUNTERS
+  // Backdoor for the testbench (`--perf-dump`): report the increments of all
+  // events for all harts each cycle, independent of the programmed counters,
+  // along with the programmed counters themselves. The events are indexed by
+  // their `PERF_COUNTER_ENABLE` bit; row 0 holds the cluster-wide events and
+  // row `1 + i` the events of hart `i`.
+  import "DPI-C" function int tb_perf_enabled();
+  import "DPI-C" function void tb_perf_cycle(input int hart_base, input int num_cores,
+    input int probe, input int unsigned events[], input longint unsigned counters[],
+    input int unsigned enable[], input int unsigned hart_select[]);
+  import "DPI-C" function void tb_perf_finish();
+
+  localparam int unsigned NumEvents = 31;
+
+  always_ff @(posedge clk_i) begin
+    automatic int unsigned events [(NrCores+1)*NumEvents];
+    automatic longint unsigned counters [NumPerfCounters];
+    automatic int unsigned enable [NumPerfCounters];
+    automatic int unsigned hart_select [NumPerfCounters];
+
+    if (rst_ni && tb_perf_enabled() != 0) begin
+      events = '{default: 0};
+      events[0]  = 1;
+      events[1]  = tcdm_events_q.inc_accessed;
+      events[2]  = tcdm_events_q.inc_congested;
+      events[10] = dma_events_q.aw_stall;
+      events[11] = dma_events_q.ar_stall;
+      events[12] = dma_events_q.r_stall;
+      events[13] = dma_events_q.w_stall;
+      events[14] = dma_events_q.buf_w_stall;
+      events[15] = dma_events_q.buf_r_stall;
+      events[16] = dma_events_q.aw_done;
+      events[17] = dma_events_q.aw_done ? (int'(dma_events_q.aw_len) + 1) << dma_events_q.aw_size : 0;
+      events[18] = dma_events_q.ar_done;
+      events[19] = dma_events_q.ar_done ? (int'(dma_events_q.ar_len) + 1) << dma_events_q.ar_size : 0;
+      events[20] = dma_events_q.r_done;
+      events[21] = dma_events_q.r_done ? DMADataWidth/8 : 0;
+      events[22] = dma_events_q.w_done;
+      events[23] = dma_events_q.w_done ? int'(dma_events_q.num_bytes_written) : 0;
+      events[24] = dma_events_q.b_done;
+      events[25] = dma_events_q.dma_busy;
+      for (int h = 0; h < NrCores; h++) begin
+        events[(h+1)*NumEvents+3]  = core_events_i[h].issue_fpu;
+        events[(h+1)*NumEvents+4]  = core_events_i[h].issue_fpu_seq;
+        events[(h+1)*NumEvents+5]  = core_events_i[h].issue_core_to_fpu;
+        events[(h+1)*NumEvents+6]  = core_events_i[h].retired_instr;
+        events[(h+1)*NumEvents+7]  = core_events_i[h].retired_load;
+        events[(h+1)*NumEvents+8]  = core_events_i[h].retired_i;
+        events[(h+1)*NumEvents+9]  = core_events_i[h].retired_acc;
+        events[(h+1)*NumEvents+26] = icache_events_q[h].l0_miss;
+        events[(h+1)*NumEvents+27] = icache_events_q[h].l0_hit;
+        events[(h+1)*NumEvents+28] = icache_events_q[h].l0_prefetch;
+        events[(h+1)*NumEvents+29] = icache_events_q[h].l0_double_hit;
+        events[(h+1)*NumEvents+30] = icache_events_q[h].l0_stall;
+      end
+      for (int i = 0; i < NumPerfCounters; i++) begin
+        counters[i]    = perf_counter_q[i];
+        enable[i]      = reg2hw.perf_counter_enable[i];
+        hart_select[i] = reg2hw.hart_select[i].q;
+      end
+      tb_perf_cycle(cluster_hart_base_id_i, NrCores, reg2hw.spatz_status.q, events,
+        counters, enable, hart_select);
+    end
+  end
+
+  final tb_perf_finish();
+`endif
+  // pragma translate_on
+
 endmodule
@@ -20,6 +20,7 @@ module testharness (
   import axi_pkg::xbar_rule_32_t;
 
   import "DPI-C" function int get_entry_point();
+  import "DPI-C" function void tb_cluster_probe(input int value);
 
   /*********
    *  AXI  *
@@ -156,7 +157,7 @@ module testharness (
    *********/
 
   logic                cluster_probe;
-  logic [NumCores-1:0] debug_req;
+  logic [NumCores-1:0] debug_req = '0;
 
   spatz_cluster_wrapper i_cluster_wrapper (
     .clk_i           (clk_i                ),
@@ -249,7 +250,7 @@ module testharness (
    ************************/
 
   `REQRSP_TYPEDEF_ALL(reqrsp_cluster_in, axi_addr_t, narrow_axi_data_t, narrow_axi_strb_t)
-  reqrsp_cluster_in_req_t to_cluster_req;
+  reqrsp_cluster_in_req_t to_cluster_req = '0;
   reqrsp_cluster_in_rsp_t to_cluster_rsp;
 
   reqrsp_to_axi #(
@@ -270,7 +271,80 @@ module testharness (
   );
 
   logic [31:0] entry_point;
-  initial begin
+
+`ifdef TB_SAVABLE
+  // Boot sequence, stepped on the falling clock edge. Savable Verilator models
+  // are built without `--timing`, so this is a state machine rather than the
+  // sequence of event controls below.
+  typedef enum logic [2:0] {
+    BootLoad, BootDelay, BootReq, BootRsp, BootAck, BootWake, BootDone
+  } boot_state_e;
+
+  boot_state_e boot_state = BootLoad;
+  int unsigned boot_cnt   = 0;
+
+  always @(negedge clk_i) begin
+    boot_cnt <= boot_cnt + 1;
+    // Start over on every reset, e.g., between the binaries of a batch run.
+    if (!rst_ni) begin
+      boot_cnt       <= 0;
+      boot_state     <= BootLoad;
+      to_cluster_req <= '0;
+      debug_req      <= '0;
+    end else case (boot_state)
+      // Wait for a while, then load the entry point
+      BootLoad: if (boot_cnt == 9) begin
+        entry_point = get_entry_point();
+        $display("Loading entry point: %0x", entry_point);
+        boot_cnt   <= 0;
+        boot_state <= BootDelay;
+      end
+      // Wait for a while, then store the entry point in the Spatz cluster
+      BootDelay: if (boot_cnt == 999) begin
+        to_cluster_req <= '{
+          q: '{
+            addr   : PeriStartAddr + SPATZ_CLUSTER_PERIPHERAL_CLUSTER_BOOT_CONTROL_OFFSET,
+            data   : {32'b0, entry_point},
+            write  : 1'b1,
+            strb   : '1,
+            amo    : reqrsp_pkg::AMONone,
+            default: '0
+          },
+          q_valid: 1'b1,
+          p_ready: 1'b0
+        };
+        boot_state <= BootReq;
+      end
+      BootReq: if (to_cluster_rsp.q_ready) begin
+        to_cluster_req <= '0;
+        boot_state     <= BootRsp;
+      end
+      BootRsp: if (to_cluster_rsp.p_valid) begin
+        to_cluster_req <= '{
+          p_ready: 1'b1,
+          q      : '{
+            amo    : reqrsp_pkg::AMONone,
+            default: '0
+          },
+          default: '0
+        };
+        boot_state <= BootAck;
+      end
+      // Wake up cores
+      BootAck: begin
+        to_cluster_req <= '0;
+        debug_req      <= '1;
+        boot_state     <= BootWake;
+      end
+      BootWake: begin
+        debug_req  <= '0;
+        boot_state <= BootDone;
+      end
+      default:;
+    endcase
+  end
+`else
+  task automatic boot();
     // Idle
     to_cluster_req = '0;
     debug_req      = '0;
@@ -319,6 +393,32 @@ module testharness (
     debug_req = '1;
     @(negedge clk_i);
     debug_req = '0;
+  endtask
+
+  initial begin
+    boot();
+    // Boot again after every reset, e.g., between the binaries of a batch run.
+    forever begin
+      @(negedge rst_ni);
+      to_cluster_req = '0;
+      debug_req      = '0;
+      @(posedge rst_ni);
+      boot();
+    end
+  end
+`endif
+
+  // Report changes of the cluster status register (`start_kernel` and
+  // `stop_kernel`) to the testbench.
+  logic cluster_probe_q = 1'b0;
+
+  always_ff @(posedge clk_i) begin
+    if (!rst_ni) begin
+      cluster_probe_q <= 1'b0;
+    end else begin
+      if (cluster_probe != cluster_probe_q) tb_cluster_probe(int'(cluster_probe));
+      cluster_probe_q <= cluster_probe;
+    end
   end
 
   /********
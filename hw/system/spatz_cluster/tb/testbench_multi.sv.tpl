@@ -0,0 +1,379 @@
+// Copyright 2021 ETH Zurich and University of Bologna.
+// Solderpad Hardware License, Version 0.51, see LICENSE for details.
+// SPDX-License-Identifier: SHL-0.51
+
+`include "axi/assign.svh"
+`include "axi/typedef.svh"
+`include "reqrsp_interface/typedef.svh"
+
+// Testharness with `NrClusters` clusters. The clusters, and the testbench
+// for booting them, share one AXI crossbar. It routes each cluster's address
+// region to that cluster and everything else to the simulation memory.
+module testharness (
+    input logic clk_i,
+    input logic rst_ni
+  );
+
+  import spatz_cluster_pkg::*;
+  import spatz_cluster_peripheral_reg_pkg::*;
+
+  import "DPI-C" function int get_entry_point();
+  import "DPI-C" function void tb_cluster_probe(input int value);
+
+  /*********
+   *  AXI  *
+   *********/
+
+  localparam int unsigned NrClusters    = ${tb['nr_clusters']};
+  localparam int unsigned ClusterOffset = ${to_sv_hex(cfg['cluster_base_offset'], cfg['addr_width'])};
+  localparam int unsigned BaseHartId    = ${cfg['cluster_base_hartid']};
+
+  // The clusters and the boot master on the slave ports, the clusters and the
+  // memory on the master ports.
+  localparam int unsigned NrXbarSlvPorts = NrClusters + 1;
+  localparam int unsigned NrXbarMstPorts = NrClusters + 1;
+  localparam int unsigned BootPort       = NrClusters;
+  localparam int unsigned MemPort        = NrClusters;
+
+  localparam int unsigned XbarMstIdWidth = SpatzAxiIdOutWidth + $clog2(NrXbarSlvPorts);
+  typedef logic [XbarMstIdWidth-1:0] xbar_mst_id_t;
+  typedef logic [cf_math_pkg::idx_width(NrXbarMstPorts)-1:0] xbar_mst_idx_t;
+
+  `AXI_TYPEDEF_ALL(xbar_mst, axi_addr_t, xbar_mst_id_t, axi_data_t, axi_strb_t, axi_user_t)
+  // Wide data with the ID width of the cluster's slave port.
+  `AXI_TYPEDEF_ALL(cluster_in_wide, axi_addr_t, axi_id_in_t, axi_data_t, axi_strb_t, axi_user_t)
+
+  localparam axi_pkg::xbar_cfg_t XbarCfg = '{
+    NoSlvPorts        : NrXbarSlvPorts,
+    NoMstPorts        : NrXbarMstPorts,
+    MaxMstTrans       : ${tb['xbar']['max_mst_trans']},
+    MaxSlvTrans       : ${tb['xbar']['max_slv_trans']},
+    FallThrough       : 1'b0,
+    LatencyMode       : axi_pkg::${tb['xbar']['latency']},
+    PipelineStages    : 0,
+    AxiIdWidthSlvPorts: SpatzAxiIdOutWidth,
+    AxiIdUsedSlvPorts : SpatzAxiIdOutWidth,
+    UniqueIds         : 1'b0,
+    AxiAddrWidth      : SpatzAxiAddrWidth,
+    AxiDataWidth      : SpatzAxiDataWidth,
+    NoAddrRules       : NrClusters
+  };
+
+  typedef struct packed {
+    int unsigned idx;
+    axi_addr_t   start_addr;
+    axi_addr_t   end_addr;
+  } xbar_rule_t;
+
+  xbar_rule_t [NrClusters-1:0] xbar_rules;
+
+  for (genvar i = 0; i < NrClusters; i++) begin : gen_xbar_rules
+    assign xbar_rules[i] = '{
+      idx       : i,
+      start_addr: axi_addr_t'(TCDMStartAddr + i * ClusterOffset),
+      end_addr  : axi_addr_t'(TCDMStartAddr + (i + 1) * ClusterOffset)
+    };
+  end
+
+  spatz_axi_out_req_t  [NrXbarSlvPorts-1:0] xbar_slv_req;
+  spatz_axi_out_resp_t [NrXbarSlvPorts-1:0] xbar_slv_resp;
+  xbar_mst_req_t       [NrXbarMstPorts-1:0] xbar_mst_req;
+  xbar_mst_resp_t      [NrXbarMstPorts-1:0] xbar_mst_resp;
+
+  axi_xbar #(
+    .Cfg           (XbarCfg                      ),
+    .ATOPs         (1'b1                         ),
+    .slv_aw_chan_t (spatz_axi_out_aw_chan_t      ),
+    .mst_aw_chan_t (xbar_mst_aw_chan_t           ),
+    .w_chan_t      (spatz_axi_out_w_chan_t       ),
+    .slv_b_chan_t  (spatz_axi_out_b_chan_t       ),
+    .mst_b_chan_t  (xbar_mst_b_chan_t            ),
+    .slv_ar_chan_t (spatz_axi_out_ar_chan_t      ),
+    .mst_ar_chan_t (xbar_mst_ar_chan_t           ),
+    .slv_r_chan_t  (spatz_axi_out_r_chan_t       ),
+    .mst_r_chan_t  (xbar_mst_r_chan_t            ),
+    .slv_req_t     (spatz_axi_out_req_t          ),
+    .slv_resp_t    (spatz_axi_out_resp_t         ),
+    .mst_req_t     (xbar_mst_req_t               ),
+    .mst_resp_t    (xbar_mst_resp_t              ),
+    .rule_t        (xbar_rule_t                  )
+  ) i_xbar (
+    .clk_i                (clk_i                       ),
+    .rst_ni               (rst_ni                      ),
+    .test_i               (1'b0                        ),
+    .slv_ports_req_i      (xbar_slv_req                ),
+    .slv_ports_resp_o     (xbar_slv_resp               ),
+    .mst_ports_req_o      (xbar_mst_req                ),
+    .mst_ports_resp_i     (xbar_mst_resp               ),
+    .addr_map_i           (xbar_rules                  ),
+    .en_default_mst_port_i({NrXbarSlvPorts{1'b1}}      ),
+    .default_mst_port_i   ({NrXbarSlvPorts{xbar_mst_idx_t'(MemPort)}})
+  );
+
+  /*********
+   *  DUT  *
+   *********/
+
+  logic [NrClusters-1:0]               cluster_probe;
+  logic [NrClusters-1:0][NumCores-1:0] debug_req = '0;
+
+  for (genvar i = 0; i < NrClusters; i++) begin : gen_clusters
+    cluster_in_wide_req_t  axi_to_cluster_wide_req;
+    cluster_in_wide_resp_t axi_to_cluster_wide_resp;
+    spatz_axi_in_req_t     axi_to_cluster_req;
+    spatz_axi_in_resp_t    axi_to_cluster_resp;
+
+    // Squeeze the crossbar's IDs into the cluster's slave port.
+    axi_iw_converter #(
+      .AxiSlvPortIdWidth     (XbarMstIdWidth        ),
+      .AxiMstPortIdWidth     (SpatzAxiIdInWidth     ),
+      .AxiSlvPortMaxUniqIds  (2**SpatzAxiIdInWidth  ),
+      .AxiSlvPortMaxTxnsPerId(4                     ),
+      .AxiSlvPortMaxTxns     (${tb['xbar']['max_mst_trans']}),
+      .AxiMstPortMaxUniqIds  (2**SpatzAxiIdInWidth  ),
+      .AxiMstPortMaxTxnsPerId(4                     ),
+      .AxiAddrWidth          (SpatzAxiAddrWidth     ),
+      .AxiDataWidth          (SpatzAxiDataWidth     ),
+      .AxiUserWidth          (SpatzAxiUserWidth     ),
+      .slv_req_t             (xbar_mst_req_t        ),
+      .slv_resp_t            (xbar_mst_resp_t       ),
+      .mst_req_t             (cluster_in_wide_req_t ),
+      .mst_resp_t            (cluster_in_wide_resp_t)
+    ) i_iw_converter (
+      .clk_i     (clk_i                   ),
+      .rst_ni    (rst_ni                  ),
+      .slv_req_i (xbar_mst_req[i]         ),
+      .slv_resp_o(xbar_mst_resp[i]        ),
+      .mst_req_o (axi_to_cluster_wide_req ),
+      .mst_resp_i(axi_to_cluster_wide_resp)
+    );
+
+    // Narrow the crossbar's data down to the cluster's slave port.
+    axi_dw_converter #(
+      .AxiMaxReads        (4                               ),
+      .AxiSlvPortDataWidth(SpatzAxiDataWidth               ),
+      .AxiMstPortDataWidth(SpatzNarrowAxiDataWidth         ),
+      .AxiAddrWidth       (SpatzAxiAddrWidth               ),
+      .AxiIdWidth         (SpatzAxiIdInWidth               ),
+      .aw_chan_t          (spatz_axi_in_aw_chan_t          ),
+      .mst_w_chan_t       (spatz_axi_in_w_chan_t           ),
+      .slv_w_chan_t       (cluster_in_wide_w_chan_t        ),
+      .b_chan_t           (spatz_axi_in_b_chan_t           ),
+      .ar_chan_t          (spatz_axi_in_ar_chan_t          ),
+      .mst_r_chan_t       (spatz_axi_in_r_chan_t           ),
+      .slv_r_chan_t       (cluster_in_wide_r_chan_t        ),
+      .axi_mst_req_t      (spatz_axi_in_req_t              ),
+      .axi_mst_resp_t     (spatz_axi_in_resp_t             ),
+      .axi_slv_req_t      (cluster_in_wide_req_t           ),
+      .axi_slv_resp_t     (cluster_in_wide_resp_t          )
+    ) i_dw_converter (
+      .clk_i     (clk_i                   ),
+      .rst_ni    (rst_ni                  ),
+      .slv_req_i (axi_to_cluster_wide_req ),
+      .slv_resp_o(axi_to_cluster_wide_resp),
+      .mst_req_o (axi_to_cluster_req      ),
+      .mst_resp_i(axi_to_cluster_resp     )
+    );
+
+    spatz_cluster_wrapper i_cluster_wrapper (
+      .clk_i                  (clk_i                                      ),
+      .rst_ni                 (rst_ni                                     ),
+      .meip_i                 ('0                                         ),
+      .msip_i                 ('0                                         ),
+      .mtip_i                 ('0                                         ),
+  % if cfg['enable_debug']:
+      .debug_req_i            (debug_req[i]                               ),
+  % endif
+      .hart_base_id_i         (10'(BaseHartId + i * NumCores)             ),
+      .cluster_base_addr_i    (axi_addr_t'(TCDMStartAddr + i * ClusterOffset)),
+      .axi_core_default_user_i(axi_user_t'(${cfg['cluster_default_axi_user']})),
+      .axi_out_req_o          (xbar_slv_req[i]                            ),
+      .axi_out_resp_i         (xbar_slv_resp[i]                           ),
+      .axi_in_req_i           (axi_to_cluster_req                         ),
+      .axi_in_resp_o          (axi_to_cluster_resp                        ),
+  % if cfg['axi_isolate_enable']:
+      .axi_isolate_i          (1'b0                                       ),
+      .axi_isolated_o         (                                           ),
+  % endif
+      .cluster_probe_o        (cluster_probe[i]                           )
+    );
+  end
+
+/**************
+ *  VCD Dump  *
+ **************/
+
+`ifdef VCD_DUMP
+  initial begin: vcd_dump
+    // Wait for the reset
+    wait (rst_ni);
+
+    // Wait until the probe of cluster 0 is high
+    while (!cluster_probe[0])
+      @(posedge clk_i);
+
+    // Dump signals of group 0
+    $dumpfile(`VCD_DUMP_FILE);
+    $dumpvars(0, gen_clusters[0].i_cluster_wrapper);
+    $dumpon;
+
+    // Wait until the probe is low
+    while (cluster_probe[0])
+      @(posedge clk_i);
+
+    $dumpoff;
+
+    // Stop the execution
+    $finish(0);
+  end: vcd_dump
+`endif
+
+  /************************
+   *  Simulation control  *
+   ************************/
+
+  // The boot master writes through the crossbar, so requests use the wide
+  // data bus and put the entry point into its byte lanes.
+  `REQRSP_TYPEDEF_ALL(reqrsp_boot, axi_addr_t, axi_data_t, axi_strb_t)
+  reqrsp_boot_req_t to_cluster_req = '0;
+  reqrsp_boot_rsp_t to_cluster_rsp;
+
+  reqrsp_to_axi #(
+    .DataWidth   (SpatzAxiDataWidth      ),
+    .UserWidth   (SpatzAxiUserWidth      ),
+    .axi_req_t   (spatz_axi_out_req_t    ),
+    .axi_rsp_t   (spatz_axi_out_resp_t   ),
+    .reqrsp_req_t(reqrsp_boot_req_t      ),
+    .reqrsp_rsp_t(reqrsp_boot_rsp_t      )
+  ) i_axi_to_reqrsp (
+    .clk_i       (clk_i                  ),
+    .rst_ni      (rst_ni                 ),
+    .user_i      ('0                     ),
+    .axi_req_o   (xbar_slv_req[BootPort] ),
+    .axi_rsp_i   (xbar_slv_resp[BootPort]),
+    .reqrsp_req_i(to_cluster_req         ),
+    .reqrsp_rsp_o(to_cluster_rsp         )
+  );
+
+  // Boot sequence, stepped on the falling clock edge. The entry point is
+  // written into each cluster's peripherals in turn, then all cores are woken
+  // up at once. This is a state machine rather than a sequence of event
+  // controls so that the testharness also builds without `--timing`, as
+  // needed by `--savable` Verilator models.
+  typedef enum logic [2:0] {
+    BootLoad, BootDelay, BootReq, BootRsp, BootAck, BootWake, BootDone
+  } boot_state_e;
+
+  localparam int unsigned StrbOffset = $clog2(SpatzAxiStrbWidth);
+
+  boot_state_e boot_state   = BootLoad;
+  int unsigned boot_cnt     = 0;
+  int unsigned boot_cluster = 0;
+  logic [31:0] entry_point;
+  axi_addr_t   boot_addr;
+
+  assign boot_addr = axi_addr_t'(PeriStartAddr + boot_cluster * ClusterOffset +
+                                 SPATZ_CLUSTER_PERIPHERAL_CLUSTER_BOOT_CONTROL_OFFSET);
+
+  always @(negedge clk_i) begin
+    boot_cnt <= boot_cnt + 1;
+    // Start over on every reset, e.g., between the binaries of a batch run.
+    if (!rst_ni) begin
+      boot_cnt       <= 0;
+      boot_cluster   <= 0;
+      boot_state     <= BootLoad;
+      to_cluster_req <= '0;
+      debug_req      <= '0;
+    end else case (boot_state)
+      // Wait for a while, then load the entry point
+      BootLoad: if (boot_cnt == 9) begin
+        entry_point = get_entry_point();
+        $display("Loading entry point: %0x", entry_point);
+        boot_cnt   <= 0;
+        boot_state <= BootDelay;
+      end
+      // Wait for a while, then store the entry point in the next cluster
+      BootDelay: if (boot_cnt >= 999) begin
+        to_cluster_req <= '{
+          q: '{
+            addr   : boot_addr,
+            data   : axi_data_t'(entry_point) << (8 * boot_addr[StrbOffset-1:0]),
+            write  : 1'b1,
+            strb   : axi_strb_t'(4'hf) << boot_addr[StrbOffset-1:0],
+            size   : 3'd2,
+            amo    : reqrsp_pkg::AMONone,
+            default: '0
+          },
+          q_valid: 1'b1,
+          p_ready: 1'b0
+        };
+        boot_state <= BootReq;
+      end
+      BootReq: if (to_cluster_rsp.q_ready) begin
+        to_cluster_req <= '0;
+        boot_state     <= BootRsp;
+      end
+      BootRsp: if (to_cluster_rsp.p_valid) begin
+        to_cluster_req <= '{
+          p_ready: 1'b1,
+          q      : '{
+            amo    : reqrsp_pkg::AMONone,
+            default: '0
+          },
+          default: '0
+        };
+        boot_state <= BootAck;
+      end
+      // Boot the next cluster or wake up all cores
+      BootAck: begin
+        to_cluster_req <= '0;
+        if (boot_cluster + 1 < NrClusters) begin
+          boot_cluster <= boot_cluster + 1;
+          boot_state   <= BootDelay;
+        end else begin
+          debug_req  <= '1;
+          boot_state <= BootWake;
+        end
+      end
+      BootWake: begin
+        debug_req  <= '0;
+        boot_state <= BootDone;
+      end
+      default:;
+    endcase
+  end
+
+  // Report changes of the cluster status registers (`start_kernel` and
+  // `stop_kernel`) to the testbench. The probe is high while any cluster is
+  // in a kernel.
+  logic cluster_probe_q = 1'b0;
+
+  always_ff @(posedge clk_i) begin
+    if (!rst_ni) begin
+      cluster_probe_q <= 1'b0;
+    end else begin
+      if (|cluster_probe != cluster_probe_q) tb_cluster_probe(int'(|cluster_probe));
+      cluster_probe_q <= |cluster_probe;
+    end
+  end
+
+  /********
+   *  L2  *
+   ********/
+
+  // Wide port of the crossbar into simulation memory.
+  tb_memory_axi #(
+    .AxiAddrWidth ( SpatzAxiAddrWidth ),
+    .AxiDataWidth ( SpatzAxiDataWidth ),
+    .AxiIdWidth   ( XbarMstIdWidth    ),
+    .AxiUserWidth ( SpatzAxiUserWidth ),
+    .req_t        ( xbar_mst_req_t    ),
+    .rsp_t        ( xbar_mst_resp_t   )
+  ) i_dma (
+    .clk_i (clk_i                ),
+    .rst_ni(rst_ni               ),
+    .req_i (xbar_mst_req[MemPort] ),
+    .rsp_o (xbar_mst_resp[MemPort])
+  );
+
+endmodule : testharness
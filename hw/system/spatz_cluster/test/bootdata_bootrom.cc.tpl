@@ -4,7 +4,9 @@
 
 #include <stdint.h>
 
-// The boot data generated along with the system RTL.
+// The boot data generated along with the system RTL, one record per cluster.
+// The bootrom hands each cluster its own record, whose `tcdm_start` points to
+// that cluster's TCDM. `hartid_base` is the first hart of the system.
 struct BootData {
     uint64_t boot_addr;
     uint64_t core_count;
@@ -14,13 +16,19 @@ struct BootData {
     uint64_t tcdm_offset;
     uint64_t global_mem_start;
     uint64_t global_mem_end;
+    uint64_t cluster_count;
 };
 
-extern "C" const BootData BOOTDATA = {.boot_addr = ${hex(cfg['cluster']['boot_addr'])},
-                           .core_count = ${cfg['cluster']['nr_cores']},
-                           .hartid_base = ${cfg['cluster']['cluster_base_hartid']},
-                           .tcdm_start = ${hex(cfg['cluster']['cluster_base_addr'])},
-                           .tcdm_size = ${hex(cfg['cluster']['tcdm']['size'] * 1024)},
-                           .tcdm_offset = ${hex(cfg['cluster']['cluster_base_offset'])},
-                           .global_mem_start = ${hex(cfg['dram']['address'])},
-                           .global_mem_end = ${hex(cfg['dram']['address'] + cfg['dram']['length'])}};
\ No newline at end of file
+extern "C" const BootData BOOTDATA[] = {
+% for i in range(cfg['nr_clusters']):
+    {.boot_addr = ${hex(cfg['cluster']['boot_addr'])},
+     .core_count = ${cfg['cluster']['nr_cores']},
+     .hartid_base = ${cfg['cluster']['cluster_base_hartid']},
+     .tcdm_start = ${hex(cfg['cluster']['cluster_base_addr'] + i * cfg['cluster']['cluster_base_offset'])},
+     .tcdm_size = ${hex(cfg['cluster']['tcdm']['size'] * 1024)},
+     .tcdm_offset = ${hex(cfg['cluster']['cluster_base_offset'])},
+     .global_mem_start = ${hex(cfg['dram']['address'])},
+     .global_mem_end = ${hex(cfg['dram']['address'] + cfg['dram']['length'])},
+     .cluster_count = ${cfg['nr_clusters']}},
+% endfor
+};
@@ -19,11 +19,26 @@
 #include <string.h>
 #include <unistd.h>
 
-void *uartdpi_create(const char *name, const char *log_file_path) {
+// Models not closed yet. Verilator does not run the `final` block that closes
+// them, so they are closed on exit instead.
+static struct uartdpi_ctx *open_ctxs;
+
+static void uartdpi_close_all(void) {
+    while (open_ctxs) {
+        uartdpi_close(open_ctxs);
+    }
+}
+
+void *uartdpi_create(const char *name, const char *log_file_path,
+                     int poll_interval) {
     struct uartdpi_ctx *ctx =
-        (struct uartdpi_ctx *)malloc(sizeof(struct uartdpi_ctx));
+        (struct uartdpi_ctx *)calloc(1, sizeof(struct uartdpi_ctx));
     assert(ctx);
 
+    snprintf(ctx->name, sizeof(ctx->name), "%s", name);
+    ctx->poll_interval = poll_interval > 0 ? poll_interval : 0;
+    ctx->poll_countdown = 1;
+
     int rv;
 
     // Initialize UART pseudo-terminal
@@ -47,6 +62,10 @@ void *uartdpi_create(const char *name, const char *log_file_path) {
         "e.g.\n"
         "$ screen %s\n",
         ctx->ptyname, name, ctx->ptyname);
+    if (ctx->poll_interval) {
+        printf("UART: Polling %s every %d cycles.\n", ctx->ptyname,
+               ctx->poll_interval);
+    }
 
     // Open log file (if requested)
     ctx->log_file = NULL;
@@ -77,15 +96,57 @@ void *uartdpi_create(const char *name, const char *log_file_path) {
         }
     }
 
+    if (!open_ctxs) {
+        atexit(uartdpi_close_all);
+    }
+    ctx->next = open_ctxs;
+    open_ctxs = ctx;
+
     return (void *)ctx;
 }
 
+// Write the pending output to the pseudo-terminal. Without a terminal
+// attached, the pseudo-terminal fills up and the rest stays pending.
+static void uartdpi_flush(struct uartdpi_ctx *ctx) {
+    int done = 0;
+    while (done < ctx->tx_len) {
+        int rv = write(ctx->host, ctx->tx_buf + done, ctx->tx_len - done);
+        ctx->write_calls++;
+        if (rv < 0) {
+            assert((errno == EAGAIN || errno == EWOULDBLOCK || errno == EIO) &&
+                   "Write to pseudo-terminal failed.");
+            break;
+        }
+        done += rv;
+    }
+    ctx->bytes_written += done;
+    ctx->tx_len -= done;
+    memmove(ctx->tx_buf, ctx->tx_buf + done, ctx->tx_len);
+}
+
 void uartdpi_close(void *ctx_void) {
     struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
     if (!ctx) {
         return;
     }
 
+    for (struct uartdpi_ctx **p = &open_ctxs; *p; p = &(*p)->next) {
+        if (*p == ctx) {
+            *p = ctx->next;
+            break;
+        }
+    }
+
+    uartdpi_flush(ctx);
+    ctx->bytes_dropped += ctx->tx_len;
+    printf(
+        "UART: %s: %lu read() and %lu write() calls for %lu polls, %lu bytes "
+        "in, %lu bytes out, %lu bytes dropped.\n",
+        ctx->name, (unsigned long)ctx->read_calls,
+        (unsigned long)ctx->write_calls, (unsigned long)ctx->polls,
+        (unsigned long)ctx->bytes_read, (unsigned long)ctx->bytes_written,
+        (unsigned long)ctx->bytes_dropped);
+
     close(ctx->host);
     close(ctx->device);
 
@@ -101,26 +162,64 @@ void uartdpi_close(void *ctx_void) {
     free(ctx);
 }
 
+// Input is read in bulk, at most once every `poll_interval` polls. Output
+// that did not grow over the last `UARTDPI_IDLE_POLLS` reads is flushed as
+// well, so that prompts without a newline show up.
 int uartdpi_can_read(void *ctx_void) {
     struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
 
-    int rv = read(ctx->host, &ctx->tmp_read, 1);
-    return (rv == 1);
+    ctx->polls++;
+    if (ctx->rx_pos < ctx->rx_len) {
+        return 1;
+    }
+    if (ctx->poll_interval) {
+        if (--ctx->poll_countdown > 0) {
+            return 0;
+        }
+        ctx->poll_countdown = ctx->poll_interval;
+        if (ctx->tx_len && ++ctx->tx_idle_polls >= UARTDPI_IDLE_POLLS) {
+            uartdpi_flush(ctx);
+        }
+    }
+
+    int rv = read(ctx->host, ctx->rx_buf,
+                  ctx->poll_interval ? UARTDPI_BUF_SIZE : 1);
+    ctx->read_calls++;
+    if (rv <= 0) {
+        return 0;
+    }
+    ctx->rx_pos = 0;
+    ctx->rx_len = rv;
+    ctx->bytes_read += rv;
+    return 1;
 }
 
 char uartdpi_read(void *ctx_void) {
     struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
 
-    return ctx->tmp_read;
+    assert(ctx->rx_pos < ctx->rx_len && "No character to read.");
+    return ctx->rx_buf[ctx->rx_pos++];
 }
 
+// Output is written on every newline, when the buffer is full, and once the
+// target stops writing.
 void uartdpi_write(void *ctx_void, char c) {
     int rv;
 
     struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
 
-    rv = write(ctx->host, &c, 1);
-    assert(rv == 1 && "Write to pseudo-terminal failed.");
+    if (ctx->tx_len == UARTDPI_BUF_SIZE) {
+        uartdpi_flush(ctx);
+    }
+    if (ctx->tx_len == UARTDPI_BUF_SIZE) {
+        ctx->bytes_dropped++;
+    } else {
+        ctx->tx_buf[ctx->tx_len++] = c;
+    }
+    ctx->tx_idle_polls = 0;
+    if (!ctx->poll_interval || c == '\n') {
+        uartdpi_flush(ctx);
+    }
 
     if (ctx->log_file) {
         rv = fwrite(&c, sizeof(char), 1, ctx->log_file);
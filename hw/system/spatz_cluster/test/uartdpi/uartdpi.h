@@ -5,17 +5,49 @@
 #ifndef OPENTITAN_HW_DV_DPI_UARTDPI_UARTDPI_H_
 #define OPENTITAN_HW_DV_DPI_UARTDPI_UARTDPI_H_
 
+#include <stdint.h>
 #include <stdio.h>
 
+#define UARTDPI_BUF_SIZE 256
+// Reads of the pseudo-terminal without new output before flushing it.
+#define UARTDPI_IDLE_POLLS 32
+
 struct uartdpi_ctx {
     char ptyname[64];
+    char name[64];
     int host;
     int device;
-    char tmp_read;
     FILE *log_file;
+
+    // Polls between two reads of the pseudo-terminal, 0 for one read per poll
+    // and one write per character.
+    int poll_interval;
+    int poll_countdown;
+
+    // Characters read from the pseudo-terminal, not yet sent to the target.
+    char rx_buf[UARTDPI_BUF_SIZE];
+    int rx_pos;
+    int rx_len;
+
+    // Characters sent by the target, not yet written to the pseudo-terminal.
+    char tx_buf[UARTDPI_BUF_SIZE];
+    int tx_len;
+    int tx_idle_polls;
+
+    // Statistics, reported on close.
+    uint64_t polls;
+    uint64_t read_calls;
+    uint64_t write_calls;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t bytes_dropped;
+
+    // Next model still open at exit.
+    struct uartdpi_ctx *next;
 };
 
-void *uartdpi_create(const char *name, const char *log_file_path);
+void *uartdpi_create(const char *name, const char *log_file_path,
+                     int poll_interval);
 void uartdpi_close(void *ctx_void);
 int uartdpi_can_read(void *ctx_void);
 char uartdpi_read(void *ctx_void);
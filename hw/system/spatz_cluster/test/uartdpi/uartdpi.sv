@@ -20,7 +20,8 @@ module uartdpi #(
   localparam int CyclesPerSymbol = FREQ / BAUD;
 
   import "DPI-C" function
-    chandle uartdpi_create(input string name, input string log_file_path);
+    chandle uartdpi_create(input string name, input string log_file_path,
+                           input int poll_interval);
 
   import "DPI-C" function
     void uartdpi_close(input chandle ctx);
@@ -36,10 +37,15 @@ module uartdpi #(
 
   chandle ctx;
   string log_file_path = DefaultLogFile;
+  // Cycles between two reads of the pseudo-terminal. Input cannot be sent
+  // faster than one symbol anyway. Set the `UARTDPI_POLL_<name>` plusarg to 0
+  // for a read on every cycle and a write on every character.
+  int poll_interval = CyclesPerSymbol;
 
   initial begin
     $value$plusargs({"UARTDPI_LOG_", NAME, "=%s"}, log_file_path);
-    ctx = uartdpi_create(NAME, log_file_path);
+    $value$plusargs({"UARTDPI_POLL_", NAME, "=%d"}, poll_interval);
+    ctx = uartdpi_create(NAME, log_file_path, poll_interval);
   end
 
   final begin
@@ -6,6 +6,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+/**
+ * @brief Handle of a queued transfer, to wait for it with dm_wait_id
+ */
+typedef struct {
+    uint32_t core;  // cluster-local index of the core that queued it
+    uint32_t seq;   // position in the queue of that core
+} dm_handle_t;
+
 /**
  * @brief Init the data mover and load a pointer to the DM struct in to TLS.
  * Needs to be called by the DM itself and all harts that want to use the dm
@@ -29,19 +37,19 @@ void dm_exit(void);
 /**
  * @brief Queue an asynchronus memory copy. The transfer is not started unless
  * dm_start or dm_wait is issued
- * @details block only if DM queue is full
+ * @details block only if the DM queue of the calling core is full
  *
  * @param dest destination pointer
  * @param src source pointer
  * @param n number of bytes to copy
- * @return transfer ID
+ * @return handle of the transfer
  */
-void dm_memcpy_async(void *dest, const void *src, size_t n);
+dm_handle_t dm_memcpy_async(void *dest, const void *src, size_t n);
 
 /**
  * @brief Queue an asynchronus memory copy. The transfer is not started unless
  * dm_start or dm_wait is issued
- * @details block only if DM queue is full
+ * @details block only if the DM queue of the calling core is full
  *
  * @param src source address
  * @param dst destination address
@@ -50,10 +58,11 @@ void dm_memcpy_async(void *dest, const void *src, size_t n);
  * @param dstrd outer destination stride
  * @param nreps number of repetitions in outer dimension
  * @param cfg DMA configuration
+ * @return handle of the transfer
  */
-void dm_memcpy2d_async(uint64_t src, uint64_t dst, uint32_t size,
-                       uint32_t sstrd, uint32_t dstrd, uint32_t nreps,
-                       uint32_t cfg);
+dm_handle_t dm_memcpy2d_async(uint64_t src, uint64_t dst, uint32_t size,
+                              uint32_t sstrd, uint32_t dstrd, uint32_t nreps,
+                              uint32_t cfg);
 
 /**
  * @brief Trigger the start of queued transfers and exit immediately
@@ -67,6 +76,15 @@ void dm_start(void);
  */
 void dm_wait(void);
 
+/**
+ * @brief Wait for one DMA transfer to complete, starts queued transfers
+ * @details Returns once the transfer and all transfers the DMA issued before
+ * it are complete
+ *
+ * @param handle handle returned when queueing the transfer
+ */
+void dm_wait_id(dm_handle_t handle);
+
 /**
  * @brief Wait for the DM core to be ready
  * @details
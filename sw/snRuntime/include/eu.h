@@ -28,7 +28,8 @@ void eu_event_loop(uint32_t cluster_core_idx);
 
 /**
  * @brief Set function to execute by `nthreads` number of threads
- * @details
+ * @details Queues the event in the dispatch ring and returns without waiting
+ * for the workers, unless the ring is full.
  *
  * @param fn pointer to worker function to be executed
  * @param data pointer to function arguments
@@ -39,11 +40,24 @@ int eu_dispatch_push(void (*fn)(void *, uint32_t), uint32_t argc, void *data,
                      uint32_t nthreads);
 
 /**
- * @brief wait for all workers to idle
+ * @brief Run the share of the calling core of all queued events and wait for
+ * the workers to finish them
  * @param core_idx cluster-local core index
  */
 void eu_run_empty(uint32_t core_idx);
 
+/**
+ * @brief Run the share of the calling core of all queued events, the workers
+ * may still be running them on return
+ * @param core_idx cluster-local core index
+ */
+void eu_run_queued(uint32_t core_idx);
+
+/**
+ * @brief Wait for the workers to finish all events the master ran its share of
+ */
+void eu_join(void);
+
 /**
  * @brief Debugging info to printf
  * @details
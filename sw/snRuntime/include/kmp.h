@@ -29,3 +29,13 @@ extern _kmp_ptr32 *kmpc_args;
 #else
 #define KMP_PRINTF(d, ...)
 #endif
+
+////////////////////////////////////////////////////////////////////////////////
+// exported
+////////////////////////////////////////////////////////////////////////////////
+
+void __kmpc_dispatch_init_4(ident_t *loc, kmp_int32 gtid,
+                            enum sched_type schedule, kmp_int32 lb,
+                            kmp_int32 ub, kmp_int32 st, kmp_int32 chunk);
+int __kmpc_dispatch_next_4(ident_t *loc, kmp_int32 gtid, kmp_int32 *p_last,
+                           kmp_int32 *p_lb, kmp_int32 *p_ub, kmp_int32 *p_st);
@@ -56,16 +56,69 @@
 // types
 //================================================================================
 
+#ifndef OMPSTATIC_NUMTHREADS
+/**
+ * @brief Threads the per-thread loop state is sized for. Teams are capped to
+ * it, compute cores beyond it stay idle in parallel regions.
+ */
+#ifndef OMP_MAX_THREADS
+#define OMP_MAX_THREADS 16
+#endif
+/**
+ * @brief Number of dynamically scheduled loops in flight. Threads leaving a
+ * `nowait` loop early can set up the next one while the others finish.
+ */
+#define OMP_LOOP_SLOTS 2
+
+typedef enum {
+    OMP_LOOP_STATIC,
+    OMP_LOOP_STATIC_CHUNKED,
+    OMP_LOOP_DYNAMIC,
+    OMP_LOOP_GUIDED,
+    OMP_LOOP_STEAL,
+} omp_loop_sched_t;
+
+/**
+ * @brief A dynamically scheduled loop, shared by the team. Iterations are
+ * numbered from 0 to `trip` and claimed with a single `amoadd` on `next` (or
+ * on the `block_next` of a thread for nonmonotonic loops).
+ */
+typedef struct {
+    int epoch;       // loop held by this slot, published after setup
+    int done_epoch;  // last loop of this slot that all threads left
+    int claim;       // elects the thread setting up the slot
+    int start;
+    int incr;
+    uint32_t trip;
+    uint32_t chunk;
+    uint32_t sched;
+    uint32_t nthreads;
+    uint32_t next;  // next iteration, or next chunk for guided loops
+    uint32_t left;  // threads that ran out of work
+    uint32_t block_next[OMP_MAX_THREADS];
+    uint32_t block_end[OMP_MAX_THREADS];
+} omp_loop_t;
+
+/**
+ * @brief Per-thread view of the dynamically scheduled loops
+ */
+typedef struct {
+    int epoch;        // loops entered in this parallel region
+    uint32_t k;       // chunks taken from a static loop
+    uint32_t victim;  // block to take the next chunk from
+    // First chunk, first iteration and chunk size of the current guided round
+    uint32_t round_chunk;
+    uint32_t round_begin;
+    uint32_t round_size;
+} omp_loop_cursor_t;
+#endif
+
 typedef struct {
     char nbThreads;
 #ifndef OMPSTATIC_NUMTHREADS
-    int loop_epoch;
-    int loop_start;
-    int loop_end;
-    int loop_incr;
-    int loop_chunk;
-    int loop_is_setup;
-    int core_epoch[16];  // for dynamic scheduling
+    int loops_used;  // whether the loop slots need a reset before a fork
+    omp_loop_t loops[OMP_LOOP_SLOTS];
+    omp_loop_cursor_t loop_cursor[OMP_MAX_THREADS];
 #endif
 } omp_team_t;
 
@@ -96,7 +149,17 @@ typedef struct {
 
 #ifdef OPENMP_PROFILE
 typedef struct {
+    // Latency of the last parallel region: from the fork to the start of
+    // thread 1 and from the end of thread 1 to the master leaving the join
     uint32_t fork_oh;
+    uint32_t join_oh;
+    // Sums over all parallel regions with more than one thread
+    uint32_t regions;
+    uint32_t fork_total;
+    uint32_t join_total;
+    // Timestamps of the current region
+    uint32_t fork_start;
+    uint32_t thread_end;
 } omp_prof_t;
 extern omp_prof_t *omp_prof;
 #endif
@@ -116,6 +179,21 @@ unsigned snrt_omp_bootstrap(uint32_t core_idx);
 void partialParallelRegion(int32_t argc, void *data,
                            void (*fn)(void *, uint32_t), int num_threads);
 
+/**
+ * @brief Fork a parallel region without waiting for the workers to finish it.
+ * @details The master runs its share and returns, so it can fork the next
+ * region while the workers are still busy with this one. Up to EU_RING_SLOTS
+ * regions are in flight. `data` must stay valid until parallelRegionJoin.
+ * Forking with a different number of threads joins first.
+ */
+void parallelRegionNowait(int32_t argc, void *data,
+                          void (*fn)(void *, uint32_t), int num_threads);
+
+/**
+ * @brief Wait for all regions forked with parallelRegionNowait
+ */
+void parallelRegionJoin(void);
+
 #ifdef OPENMP_PROFILE
 void omp_print_prof(void);
 extern omp_prof_t *omp_prof;
@@ -31,12 +31,6 @@ extern "C" {
 #define snrt_max(a, b) ((a) > (b) ? (a) : (b))
 #endif
 
-inline static void *snrt_memset(void *ptr, int value, size_t num) {
-    for (uint32_t i = 0; i < num; ++i)
-        *((uint8_t *)ptr + i) = (unsigned char)value;
-    return ptr;
-}
-
 /// A slice of memory.
 typedef struct snrt_slice {
     uint64_t start;
@@ -103,7 +97,13 @@ extern void snrt_set_eoc_and_return_code(int eoc_and_return_code);
 extern void snrt_bcast_send(void *data, size_t len);
 extern void snrt_bcast_recv(void *data, size_t len);
 
+/// Copy, move and fill memory. Small sizes are handled a word at a time,
+/// larger ones with the vector unit, and large copies between the TCDM and
+/// the main memory with the cluster DMA when called on the DM core. The vector
+/// state is not preserved.
 extern void *snrt_memcpy(void *dst, const void *src, size_t n);
+extern void *snrt_memmove(void *dst, const void *src, size_t n);
+extern void *snrt_memset(void *ptr, int value, size_t num);
 
 /// DMA runtime functions.
 /// A DMA transfer identifier.
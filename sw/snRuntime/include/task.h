@@ -0,0 +1,108 @@
+// Copyright 2021 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <stdint.h>
+
+#include "snrt.h"
+
+/**
+ * @brief Number of tasks each core can have queued. A spawn on a full queue
+ * runs the task in place.
+ */
+#ifndef SNRT_TASK_DEQUE_DEPTH
+#define SNRT_TASK_DEQUE_DEPTH 32
+#endif
+
+/**
+ * @brief Rounds over all queues without finding work before an idle worker
+ * goes to sleep
+ */
+#ifndef SNRT_TASK_IDLE_ROUNDS
+#define SNRT_TASK_IDLE_ROUNDS 8
+#endif
+
+typedef struct {
+    uint32_t executed;  // tasks run by the core
+    uint32_t stolen;    // of which taken from another core's queue
+    uint32_t inlined;   // spawns run in place because the queue was full
+    uint32_t sleeps;    // times the core went to sleep for lack of work
+} snrt_task_stats_t;
+
+/**
+ * @brief Initialize the task runtime. Called by all cores of the cluster,
+ * core 0 allocates the task queues in TCDM.
+ */
+void snrt_task_init(void);
+
+/**
+ * @brief Run tasks from the own queue and steal from the other cores until
+ * snrt_task_exit is called. Idle workers sleep on the cluster interrupt.
+ */
+void snrt_task_worker(void);
+
+/**
+ * @brief Send all workers in snrt_task_worker to exit
+ */
+void snrt_task_exit(void);
+
+/**
+ * @brief Queue `fn(arg)` on the calling core. Any core may run it.
+ * @details The task is a child of the task running on the calling core, or of
+ * the calling core itself outside of a task.
+ *
+ * @param fn task function
+ * @param arg argument passed to the task function
+ */
+void snrt_task_spawn(void (*fn)(void *), void *arg);
+
+/**
+ * @brief Wait for all children of the current task, running queued tasks in
+ * the meantime. A task implicitly waits for its children before it returns.
+ * @details Inside a task only its own children are run while waiting, so a
+ * core nests at most as many tasks as the task tree is deep.
+ */
+void snrt_task_wait(void);
+
+/**
+ * @brief Enter the task runtime, returns 1 on the workers once they exited
+ *
+ * @param core_idx cluster-local core index
+ */
+unsigned snrt_task_bootstrap(uint32_t core_idx);
+
+/**
+ * @brief Get the task statistics of a core
+ *
+ * @param core_idx cluster-local core index
+ * @param stats filled with the counters of the core
+ */
+void snrt_task_get_stats(uint32_t core_idx, snrt_task_stats_t *stats);
+
+/**
+ * @brief Reset the task statistics of all cores
+ */
+void snrt_task_reset_stats(void);
+
+/**
+ * @brief Bootstrap macro for task parallel applications, core 0 continues
+ * while the other cores enter the worker loop
+ */
+#define __snrt_task_bootstrap(core_idx)      \
+    do {                                     \
+        if (snrt_task_bootstrap(core_idx)) { \
+            snrt_cluster_hw_barrier();       \
+            return 0;                        \
+        }                                    \
+    } while (0)
+
+/**
+ * @brief Destroy a task session so all cores exit cleanly
+ */
+#define __snrt_task_destroy(core_idx) \
+    do {                              \
+        snrt_task_exit();             \
+        snrt_cluster_hw_barrier();    \
+    } while (0)
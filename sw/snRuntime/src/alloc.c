@@ -87,10 +87,15 @@ void snrt_alloc_init(struct snrt_team_root *team, uint32_t l3off) {
     // past the end — the "+ 1" below accounts for that.
     extern uint32_t _edram;
     extern uint32_t __l3_end;
-    team->allocator.l3.base =
-        ALIGN_UP((uint32_t)&_edram + l3off, MIN_CHUNK_SIZE);
-    team->allocator.l3.size =
-        (uint32_t)&__l3_end - team->allocator.l3.base + 1;
+    uint32_t l3_base = ALIGN_UP((uint32_t)&_edram + l3off, MIN_CHUNK_SIZE);
+    uint32_t l3_size = (uint32_t)&__l3_end - l3_base + 1;
+    // Each cluster allocates from its own slice of the heap.
+    if (team->cluster_num > 1) {
+        l3_size = ALIGN_DOWN(l3_size / team->cluster_num, MIN_CHUNK_SIZE);
+        l3_base += team->cluster_idx * l3_size;
+    }
+    team->allocator.l3.base = l3_base;
+    team->allocator.l3.size = l3_size;
     team->allocator.l3.next = team->allocator.l3.base;
 }
 
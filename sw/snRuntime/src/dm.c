@@ -21,11 +21,17 @@
 // #define DM_USE_GLOBAL_CLINT
 
 /**
- * @brief Number of outstanding transactions to buffer. Each requires
- * sizeof(dm_task_t) bytes
+ * @brief Number of outstanding transactions to buffer per core. Each requires
+ * sizeof(dm_task_t) + 4 bytes. Must be a power of two.
  *
  */
-#define DM_TASK_QUEUE_SIZE 4
+#ifndef DM_TASK_QUEUE_SIZE
+#define DM_TASK_QUEUE_SIZE 16
+#endif
+
+#if DM_TASK_QUEUE_SIZE & (DM_TASK_QUEUE_SIZE - 1)
+#error "DM_TASK_QUEUE_SIZE must be a power of two"
+#endif
 
 //================================================================================
 // Macros
@@ -57,8 +63,8 @@ static inline uint32_t dm_sdma_stat(const uint32_t which) {
     return status;
 }
 
-static inline void dm_sdma_start_oned(uint64_t src, uint64_t dst,
-                                      uint32_t size, uint32_t cfg) {
+static inline uint32_t dm_sdma_start_oned(uint64_t src, uint64_t dst,
+                                          uint32_t size, uint32_t cfg) {
     uint32_t src_lo = (uint32_t)src, src_hi = (uint32_t)(src >> 32);
     uint32_t dst_lo = (uint32_t)dst, dst_hi = (uint32_t)(dst >> 32);
     uint32_t txid;
@@ -70,12 +76,13 @@ static inline void dm_sdma_start_oned(uint64_t src, uint64_t dst,
         : [ src_lo ] "r"(src_lo), [ src_hi ] "r"(src_hi),
           [ dst_lo ] "r"(dst_lo), [ dst_hi ] "r"(dst_hi), [ size ] "r"(size),
           [ cfg ] "r"(cfg));
+    return txid;
 }
 
-static inline void dm_sdma_start_twod(uint64_t src, uint64_t dst,
-                                      uint32_t size, uint32_t sstrd,
-                                      uint32_t dstrd, uint32_t nreps,
-                                      uint32_t cfg) {
+static inline uint32_t dm_sdma_start_twod(uint64_t src, uint64_t dst,
+                                          uint32_t size, uint32_t sstrd,
+                                          uint32_t dstrd, uint32_t nreps,
+                                          uint32_t cfg) {
     uint32_t src_lo = (uint32_t)src, src_hi = (uint32_t)(src >> 32);
     uint32_t dst_lo = (uint32_t)dst, dst_hi = (uint32_t)(dst >> 32);
     uint32_t txid;
@@ -90,6 +97,7 @@ static inline void dm_sdma_start_twod(uint64_t src, uint64_t dst,
           [ dst_lo ] "r"(dst_lo), [ dst_hi ] "r"(dst_hi),
           [ sstrd ] "r"(sstrd), [ dstrd ] "r"(dstrd), [ nreps ] "r"(nreps),
           [ size ] "r"(size), [ cfg ] "r"(cfg));
+    return txid;
 }
 
 //================================================================================
@@ -118,16 +126,27 @@ typedef enum en_stat {
     STAT_READY = 3,
 } en_stat_t;
 
+// single producer, single consumer queue of one core: the core fills it at
+// the front, the DM core issues the transfers at the back
 typedef struct {
+    volatile uint32_t front;
+    volatile uint32_t back;
+    // DMA transaction id of the last transfer issued from each slot
+    volatile uint32_t txid[DM_TASK_QUEUE_SIZE];
     dm_task_t queue[DM_TASK_QUEUE_SIZE];
-    uint32_t queue_back;
-    uint32_t queue_front;
-    volatile uint32_t queue_fill;
+} dm_queue_t;
+
+typedef struct {
     volatile uint32_t mutex;
     volatile en_stat_t stat_q;
     volatile uint32_t stat_p;
     volatile uint32_t stat_pvalid;
     volatile uint32_t dm_wfi;
+    // cores in dm_wait_id, the DM core keeps complete_id up to date for them
+    volatile uint32_t waiters;
+    volatile uint32_t complete_id;
+    uint32_t queue_num;
+    dm_queue_t queues[];
 } dm_t;
 
 //================================================================================
@@ -145,6 +164,13 @@ __thread volatile dm_t *dm_p;
  */
 static volatile dm_t *volatile dm_p_global;
 
+/**
+ * @brief Queue of this core and its index
+ *
+ */
+__thread volatile dm_queue_t *dm_q;
+__thread uint32_t dm_q_idx;
+
 /**
  * @brief DM core id for wakeup is stored on TLS for performance
  *
@@ -156,6 +182,10 @@ __thread uint32_t cluster_dm_core_idx;
 //================================================================================
 static void wfi_dm(uint32_t cluster_core_idx);
 static void wake_dm(void);
+static uint32_t dm_service(void);
+static uint32_t dm_pending(void);
+static volatile dm_task_t *dm_queue_slot(uint32_t *seq);
+static dm_handle_t dm_queue_commit(uint32_t seq);
 
 //================================================================================
 // Debug
@@ -181,6 +211,7 @@ static void wake_dm(void);
 //================================================================================
 void dm_init(void) {
     cluster_dm_core_idx = snrt_cluster_dm_core_idx();
+    dm_q_idx = snrt_cluster_core_idx();
     // create a data mover instance
     if (snrt_is_dm_core()) {
 #ifdef DM_USE_GLOBAL_CLINT
@@ -188,45 +219,30 @@ void dm_init(void) {
 #else
         snrt_interrupt_enable(IRQ_M_CLUSTER);
 #endif
-        dm_p = (dm_t *)snrt_l1alloc(sizeof(dm_t));
-        snrt_memset((void *)dm_p, 0, sizeof(dm_t));
+        // one queue per core of the cluster
+        uint32_t queue_num = snrt_cluster_core_num();
+        size_t size = sizeof(dm_t) + queue_num * sizeof(dm_queue_t);
+        dm_p = (dm_t *)snrt_l1alloc(size);
+        snrt_memset((void *)dm_p, 0, size);
+        dm_p->queue_num = queue_num;
         dm_p_global = dm_p;
     } else {
         while (!dm_p_global)
             ;
         dm_p = dm_p_global;
     }
+    dm_q = &dm_p->queues[dm_q_idx];
 }
 
 void dm_main(void) {
-    volatile dm_task_t *t;
     uint32_t do_exit = 0;
     uint32_t cluster_core_idx = snrt_cluster_core_idx();
 
     DM_PRINTF(10, "enter main\n");
 
     while (!do_exit) {
-        /// New transaction to issue?
-        if (dm_p->queue_fill) {
-            // wait until DMA is ready
-            while (dm_sdma_stat(DM_STATUS_WOULD_BLOCK))
-                ;
-
-            t = &dm_p->queue[dm_p->queue_back];
-
-            if (t->twod) {
-                DM_PRINTF(10, "start twod\n");
-                dm_sdma_start_twod(t->src, t->dst, t->size, t->sstrd,
-                                          t->dstrd, t->nreps, t->cfg);
-            } else {
-                DM_PRINTF(10, "start oned\n");
-                dm_sdma_start_oned(t->src, t->dst, t->size, t->cfg);
-            }
-
-            // bump
-            dm_p->queue_back = (dm_p->queue_back + 1) % DM_TASK_QUEUE_SIZE;
-            __atomic_add_fetch(&dm_p->queue_fill, -1, __ATOMIC_RELAXED);
-        }
+        /// New transactions to issue?
+        dm_service();
 
         /// any STAT request pending?
         if (dm_p->stat_q) {
@@ -251,8 +267,8 @@ void dm_main(void) {
             }
         }
 
-        // sleep if queue is empty and no stats pending
-        if (!dm_p->queue_fill && !dm_p->stat_q) {
+        // sleep if the queues are empty and no stats or waiters are pending
+        if (!dm_pending() && !dm_p->stat_q && !dm_p->waiters) {
             wfi_dm(cluster_core_idx);
         }
     }
@@ -265,21 +281,15 @@ void dm_main(void) {
     return;
 }
 
-void dm_memcpy_async(void *dest, const void *src, size_t n) {
-    uint32_t s;
+dm_handle_t dm_memcpy_async(void *dest, const void *src, size_t n) {
+    uint32_t seq;
     volatile dm_task_t *t;
 
     DM_PRINTF(10, "dm_memcpy_async %#x -> %#x size %d\n", src, dest,
               (uint32_t)n);
 
-    // poll queue size
-    do {
-        s = __atomic_load_n(&dm_p->queue_fill, __ATOMIC_RELAXED);
-    } while (s >= DM_TASK_QUEUE_SIZE);
-    _dm_mtx_lock();
-
     // insert
-    t = &dm_p->queue[dm_p->queue_front];
+    t = dm_queue_slot(&seq);
     t->src = (uint64_t)src;
     t->dst = (uint64_t)dest;
     t->size = (uint32_t)n;
@@ -287,29 +297,20 @@ void dm_memcpy_async(void *dest, const void *src, size_t n) {
     t->cfg = 0;
 
     // bump
-    __atomic_add_fetch(&dm_p->queue_fill, 1, __ATOMIC_RELAXED);
-    dm_p->queue_front = (dm_p->queue_front + 1) % DM_TASK_QUEUE_SIZE;
-
-    _dm_mtx_release();
+    return dm_queue_commit(seq);
 }
 
-void dm_memcpy2d_async(uint64_t src, uint64_t dst, uint32_t size,
-                       uint32_t sstrd, uint32_t dstrd, uint32_t nreps,
-                       uint32_t cfg) {
-    uint32_t s;
+dm_handle_t dm_memcpy2d_async(uint64_t src, uint64_t dst, uint32_t size,
+                              uint32_t sstrd, uint32_t dstrd, uint32_t nreps,
+                              uint32_t cfg) {
+    uint32_t seq;
     volatile dm_task_t *t;
 
     DM_PRINTF(10, "dm_memcpy2d_async %#x -> %#x size %d\n", src, dst,
               (uint32_t)size);
 
-    // poll queue size
-    do {
-        s = __atomic_load_n(&dm_p->queue_fill, __ATOMIC_RELAXED);
-    } while (s >= DM_TASK_QUEUE_SIZE);
-    _dm_mtx_lock();
-
     // insert
-    t = &dm_p->queue[dm_p->queue_front];
+    t = dm_queue_slot(&seq);
     t->src = src;
     t->dst = dst;
     t->size = size;
@@ -320,24 +321,34 @@ void dm_memcpy2d_async(uint64_t src, uint64_t dst, uint32_t size,
     t->cfg = cfg;
 
     // bump
-    __atomic_add_fetch(&dm_p->queue_fill, 1, __ATOMIC_RELAXED);
-    dm_p->queue_front = (dm_p->queue_front + 1) % DM_TASK_QUEUE_SIZE;
-
-    _dm_mtx_release();
+    return dm_queue_commit(seq);
 }
 
-void dm_start(void) { wake_dm(); }
+void dm_start(void) {
+    if (snrt_is_dm_core()) {
+        // nobody else issues transfers while the DM core is busy here
+        while (dm_service())
+            ;
+    } else {
+        wake_dm();
+    }
+}
 
 void dm_wait(void) {
-    uint32_t s;
+    if (snrt_is_dm_core()) {
+        while (dm_service())
+            ;
+        while (dm_sdma_stat(DM_STATUS_BUSY))
+            ;
+        return;
+    }
 
     // signal data mover
     wake_dm();
 
-    // first, wait for the dm queue to be empty and no request be pending
-    do {
-        s = __atomic_load_n(&dm_p->queue_fill, __ATOMIC_RELAXED);
-    } while (s != 0);
+    // first, wait for the dm queues to be empty and no request be pending
+    while (dm_pending())
+        ;
     while (dm_p->stat_q)
         ;
 
@@ -355,6 +366,36 @@ void dm_wait(void) {
     _dm_mtx_release();
 }
 
+void dm_wait_id(dm_handle_t handle) {
+    volatile dm_queue_t *q = &dm_p->queues[handle.core];
+    uint32_t txid;
+
+    if (snrt_is_dm_core()) {
+        while ((int32_t)(q->back - handle.seq) <= 0) dm_service();
+        txid = q->txid[handle.seq % DM_TASK_QUEUE_SIZE];
+        while ((int32_t)(dm_sdma_stat(DM_STATUS_COMPLETE_ID) - txid) <= 0)
+            dm_service();
+        return;
+    }
+
+    // wait for the DM core to issue the transfer. If the slot was reused in
+    // the meantime, this waits for the newer transfer.
+    if ((int32_t)(q->back - handle.seq) <= 0) {
+        wake_dm();
+        while ((int32_t)(q->back - handle.seq) <= 0)
+            ;
+    }
+    txid = q->txid[handle.seq % DM_TASK_QUEUE_SIZE];
+    if ((int32_t)(dm_p->complete_id - txid) > 0) return;
+
+    // keep the DM core polling the DMA status until the transfer completed
+    __atomic_add_fetch(&dm_p->waiters, 1, __ATOMIC_SEQ_CST);
+    wake_dm();
+    while ((int32_t)(dm_p->complete_id - txid) <= 0)
+        ;
+    __atomic_add_fetch(&dm_p->waiters, -1, __ATOMIC_RELAXED);
+}
+
 void dm_exit(void) {
     dm_p->stat_q = STAT_EXIT;
     // signal data mover
@@ -362,6 +403,7 @@ void dm_exit(void) {
 }
 
 void dm_wait_ready(void) {
+    if (snrt_is_dm_core()) return;
     _dm_mtx_lock();
     dm_p->stat_pvalid = 0;
     dm_p->stat_q = STAT_READY;
@@ -375,6 +417,80 @@ void dm_wait_ready(void) {
 // private
 //================================================================================
 
+/**
+ * @brief Issue the next transfer of every core with queued transfers, DM core
+ * only
+ * @return number of issued transfers
+ */
+static uint32_t dm_service(void) {
+    uint32_t issued = 0;
+
+    for (uint32_t i = 0; i < dm_p->queue_num; i++) {
+        volatile dm_queue_t *q = &dm_p->queues[i];
+        uint32_t back = q->back;
+        if (back == __atomic_load_n(&q->front, __ATOMIC_ACQUIRE)) continue;
+
+        // wait until DMA is ready
+        while (dm_sdma_stat(DM_STATUS_WOULD_BLOCK))
+            ;
+
+        volatile dm_task_t *t = &q->queue[back % DM_TASK_QUEUE_SIZE];
+        uint32_t txid;
+        if (t->twod) {
+            DM_PRINTF(10, "start twod\n");
+            txid = dm_sdma_start_twod(t->src, t->dst, t->size, t->sstrd,
+                                      t->dstrd, t->nreps, t->cfg);
+        } else {
+            DM_PRINTF(10, "start oned\n");
+            txid = dm_sdma_start_oned(t->src, t->dst, t->size, t->cfg);
+        }
+
+        // bump, the slot is free for the producer afterwards
+        q->txid[back % DM_TASK_QUEUE_SIZE] = txid;
+        __atomic_store_n(&q->back, back + 1, __ATOMIC_RELEASE);
+        issued++;
+    }
+
+    if (dm_p->waiters) dm_p->complete_id = dm_sdma_stat(DM_STATUS_COMPLETE_ID);
+    return issued;
+}
+
+/**
+ * @brief Whether any core has transfers queued that the DM core did not issue
+ */
+static uint32_t dm_pending(void) {
+    for (uint32_t i = 0; i < dm_p->queue_num; i++) {
+        volatile dm_queue_t *q = &dm_p->queues[i];
+        if (q->back != q->front) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Return the next free slot of the queue of this core, blocking while
+ * the queue is full
+ */
+static volatile dm_task_t *dm_queue_slot(uint32_t *seq) {
+    uint32_t front = dm_q->front;
+    if (front - dm_q->back >= DM_TASK_QUEUE_SIZE) {
+        // the DM core only issues once it was started
+        dm_start();
+        while (front - dm_q->back >= DM_TASK_QUEUE_SIZE)
+            if (snrt_is_dm_core()) dm_service();
+    }
+    *seq = front;
+    return &dm_q->queue[front % DM_TASK_QUEUE_SIZE];
+}
+
+/**
+ * @brief Hand the transfer in slot seq over to the DM core
+ */
+static dm_handle_t dm_queue_commit(uint32_t seq) {
+    dm_handle_t handle = {dm_q_idx, seq};
+    __atomic_store_n(&dm_q->front, seq + 1, __ATOMIC_RELEASE);
+    return handle;
+}
+
 #ifdef DM_USE_GLOBAL_CLINT
 static void wfi_dm(uint32_t cluster_core_idx) {
     (void)cluster_core_idx;
@@ -386,15 +502,16 @@ static void wake_dm(void) {
 }
 #else
 static void wfi_dm(uint32_t cluster_core_idx) {
-    __atomic_add_fetch(&dm_p->dm_wfi, 1, __ATOMIC_RELAXED);
-    snrt_wfi();
+    __atomic_add_fetch(&dm_p->dm_wfi, 1, __ATOMIC_SEQ_CST);
+    // a wake-up sent after this check stays pending in the cluster CLINT
+    if (!dm_pending() && !dm_p->stat_q && !dm_p->waiters) snrt_wfi();
     snrt_int_cluster_clr(1 << cluster_core_idx);
     __atomic_add_fetch(&dm_p->dm_wfi, -1, __ATOMIC_RELAXED);
 }
 static void wake_dm(void) {
-    // wait for DM to sleep before sending wakeup
-    while (!__atomic_load_n(&dm_p->dm_wfi, __ATOMIC_RELAXED))
-        ;
-    snrt_int_cluster_set(1 << snrt_cluster_dm_core_idx());
+    // only a sleeping DM core needs the wakeup, pairs with the check in wfi_dm
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&dm_p->dm_wfi, __ATOMIC_RELAXED))
+        snrt_int_cluster_set(1 << cluster_dm_core_idx);
 }
 #endif  // #ifdef DM_USE_GLOBAL_CLINT
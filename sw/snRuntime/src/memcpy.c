@@ -6,18 +6,273 @@
 
 #include "snrt.h"
 
-// TODO: Implement using cluster DMA for a faster `memcpy`.
+//================================================================================
+// Settings
+//================================================================================
+
+/**
+ * @brief Copies and fills of at least this many bytes within the TCDM use the
+ * vector unit
+ *
+ */
+#ifndef SNRT_MEMCPY_VEC_MIN
+#define SNRT_MEMCPY_VEC_MIN 128
+#endif
+
+/**
+ * @brief Copies of at least this many bytes between the TCDM and the main
+ * memory use the cluster DMA, if the calling core controls it
+ *
+ */
+#ifndef SNRT_MEMCPY_DMA_MIN
+#define SNRT_MEMCPY_DMA_MIN 2048
+#endif
+
+//================================================================================
+// Scalar
+//================================================================================
+
+/**
+ * @brief Copy forward a word at a time. A source misaligned to the
+ * destination is read in aligned words and shifted into place.
+ */
+static inline void copy_fwd(uint8_t *d, const uint8_t *s, size_t n) {
+    // align the destination
+    while (n && ((uintptr_t)d & 3)) {
+        *d++ = *s++;
+        n--;
+    }
+
+    uint32_t *dw = (uint32_t *)d;
+    uint32_t off = (uintptr_t)s & 3;
+    if (!off) {
+        const uint32_t *sw = (const uint32_t *)s;
+        for (; n >= 16; n -= 16, dw += 4, sw += 4) {
+            uint32_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+            dw[0] = w0;
+            dw[1] = w1;
+            dw[2] = w2;
+            dw[3] = w3;
+        }
+        for (; n >= 4; n -= 4) *dw++ = *sw++;
+        s = (const uint8_t *)sw;
+    } else if (n >= 8) {
+        // the aligned words around the source never reach past its end while
+        // eight bytes are left
+        const uint32_t *sw = (const uint32_t *)(s - off);
+        uint32_t sh = off * 8, lo = *sw++;
+        for (; n >= 8; n -= 4) {
+            uint32_t hi = *sw++;
+            *dw++ = (lo >> sh) | (hi << (32 - sh));
+            lo = hi;
+        }
+        s = (const uint8_t *)sw - 4 + off;
+    }
+
+    d = (uint8_t *)dw;
+    while (n--) *d++ = *s++;
+}
+
+/**
+ * @brief Copy backward for overlapping moves to a higher address
+ */
+static inline void copy_bwd(uint8_t *d, const uint8_t *s, size_t n) {
+    d += n;
+    s += n;
+    if ((((uintptr_t)d ^ (uintptr_t)s) & 3) == 0) {
+        while (n && ((uintptr_t)d & 3)) {
+            *--d = *--s;
+            n--;
+        }
+        uint32_t *dw = (uint32_t *)d;
+        const uint32_t *sw = (const uint32_t *)s;
+        for (; n >= 4; n -= 4) *--dw = *--sw;
+        d = (uint8_t *)dw;
+        s = (const uint8_t *)sw;
+    }
+    while (n--) *--d = *--s;
+}
+
+static inline void set_fwd(uint8_t *d, uint8_t c, size_t n) {
+    while (n && ((uintptr_t)d & 3)) {
+        *d++ = c;
+        n--;
+    }
+    uint32_t *dw = (uint32_t *)d;
+    uint32_t w = c * 0x01010101u;
+    for (; n >= 16; n -= 16, dw += 4) {
+        dw[0] = w;
+        dw[1] = w;
+        dw[2] = w;
+        dw[3] = w;
+    }
+    for (; n >= 4; n -= 4) *dw++ = w;
+    d = (uint8_t *)dw;
+    while (n--) *d++ = c;
+}
+
+//================================================================================
+// Vector
+//================================================================================
+// The runtime is built without 'v' in the march so the compiler never emits
+// vector code on its own, the kernels below enable it for their asm only.
+// They clobber vl, vtype and v8-v15.
+
+static inline void copy_vec_fwd(uint8_t *d, const uint8_t *s, size_t n) {
+    while (n) {
+        size_t vl;
+        asm volatile(
+            ".option push\n"
+            ".option arch, +zve32x\n"
+            "vsetvli %[vl], %[n], e8, m8, ta, ma\n"
+            "vle8.v v8, (%[s])\n"
+            "vse8.v v8, (%[d])\n"
+            ".option pop\n"
+            : [ vl ] "=&r"(vl)
+            : [ n ] "r"(n), [ s ] "r"(s), [ d ] "r"(d)
+            : "memory");
+        d += vl;
+        s += vl;
+        n -= vl;
+    }
+}
+
+// Each chunk is loaded before it is stored, so the copy is safe for
+// overlapping moves to a higher address when going from the end
+static inline void copy_vec_bwd(uint8_t *d, const uint8_t *s, size_t n) {
+    while (n) {
+        size_t vl;
+        asm volatile(
+            ".option push\n"
+            ".option arch, +zve32x\n"
+            "vsetvli %[vl], %[n], e8, m8, ta, ma\n"
+            ".option pop\n"
+            : [ vl ] "=r"(vl)
+            : [ n ] "r"(n));
+        n -= vl;
+        asm volatile(
+            ".option push\n"
+            ".option arch, +zve32x\n"
+            "vle8.v v8, (%[s])\n"
+            "vse8.v v8, (%[d])\n"
+            ".option pop\n"
+            :
+            : [ s ] "r"(s + n), [ d ] "r"(d + n)
+            : "memory");
+    }
+}
+
+static inline void set_vec(uint8_t *d, uint8_t c, size_t n) {
+    size_t vl;
+    asm volatile(
+        ".option push\n"
+        ".option arch, +zve32x\n"
+        "vsetvli %[vl], %[n], e8, m8, ta, ma\n"
+        "vmv.v.x v8, %[c]\n"
+        ".option pop\n"
+        : [ vl ] "=r"(vl)
+        : [ n ] "r"(n), [ c ] "r"(c));
+    while (n) {
+        asm volatile(
+            ".option push\n"
+            ".option arch, +zve32x\n"
+            "vsetvli %[vl], %[n], e8, m8, ta, ma\n"
+            "vse8.v v8, (%[d])\n"
+            ".option pop\n"
+            : [ vl ] "=&r"(vl)
+            : [ n ] "r"(n), [ d ] "r"(d)
+            : "memory");
+        d += vl;
+        n -= vl;
+    }
+}
+
+//================================================================================
+// Dispatch
+//================================================================================
+
+static inline int in_tcdm(const void *p) {
+    snrt_slice_t tcdm = snrt_cluster_memory();
+    return (uintptr_t)p >= tcdm.start && (uintptr_t)p < tcdm.end;
+}
+
+/**
+ * @brief Whether the copy should use the vector unit. Its loads and stores
+ * are only fast on the TCDM, copies touching the main memory stay scalar.
+ */
+static inline int use_vec(const void *dst, const void *src, size_t n) {
+    return n >= SNRT_MEMCPY_VEC_MIN && in_tcdm(dst) && in_tcdm(src);
+}
+
+/**
+ * @brief Whether the copy should go through the cluster DMA. Only the DM core
+ * drives the DMA, the other cores copy word by word.
+ */
+static inline int use_dma(const void *dst, const void *src, size_t n) {
+    return n >= SNRT_MEMCPY_DMA_MIN && snrt_is_dm_core() &&
+           in_tcdm(dst) != in_tcdm(src);
+}
+
+//================================================================================
+// public
+//================================================================================
+
 void *snrt_memcpy(void *dst, const void *src, size_t n) {
-    return memcpy(dst, src, n);
+    if (use_dma(dst, src, n)) {
+        snrt_dma_wait(snrt_dma_start_1d(dst, src, n));
+    } else if (use_vec(dst, src, n)) {
+        copy_vec_fwd(dst, src, n);
+    } else {
+        copy_fwd(dst, src, n);
+    }
+    return dst;
+}
+
+void *snrt_memmove(void *dst, const void *src, size_t n) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    if (d == s || !n) return dst;
+    // the TCDM and the main memory never overlap
+    if (use_dma(dst, src, n)) return snrt_memcpy(dst, src, n);
+
+    int vec = use_vec(dst, src, n);
+    if (d < s || d >= s + n) {
+        if (vec)
+            copy_vec_fwd(d, s, n);
+        else
+            copy_fwd(d, s, n);
+    } else {
+        if (vec)
+            copy_vec_bwd(d, s, n);
+        else
+            copy_bwd(d, s, n);
+    }
+    return dst;
 }
 
-void* memcpy(void *dest, const void *src, size_t n) {
-  const char *csrc = (const char *)src;
-  char *cdest = (char *)dest;
+void *snrt_memset(void *ptr, int value, size_t num) {
+    if (use_vec(ptr, ptr, num))
+        set_vec(ptr, (uint8_t)value, num);
+    else
+        set_fwd(ptr, (uint8_t)value, num);
+    return ptr;
+}
 
-  // Copy contents of src[] to dest[]
-  for (size_t i = 0; i < n; ++i)
-    cdest[i] = csrc[i];
+// The compiler emits calls to memcpy for struct copies anywhere, also between
+// the vector instructions of a kernel, so it must leave the vector state alone
+// and only gets the scalar copy.
+void *memcpy(void *dest, const void *src, size_t n) {
+    copy_fwd(dest, src, n);
+    return dest;
+}
 
-  return dest;
+void *memmove(void *dest, const void *src, size_t n) {
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+    if (d < s || d >= s + n)
+        copy_fwd(d, s, n);
+    else
+        copy_bwd(d, s, n);
+    return dest;
 }
@@ -22,22 +22,47 @@
  */
 // #define EU_USE_GLOBAL_CLINT
 
+/**
+ * @brief Number of descriptors in the dispatch ring. The master can queue
+ * this many events before it has to wait for the workers.
+ *
+ */
+#ifndef EU_RING_SLOTS
+#define EU_RING_SLOTS 4
+#endif
+
+/**
+ * @brief Polls of the next ring slot before a worker goes to wfi. A region
+ * forked while the workers still poll starts without an interrupt.
+ *
+ */
+#ifndef EU_SPIN_ROUNDS
+#define EU_SPIN_ROUNDS 128
+#endif
+
 //================================================================================
 // Types
 //================================================================================
 
+typedef struct {
+    void (*fn)(void *, uint32_t);  // points to microtask wrapper
+    void *data;
+    uint32_t argc;
+    uint32_t nthreads;
+    uint32_t fini_count;
+    // number of the event in the slot plus one, 0 while the slot is unused
+    uint32_t seq;
+} eu_event_t;
+
 typedef struct {
     uint32_t workers_in_loop;
     uint32_t exit_flag;
     uint32_t workers_mutex;
     uint32_t workers_wfi;
-    struct {
-        void (*fn)(void *, uint32_t);  // points to microtask wrapper
-        void *data;
-        uint32_t argc;
-        uint32_t nthreads;
-        uint32_t fini_count;
-    } e;
+    uint32_t head;  // events pushed by the master
+    uint32_t tail;  // events the master ran its share of
+    uint32_t join;  // number plus one of the last event with a team, 0 if joined
+    eu_event_t e[EU_RING_SLOTS];
 } eu_t;
 
 //================================================================================
@@ -60,8 +85,9 @@ static volatile eu_t *volatile eu_p_global;
 // prototypes
 //================================================================================
 static void wake_workers(void);
-static void worker_wfi(uint32_t cluster_core_idx);
-static void wait_worker_wfi(void);
+static void worker_wfi(uint32_t cluster_core_idx, volatile eu_event_t *ev,
+                       uint32_t seq);
+static void wait_event_done(volatile eu_event_t *ev);
 
 //================================================================================
 // public
@@ -86,10 +112,10 @@ void eu_init(void) {
  */
 void eu_exit(uint32_t core_idx) {
     // make sure queue is empty
-    if (!eu_p->e.nthreads) eu_run_empty(core_idx);
+    eu_run_empty(core_idx);
     // set exit flag and wake cores
-    wait_worker_wfi();
     eu_p->exit_flag = 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
     wake_workers();
 }
 
@@ -113,7 +139,8 @@ uint32_t eu_get_workers_in_wfi() {
  *
  */
 void eu_print_status() {
-    EU_PRINTF(0, "workers_in_loop=%d\n", eu_p->workers_in_loop);
+    EU_PRINTF(0, "workers_in_loop=%d head=%d tail=%d\n", eu_p->workers_in_loop,
+              eu_p->head, eu_p->tail);
 }
 
 /**
@@ -122,11 +149,12 @@ void eu_print_status() {
  * @param cluster_core_idx local core index of the entering thread
  */
 void eu_event_loop(uint32_t cluster_core_idx) {
-    uint32_t scratch;
-    uint32_t nthds;
+    uint32_t next, spins = 0;
+    volatile eu_event_t *ev;
 
     // count number of workers in loop
     __atomic_add_fetch(&eu_p->workers_in_loop, 1, __ATOMIC_RELAXED);
+    next = eu_p->head;
 
     // enable software interrupts
 #ifdef EU_USE_GLOBAL_CLINT
@@ -138,6 +166,22 @@ void eu_event_loop(uint32_t cluster_core_idx) {
     EU_PRINTF(0, "#%d entered event loop\n", cluster_core_idx);
 
     while (1) {
+        ev = &eu_p->e[next % EU_RING_SLOTS];
+
+        // run the events in the order the master pushed them
+        if (__atomic_load_n(&ev->seq, __ATOMIC_ACQUIRE) == next + 1) {
+            if (cluster_core_idx < ev->nthreads) {
+                EU_PRINTF(0, "run fn @ %#x (arg 0 = %#x)\n", ev->fn,
+                          ((uint32_t *)ev->data)[0]);
+                // call
+                ev->fn(ev->data, ev->argc);
+            }
+            __atomic_add_fetch(&ev->fini_count, 1, __ATOMIC_RELEASE);
+            next++;
+            spins = 0;
+            continue;
+        }
+
         // check for exit
         if (eu_p->exit_flag) {
 #ifdef EU_USE_GLOBAL_CLINT
@@ -148,20 +192,10 @@ void eu_event_loop(uint32_t cluster_core_idx) {
             return;
         }
 
-        if (cluster_core_idx < eu_p->e.nthreads) {
-            // make a local copy of nthreads to sync after work since the master
-            // hart will reset eu_p->e.nthreads as soon as all workers finished
-            // which might cause a race condition
-            nthds = eu_p->e.nthreads;
-            EU_PRINTF(0, "run fn @ %#x (arg 0 = %#x)\n", eu_p->e.fn,
-                      ((uint32_t *)eu_p->e.data)[0]);
-            // call
-            eu_p->e.fn(eu_p->e.data, eu_p->e.argc);
-        }
-
-        // enter wait for interrupt
-        __atomic_add_fetch(&eu_p->e.fini_count, 1, __ATOMIC_RELAXED);
-        worker_wfi(cluster_core_idx);
+        // enter wait for interrupt once the master stays quiet
+        if (++spins < EU_SPIN_ROUNDS) continue;
+        spins = 0;
+        worker_wfi(cluster_core_idx, ev, next + 1);
     }
 }
 
@@ -176,14 +210,27 @@ void eu_event_loop(uint32_t cluster_core_idx) {
  */
 int eu_dispatch_push(void (*fn)(void *, uint32_t), uint32_t argc, void *data,
                      uint32_t nthreads) {
-    // wait for workers to be in wfi before manipulating the event struct
-    wait_worker_wfi();
-
-    // fill queue
-    eu_p->e.fn = fn;
-    eu_p->e.data = data;
-    eu_p->e.argc = argc;
-    eu_p->e.nthreads = nthreads;
+    uint32_t n = eu_p->head;
+    volatile eu_event_t *ev = &eu_p->e[n % EU_RING_SLOTS];
+
+    // the ring is full of events the master has not run its share of yet
+    if (n - eu_p->tail == EU_RING_SLOTS) eu_run_queued(snrt_cluster_core_idx());
+    // the workers may still be running the last event in this slot
+    if (ev->seq) wait_event_done(ev);
+
+    // fill the slot, the workers pick it up once seq matches
+    ev->fn = fn;
+    ev->data = data;
+    ev->argc = argc;
+    ev->nthreads = nthreads;
+    ev->fini_count = 0;
+    __atomic_store_n(&ev->seq, n + 1, __ATOMIC_RELEASE);
+    eu_p->head = n + 1;
+
+    // workers that went to wfi before the event was visible need a wake-up,
+    // pairs with the check in worker_wfi
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (nthreads > 1 && eu_get_workers_in_wfi()) wake_workers();
 
     EU_PRINTF(10, "eu_dispatch_push success, workers %d in loop %d\n", nthreads,
               eu_p->workers_in_loop);
@@ -193,37 +240,54 @@ int eu_dispatch_push(void (*fn)(void *, uint32_t), uint32_t argc, void *data,
 
 /**
  * @brief supervisor core enters this loop to empty the event queue
- * @details
+ * @details Runs the share of the master of all pushed events and waits for
+ * the workers to finish them.
  */
 void eu_run_empty(uint32_t core_idx) {
-    unsigned nfini, scratch;
-    scratch = eu_p->e.nthreads;
-    if (!scratch) return;
-    EU_PRINTF(10, "eu_run_empty enter: q size %d\n", eu_p->e.nthreads);
-
-    eu_p->e.fini_count = 0;
-    if (scratch > 1) wake_workers();
-
-    // Am i also part of the team?
-    if (core_idx < eu_p->e.nthreads) {
-        // call
-        EU_PRINTF(0, "run fn @ %#x (arg 0 = %#x)\n", eu_p->e.fn,
-                  ((uint32_t *)eu_p->e.data)[0]);
-        eu_p->e.fn(eu_p->e.data, eu_p->e.argc);
-    }
+    eu_run_queued(core_idx);
+    eu_join();
+}
 
-    // wait for queue to be empty
-    if (scratch > 1) {
-        scratch = eu_get_workers_in_loop();
-        while (__atomic_load_n(&eu_p->e.fini_count, __ATOMIC_RELAXED) !=
-               scratch)
-            ;
+/**
+ * @brief Run the share of the master of all pushed events without waiting for
+ * the workers
+ */
+void eu_run_queued(uint32_t core_idx) {
+    uint32_t tail = eu_p->tail, head = eu_p->head;
+    volatile eu_event_t *ev;
+    if (tail == head) return;
+    EU_PRINTF(10, "eu_run_queued enter: q size %d\n", head - tail);
+
+    for (; tail != head; tail++) {
+        ev = &eu_p->e[tail % EU_RING_SLOTS];
+        // Am i also part of the team?
+        if (core_idx < ev->nthreads) {
+            // call
+            EU_PRINTF(0, "run fn @ %#x (arg 0 = %#x)\n", ev->fn,
+                      ((uint32_t *)ev->data)[0]);
+            ev->fn(ev->data, ev->argc);
+        }
+        // a lone master does not wait for the workers to skip its events
+        if (ev->nthreads > 1) eu_p->join = tail + 1;
     }
+    eu_p->tail = tail;
 
-    // stop workers from re-executing the task
-    eu_p->e.nthreads = 0;
+    EU_PRINTF(10, "eu_run_queued exit\n");
+}
 
-    EU_PRINTF(10, "eu_run_empty exit\n");
+/**
+ * @brief Wait for the workers to finish the last event with a team. The
+ * workers run the events in order, so all events with a team are done
+ * afterwards.
+ */
+void eu_join(void) {
+    uint32_t join = eu_p->join;
+    if (!join) return;
+    volatile eu_event_t *ev = &eu_p->e[(join - 1) % EU_RING_SLOTS];
+    // a push only reuses the slot once the workers are done with the event
+    if (__atomic_load_n(&ev->seq, __ATOMIC_RELAXED) == join)
+        wait_event_done(ev);
+    eu_p->join = 0;
 }
 
 /**
@@ -240,9 +304,15 @@ inline void eu_mutex_release() { snrt_mutex_release(&eu_p->workers_mutex); }
 // private
 //================================================================================
 
-static void wait_worker_wfi(void) {
-    uint32_t scratch = eu_p->workers_in_loop;
-    while (__atomic_load_n(&eu_p->workers_wfi, __ATOMIC_RELAXED) != scratch)
+/**
+ * @brief Wait for all workers to be done with the event
+ */
+static void wait_event_done(volatile eu_event_t *ev) {
+    uint32_t scratch = eu_get_workers_in_loop();
+    if (__atomic_load_n(&ev->fini_count, __ATOMIC_ACQUIRE) == scratch) return;
+    // the event might not have woken the workers
+    if (eu_get_workers_in_wfi()) wake_workers();
+    while (__atomic_load_n(&ev->fini_count, __ATOMIC_ACQUIRE) != scratch)
         ;
 }
 
@@ -283,9 +353,12 @@ static void wake_workers(void) {
 #endif
 }
 
-static void worker_wfi(uint32_t cluster_core_idx) {
-    __atomic_add_fetch(&eu_p->workers_wfi, 1, __ATOMIC_RELAXED);
-    snrt_int_sw_poll();
+static void worker_wfi(uint32_t cluster_core_idx, volatile eu_event_t *ev,
+                       uint32_t seq) {
+    __atomic_add_fetch(&eu_p->workers_wfi, 1, __ATOMIC_SEQ_CST);
+    // a wake-up sent after this check stays pending in the CLINT
+    if (__atomic_load_n(&ev->seq, __ATOMIC_RELAXED) != seq && !eu_p->exit_flag)
+        snrt_int_sw_poll();
     __atomic_add_fetch(&eu_p->workers_wfi, -1, __ATOMIC_RELAXED);
 }
 
@@ -296,16 +369,17 @@ static void worker_wfi(uint32_t cluster_core_idx) {
 #else  // #ifdef EU_USE_GLOBAL_CLINT
 
 static void wake_workers(void) {
-    // Guard to wake only if all workers are wfi
-    wait_worker_wfi();
     // Wake the cluster cores. We do this with cluster relative hart IDs and do
     // not wake hart 0 since this is the main thread
     uint32_t numcores = snrt_cluster_compute_core_num();
     snrt_int_cluster_set(~0x1 & ((1 << numcores) - 1));
 }
-static void worker_wfi(uint32_t cluster_core_idx) {
-    __atomic_add_fetch(&eu_p->workers_wfi, 1, __ATOMIC_RELAXED);
-    snrt_wfi();
+static void worker_wfi(uint32_t cluster_core_idx, volatile eu_event_t *ev,
+                       uint32_t seq) {
+    __atomic_add_fetch(&eu_p->workers_wfi, 1, __ATOMIC_SEQ_CST);
+    // a wake-up sent after this check stays pending in the cluster CLINT
+    if (__atomic_load_n(&ev->seq, __ATOMIC_RELAXED) != seq && !eu_p->exit_flag)
+        snrt_wfi();
     snrt_int_cluster_clr(1 << cluster_core_idx);
     __atomic_add_fetch(&eu_p->workers_wfi, -1, __ATOMIC_RELAXED);
 }
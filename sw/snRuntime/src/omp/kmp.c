@@ -35,8 +35,10 @@ static void __microtask_wrapper(void *arg, uint32_t argc) {
     kmp_int32 gtid = id;
 
     uint32_t cycle = read_csr(mcycle);
-    OMP_PROF(if (snrt_hartid() == 1) omp_prof->fork_oh =
-                 cycle - omp_prof->fork_oh);
+    OMP_PROF(if (snrt_hartid() == 1) {
+        omp_prof->fork_oh = cycle - omp_prof->fork_start;
+        omp_prof->fork_total += omp_prof->fork_oh;
+    });
 
     switch (argc) {
         default:
@@ -91,6 +93,7 @@ static void __microtask_wrapper(void *arg, uint32_t argc) {
     }
     // for performance tracking in traces
     cycle = read_csr(mcycle);
+    OMP_PROF(if (snrt_hartid() == 1) omp_prof->thread_end = cycle);
 }
 
 /*!
@@ -167,7 +170,7 @@ void __kmpc_fork_call(ident_t *loc, kmp_int32 argc, kmpc_micro microtask, ...) {
     (void)loc;
     _OMP_T *omp = omp_getData();
 
-    OMP_PROF(omp_prof->fork_oh = read_csr(mcycle));
+    OMP_PROF(omp_prof->fork_start = read_csr(mcycle));
 
     va_list vl;
     int arg_size = 0;
@@ -204,6 +207,11 @@ void __kmpc_fork_call(ident_t *loc, kmp_int32 argc, kmpc_micro microtask, ...) {
                                omp->numThreads);
     } else {
         parallelRegion(argc, kmpc_args, __microtask_wrapper, omp->numThreads);
+        OMP_PROF(if (omp->numThreads > 1) {
+            omp_prof->join_oh = read_csr(mcycle) - omp_prof->thread_end;
+            omp_prof->join_total += omp_prof->join_oh;
+            omp_prof->regions++;
+        });
     }
 
     // rt_free(args);
@@ -385,6 +393,66 @@ void __kmpc_for_static_init_8u(ident_t *loc, kmp_int32 gtid, kmp_int32 sched,
 //================================================================================
 #ifndef OMPSTATIC_NUMTHREADS
 
+/**
+ * @brief Map a schedule passed by the compiler to the one implemented for it.
+ * Nonmonotonic dynamic loops steal chunks from the blocks of other threads,
+ * like `kmp_sch_static_steal` in LLVM's runtime. Ordered loops hand out
+ * chunks in order, which is all `ordered` needs without `__kmpc_ordered`.
+ */
+static omp_loop_sched_t loop_sched(enum sched_type schedule) {
+    int nonmonotonic = SCHEDULE_HAS_NONMONOTONIC(schedule);
+    kmp_int32 sched = SCHEDULE_WITHOUT_MODIFIERS(schedule);
+    if (sched >= kmp_nm_lower && sched < kmp_nm_upper)
+        sched = sched - kmp_nm_lower + kmp_sch_lower;
+    else if (sched >= kmp_ord_lower && sched < kmp_ord_upper)
+        return OMP_LOOP_DYNAMIC;
+
+    switch (sched) {
+        case kmp_sch_static_chunked:
+            return OMP_LOOP_STATIC_CHUNKED;
+        case kmp_sch_dynamic_chunked:
+            return nonmonotonic ? OMP_LOOP_STEAL : OMP_LOOP_DYNAMIC;
+        case kmp_sch_static_steal:
+            return OMP_LOOP_STEAL;
+        case kmp_sch_guided_chunked:
+        case kmp_sch_guided_iterative_chunked:
+        case kmp_sch_guided_analytical_chunked:
+        case kmp_sch_guided_simd:
+        case kmp_sch_auto:
+            return OMP_LOOP_GUIDED;
+        case kmp_sch_trapezoidal:
+            return OMP_LOOP_DYNAMIC;
+        default:
+            return OMP_LOOP_STATIC;
+    }
+}
+
+/**
+ * @brief Chunk size of a guided round starting with `remaining` iterations.
+ * Every round hands out one chunk per thread, and halves the remaining
+ * iterations until the chunks reach the requested size.
+ */
+static inline uint32_t guided_size(omp_loop_t *loop, uint32_t remaining) {
+    uint32_t size = (remaining + 2 * loop->nthreads - 1) / (2 * loop->nthreads);
+    return size > loop->chunk ? size : loop->chunk;
+}
+
+/**
+ * @brief Iterations of the j-th chunk of a guided loop. The chunk indices a
+ * thread claims only grow, so it walks the rounds forward from the last one.
+ */
+static inline uint32_t guided_chunk(omp_loop_t *loop, omp_loop_cursor_t *cur,
+                                    uint32_t j, uint32_t *begin) {
+    while (cur->round_size > loop->chunk &&
+           j - cur->round_chunk >= loop->nthreads) {
+        cur->round_chunk += loop->nthreads;
+        cur->round_begin += loop->nthreads * cur->round_size;
+        cur->round_size = guided_size(loop, loop->trip - cur->round_begin);
+    }
+    *begin = cur->round_begin + (j - cur->round_chunk) * cur->round_size;
+    return cur->round_size;
+}
+
 /*!
 @ingroup WORK_SHARING
 @{
@@ -399,38 +467,72 @@ void __kmpc_for_static_init_8u(ident_t *loc, kmp_int32 gtid, kmp_int32 sched,
 This function prepares the runtime to start a dynamically scheduled for loop,
 saving the loop arguments.
 These functions are all identical apart from the types of the arguments.
+
+The first thread to arrive sets up one of the `OMP_LOOP_SLOTS` loop slots,
+the others wait until it is published. A slot is only reused once all threads
+have left the loop it held before.
 */
 void __kmpc_dispatch_init_4(ident_t *loc, kmp_int32 gtid,
                             enum sched_type schedule, kmp_int32 lb,
                             kmp_int32 ub, kmp_int32 st, kmp_int32 chunk) {
     (void)loc;
     (void)gtid;
-    (void)schedule;
     omp_team_t *team = omp_get_team(omp_getData());
-    // dynLoopInitNoIter(team, lb, ub, st, chunk);
-    // int core_id = omp_get_thread_num();
-    eu_mutex_lock();
-    // if (team->loop_epoch - team->core_epoch[core_id] != 0)
-    // {
-    //   eu_mutex_release();
-    //   team->core_epoch[core_id]++;
-    //   KMP_PRINTF(10, "__kmpc_dispatch_init_4 core_epoch[%d] =
-    //   %d\n",core_id,team->core_epoch[core_id]); return;
-    // }
-
-    if (!team->loop_is_setup) {
-        team->loop_is_setup = 1;
-        team->loop_start = lb;
-        team->loop_end = ub;
-        team->loop_incr = st;
-        team->loop_chunk = chunk;
-        KMP_PRINTF(
-            10,
-            "__kmpc_dispatch_init_4 setup: start %d end %d incr %d chunk %d\n",
-            team->loop_start, team->loop_end, team->loop_incr,
-            team->loop_chunk);
+    unsigned threadNum = omp_get_thread_num();
+    omp_loop_cursor_t *cur = &team->loop_cursor[threadNum];
+    int epoch = ++cur->epoch;
+    omp_loop_t *loop = &team->loops[epoch % OMP_LOOP_SLOTS];
+
+    // wait for the previous loop of this slot to drain
+    while (__atomic_load_n(&loop->done_epoch, __ATOMIC_ACQUIRE) !=
+           epoch - OMP_LOOP_SLOTS)
+        ;
+
+    if (__atomic_exchange_n(&loop->claim, epoch, __ATOMIC_ACQUIRE) != epoch) {
+        uint32_t nthreads = team->nbThreads;
+        uint32_t trip = 0;
+        if (st > 0 && ub >= lb)
+            trip = (uint32_t)(ub - lb) / st + 1;
+        else if (st < 0 && lb >= ub)
+            trip = (uint32_t)(lb - ub) / -st + 1;
+
+        loop->start = lb;
+        loop->incr = st;
+        loop->trip = trip;
+        loop->chunk = chunk > 0 ? chunk : 1;
+        loop->sched = loop_sched(schedule);
+        loop->nthreads = nthreads;
+        loop->next = 0;
+        loop->left = 0;
+        // static and nonmonotonic loops split the iterations into one block
+        // per thread
+        if (loop->sched == OMP_LOOP_STATIC || loop->sched == OMP_LOOP_STEAL) {
+            uint32_t block = trip / nthreads;
+            uint32_t leftOver = trip - block * nthreads;
+            uint32_t begin = 0;
+            for (uint32_t i = 0; i < nthreads; i++) {
+                loop->block_next[i] = begin;
+                begin += block + (i < leftOver);
+                loop->block_end[i] = begin;
+            }
+        }
+        team->loops_used = 1;
+        __atomic_store_n(&loop->epoch, epoch, __ATOMIC_RELEASE);
+        KMP_PRINTF(10,
+                   "__kmpc_dispatch_init_4 setup: start %d trip %d incr %d "
+                   "chunk %d sched %d\n",
+                   loop->start, loop->trip, loop->incr, loop->chunk,
+                   loop->sched);
+    } else {
+        while (__atomic_load_n(&loop->epoch, __ATOMIC_ACQUIRE) != epoch)
+            ;
     }
-    eu_mutex_release();
+
+    cur->k = 0;
+    cur->victim = threadNum;
+    cur->round_chunk = 0;
+    cur->round_begin = 0;
+    cur->round_size = guided_size(loop, loop->trip);
 }
 
 /*!
@@ -456,6 +558,9 @@ otherwise
 
 Get the next dynamically allocated chunk of work for this thread.
 If there is no more work, then the lb,ub and stride need not be modified.
+
+Chunks are claimed with a single `amoadd` on the shared iteration (or guided
+chunk) counter, without taking a lock.
 */
 int __kmpc_dispatch_next_4(ident_t *loc, kmp_int32 gtid, kmp_int32 *p_last,
                            kmp_int32 *p_lb, kmp_int32 *p_ub, kmp_int32 *p_st) {
@@ -463,36 +568,64 @@ int __kmpc_dispatch_next_4(ident_t *loc, kmp_int32 gtid, kmp_int32 *p_last,
     (void)gtid;
 
     omp_team_t *team = omp_get_team(omp_getData());
-
-    // The stride is actually always 1
-    *p_st = 1;
-
-    // int result = dynLoopIter(team, (int*) p_lb, (int*) p_ub, (int*) p_last);
-    eu_mutex_lock();
-
-    // have already iterated over all the iterations(no more work), return 0
-    if (team->loop_start > team->loop_end) {
-        team->loop_is_setup = 0;
-        KMP_PRINTF(
-            10, "__kmpc_dispatch_next_4 start > end: team->loop_is_setup %d\n",
-            team->loop_is_setup);
-        eu_mutex_release();
-        return 0;
+    unsigned threadNum = omp_get_thread_num();
+    omp_loop_cursor_t *cur = &team->loop_cursor[threadNum];
+    omp_loop_t *loop = &team->loops[cur->epoch % OMP_LOOP_SLOTS];
+    uint32_t begin = loop->trip;
+    uint32_t size = loop->chunk;
+
+    switch (loop->sched) {
+        case OMP_LOOP_STATIC:
+            if (cur->k++ == 0) {
+                begin = loop->block_next[threadNum];
+                size = loop->block_end[threadNum] - begin;
+                if (!size) begin = loop->trip;
+            }
+            break;
+        case OMP_LOOP_STATIC_CHUNKED:
+            begin = (threadNum + cur->k++ * loop->nthreads) * size;
+            break;
+        case OMP_LOOP_DYNAMIC:
+            begin = __atomic_fetch_add(&loop->next, size, __ATOMIC_RELAXED);
+            break;
+        case OMP_LOOP_GUIDED:
+            size = guided_chunk(
+                loop, cur,
+                __atomic_fetch_add(&loop->next, 1, __ATOMIC_RELAXED), &begin);
+            break;
+        case OMP_LOOP_STEAL:
+            // take chunks from the own block, then from the others in turn
+            do {
+                uint32_t v = cur->victim;
+                begin = __atomic_fetch_add(&loop->block_next[v], size,
+                                           __ATOMIC_RELAXED);
+                if (begin < loop->block_end[v]) {
+                    if (size > loop->block_end[v] - begin)
+                        size = loop->block_end[v] - begin;
+                    break;
+                }
+                begin = loop->trip;
+                cur->victim = v + 1 < loop->nthreads ? v + 1 : 0;
+            } while (cur->victim != threadNum);
+            break;
     }
 
-    *p_lb = team->loop_start;
-    *p_ub = *p_lb + team->loop_chunk - 1;
-    if (*p_ub >= team->loop_end) {
-        *p_ub = team->loop_end;
-        *p_last = 1;
+    // no more work: the last thread to leave frees the slot, return 0
+    if (begin >= loop->trip) {
+        if (__atomic_add_fetch(&loop->left, 1, __ATOMIC_RELAXED) ==
+            loop->nthreads)
+            __atomic_store_n(&loop->done_epoch, cur->epoch, __ATOMIC_RELEASE);
+        KMP_PRINTF(10, "__kmpc_dispatch_next_4 done: epoch %d\n", cur->epoch);
+        return 0;
     }
 
-    team->loop_start += team->loop_chunk;
-    KMP_PRINTF(10,
-               "__kmpc_dispatch_next_4 : last: %d [l %4d u %4d s %4d] "
-               "team->loop_start %d\n",
-               *p_last, *p_lb, *p_ub, *p_st, team->loop_start);
-    eu_mutex_release();
+    if (size > loop->trip - begin) size = loop->trip - begin;
+    *p_lb = loop->start + (kmp_int32)begin * loop->incr;
+    *p_ub = *p_lb + (kmp_int32)(size - 1) * loop->incr;
+    *p_st = loop->incr;
+    *p_last = begin + size == loop->trip;
+    KMP_PRINTF(10, "__kmpc_dispatch_next_4 : last: %d [l %4d u %4d s %4d]\n",
+               *p_last, *p_lb, *p_ub, *p_st);
     return 1;
 }
 
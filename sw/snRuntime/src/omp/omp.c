@@ -47,6 +47,25 @@ static inline void initTeam(omp_t *_this, omp_team_t *team) {
     (void)team;
 }
 
+#ifndef OMPSTATIC_NUMTHREADS
+/**
+ * @brief Rewind the loop epochs of all threads. The threads of a parallel
+ * region count its loops from zero, so that they agree on the slot of each.
+ */
+static inline void resetLoops(omp_team_t *team) {
+    if (!team->loops_used) return;
+    team->loops_used = 0;
+    for (int i = 0; i < OMP_LOOP_SLOTS; i++) {
+        // The first loop using slot i waits for loop (its epoch - SLOTS)
+        int prev = (i ? i : OMP_LOOP_SLOTS) - OMP_LOOP_SLOTS;
+        team->loops[i].epoch = prev;
+        team->loops[i].done_epoch = prev;
+        team->loops[i].claim = prev;
+    }
+    for (int i = 0; i < OMP_MAX_THREADS; i++) team->loop_cursor[i].epoch = 0;
+}
+#endif
+
 void omp_init(void) {
     if (snrt_cluster_core_idx() == 0) {
         // allocate space for kmp arguments
@@ -55,17 +74,13 @@ void omp_init(void) {
 #ifndef OMPSTATIC_NUMTHREADS
         omp_p = (omp_t *)snrt_l1alloc(sizeof(omp_t));
         unsigned int nbCores = snrt_cluster_compute_core_num();
+        if (nbCores > OMP_MAX_THREADS) nbCores = OMP_MAX_THREADS;
         omp_p->numThreads = nbCores;
         omp_p->maxThreads = nbCores;
 
         omp_p->plainTeam.nbThreads = nbCores;
-        omp_p->plainTeam.loop_epoch = 0;
-        omp_p->plainTeam.loop_is_setup = 0;
-
-        for (int i = 0; i < sizeof(omp_p->plainTeam.core_epoch) /
-                                sizeof(omp_p->plainTeam.core_epoch[0]);
-             i++)
-            omp_p->plainTeam.core_epoch[i] = 0;
+        omp_p->plainTeam.loops_used = 1;
+        resetLoops(&omp_p->plainTeam);
 
         initTeam(omp_p, &omp_p->plainTeam);
         omp_p->kmpc_barrier =
@@ -83,6 +98,7 @@ void omp_init(void) {
 
 #ifdef OPENMP_PROFILE
         omp_prof = (omp_prof_t *)snrt_l1alloc(sizeof(omp_prof_t));
+        snrt_memset(omp_prof, 0, sizeof(omp_prof_t));
 #endif
 
     } else {
@@ -132,8 +148,12 @@ unsigned __attribute__((noinline)) snrt_omp_bootstrap(uint32_t core_idx) {
 
 void partialParallelRegion(int32_t argc, void *data,
                            void (*fn)(void *, uint32_t), int num_threads) {
+    // regions forked with parallelRegionNowait still use the team
+    eu_join();
 #ifndef OMPSTATIC_NUMTHREADS
+    if (num_threads > omp_p->maxThreads) num_threads = omp_p->maxThreads;
     omp_p->plainTeam.nbThreads = num_threads;
+    resetLoops(&omp_p->plainTeam);
 #endif
 
     OMP_PRINTF(10, "num_threads=%d nbThreads=%d omp_p->numThreads=%d\n",
@@ -141,8 +161,32 @@ void partialParallelRegion(int32_t argc, void *data,
     parallelRegionExec(argc, data, fn, num_threads);
 }
 
+void parallelRegionNowait(int32_t argc, void *data,
+                          void (*fn)(void *, uint32_t), int num_threads) {
+#ifndef OMPSTATIC_NUMTHREADS
+    // The team cannot change under the regions that are still running. Their
+    // loops need no reset, every thread of the team runs the same loops.
+    if (num_threads > omp_p->maxThreads) num_threads = omp_p->maxThreads;
+    if (omp_p->plainTeam.nbThreads != num_threads) {
+        eu_join();
+        omp_p->plainTeam.nbThreads = num_threads;
+        resetLoops(&omp_p->plainTeam);
+    }
+#endif
+
+    (void)eu_dispatch_push(fn, argc, data, num_threads);
+    eu_run_queued(snrt_cluster_core_idx());
+}
+
+void parallelRegionJoin(void) { eu_join(); }
+
 #ifdef OPENMP_PROFILE
 void omp_print_prof(void) {
+    uint32_t n = omp_prof->regions ? omp_prof->regions : 1;
     printf("%-20s %d\n", "fork_oh", omp_prof->fork_oh);
+    printf("%-20s %d\n", "join_oh", omp_prof->join_oh);
+    printf("%-20s %d\n", "regions", omp_prof->regions);
+    printf("%-20s %d\n", "fork_oh_avg", omp_prof->fork_total / n);
+    printf("%-20s %d\n", "join_oh_avg", omp_prof->join_total / n);
 }
 #endif
@@ -44,11 +44,12 @@ void _snrt_init_team(uint32_t cluster_core_id, uint32_t cluster_core_num,
     team->base.root = team;
     team->bootdata = (void *)bootdata;
     team->global_core_base_hartid = bootdata->hartid_base;
-    team->global_core_num = bootdata->core_count;
+    team->global_core_num = bootdata->core_count * SNRT_CLUSTER_NUM;
     team->cluster_idx =
         (snrt_hartid() - bootdata->hartid_base) / bootdata->core_count;
-    team->cluster_num = 0;
-    team->cluster_core_base_hartid = bootdata->hartid_base;
+    team->cluster_num = SNRT_CLUSTER_NUM;
+    team->cluster_core_base_hartid =
+        bootdata->hartid_base + team->cluster_idx * bootdata->core_count;
     team->cluster_core_num = cluster_core_num;
     team->global_mem.start = (uint64_t)bootdata->global_mem_start;
     team->global_mem.end = (uint64_t)bootdata->global_mem_end;
@@ -83,7 +84,8 @@ void _snrt_init_team(uint32_t cluster_core_id, uint32_t cluster_core_num,
                      SPATZ_CLUSTER_PERIPHERAL_CL_CLINT_SET_REG_OFFSET);
 
     // Init allocator
-    // putc_buffer is a per-core array, reserve per core slot
-    snrt_alloc_init(team, cluster_core_num * sizeof(struct putc_buffer));
+    // putc_buffer is a per-core array shared by all clusters, reserve per core
+    // slot
+    snrt_alloc_init(team, team->global_core_num * sizeof(struct putc_buffer));
     snrt_int_init(team);
 }
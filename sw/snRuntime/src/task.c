@@ -0,0 +1,309 @@
+// Copyright 2021 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "task.h"
+
+#include "snrt.h"
+
+//================================================================================
+// Types
+//================================================================================
+
+typedef struct {
+    void (*fn)(void *);
+    void *arg;
+    // Children counter of the spawning task, decremented on completion
+    volatile uint32_t *join;
+} task_t;
+
+/**
+ * @brief Task queue of one core, following the THE protocol of Cilk-5: the
+ * owner pushes and pops at the tail without locking, thieves take the lock and
+ * steal from the head. The owner only takes the lock when it races a thief for
+ * the last task.
+ */
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t lock;
+    // Children of the core outside of any task
+    volatile uint32_t pending;
+    snrt_task_stats_t stats;
+    task_t tasks[SNRT_TASK_DEQUE_DEPTH];
+} task_deque_t;
+
+typedef struct {
+    uint32_t core_num;
+    volatile uint32_t exit_flag;
+    // Cluster-local cores asleep in snrt_task_worker, one bit per core
+    volatile uint32_t sleeping;
+    task_deque_t deques[];
+} task_pool_t;
+
+//================================================================================
+// data
+//================================================================================
+/**
+ * @brief Pointer to the task pool, initialized in snrt_task_init
+ *
+ */
+static __thread task_pool_t *pool;
+static __thread task_deque_t *own;
+static __thread uint32_t own_idx;
+
+/**
+ * @brief Children counter of the task the core is currently running
+ *
+ */
+static __thread volatile uint32_t *current_join;
+
+/**
+ * @brief Pointer to where the task pool in TCDM is located
+ *
+ */
+static task_pool_t *volatile pool_global;
+
+//================================================================================
+// prototypes
+//================================================================================
+static int push(task_deque_t *dq, const task_t *t);
+static int pop(task_deque_t *dq, task_t *t);
+static int steal(task_deque_t *dq, task_t *t);
+static int run_one(void);
+static int work_available(void);
+static void run(const task_t *t);
+static void wake_workers(uint32_t mask);
+static void worker_sleep(void);
+
+//================================================================================
+// public
+//================================================================================
+void snrt_task_init(void) {
+    own_idx = snrt_cluster_core_idx();
+    if (own_idx == 0) {
+        uint32_t core_num = snrt_cluster_core_num();
+        size_t size = sizeof(task_pool_t) + core_num * sizeof(task_deque_t);
+        // Allocate the queues in L1 so the AMOs stay in the TCDM
+        pool = snrt_l1alloc(size);
+        snrt_memset(pool, 0, size);
+        pool->core_num = core_num;
+        // store copy of pool on shared memory
+        pool_global = pool;
+    } else {
+        while (!pool_global)
+            ;
+        pool = pool_global;
+    }
+    own = &pool->deques[own_idx];
+    current_join = &own->pending;
+}
+
+void snrt_task_worker(void) {
+    uint32_t idle = 0;
+
+    // wake from wfi on the cluster interrupt
+    snrt_interrupt_enable(IRQ_M_CLUSTER);
+
+    while (!pool->exit_flag) {
+        if (run_one()) {
+            idle = 0;
+        } else if (++idle >= SNRT_TASK_IDLE_ROUNDS) {
+            worker_sleep();
+            idle = 0;
+        }
+    }
+
+    snrt_interrupt_disable(IRQ_M_CLUSTER);
+}
+
+void snrt_task_exit(void) {
+    snrt_task_wait();
+    pool->exit_flag = 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    wake_workers(~(1u << own_idx));
+}
+
+void snrt_task_spawn(void (*fn)(void *), void *arg) {
+    task_t t = {fn, arg, current_join};
+
+    __atomic_add_fetch(t.join, 1, __ATOMIC_RELAXED);
+    if (!push(own, &t)) {
+        // queue is full, run the task right away
+        own->stats.inlined++;
+        run(&t);
+        return;
+    }
+
+    // make the task visible before looking for sleeping workers, pairs with
+    // the fence in worker_sleep
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t sleeping = pool->sleeping;
+    if (sleeping) wake_workers(sleeping);
+}
+
+void snrt_task_wait(void) {
+    volatile uint32_t *join = current_join;
+    while (__atomic_load_n(join, __ATOMIC_ACQUIRE)) run_one();
+}
+
+unsigned snrt_task_bootstrap(uint32_t core_idx) {
+    snrt_task_init();
+    if (core_idx == 0) return 0;
+    snrt_task_worker();
+    return 1;
+}
+
+void snrt_task_get_stats(uint32_t core_idx, snrt_task_stats_t *stats) {
+    *stats = pool->deques[core_idx].stats;
+}
+
+void snrt_task_reset_stats(void) {
+    for (uint32_t i = 0; i < pool->core_num; i++)
+        snrt_memset(&pool->deques[i].stats, 0, sizeof(snrt_task_stats_t));
+}
+
+//================================================================================
+// private
+//================================================================================
+
+/**
+ * @brief Append a task at the tail, owner only. One slot stays free so a
+ * thief that already advanced the head can still read its task.
+ */
+static int push(task_deque_t *dq, const task_t *t) {
+    uint32_t tail = dq->tail;
+    if ((int32_t)(tail - dq->head) >= SNRT_TASK_DEQUE_DEPTH - 1) return 0;
+    dq->tasks[tail % SNRT_TASK_DEQUE_DEPTH] = *t;
+    __atomic_store_n(&dq->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * @brief Take the newest task from the tail, owner only
+ */
+static int pop(task_deque_t *dq, task_t *t) {
+    // thieves only ever shrink the queue
+    if ((int32_t)(dq->tail - dq->head) <= 0) return 0;
+    uint32_t tail = dq->tail - 1;
+    dq->tail = tail;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if ((int32_t)(dq->head - tail) > 0) {
+        // raced a thief for the last task, settle it under the lock
+        dq->tail = tail + 1;
+        snrt_mutex_lock(&dq->lock);
+        tail = dq->tail - 1;
+        dq->tail = tail;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if ((int32_t)(dq->head - tail) > 0) {
+            dq->tail = tail + 1;
+            snrt_mutex_release(&dq->lock);
+            return 0;
+        }
+        snrt_mutex_release(&dq->lock);
+    }
+    *t = dq->tasks[tail % SNRT_TASK_DEQUE_DEPTH];
+    return 1;
+}
+
+/**
+ * @brief Take the oldest task from the head of another core's queue
+ */
+static int steal(task_deque_t *dq, task_t *t) {
+    if ((int32_t)(dq->tail - dq->head) <= 0) return 0;
+    // skip the queue if another thief is at it
+    if (__atomic_exchange_n(&dq->lock, 1, __ATOMIC_ACQUIRE)) return 0;
+    uint32_t head = dq->head;
+    dq->head = head + 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if ((int32_t)(head + 1 - dq->tail) > 0) {
+        dq->head = head;
+        snrt_mutex_release(&dq->lock);
+        return 0;
+    }
+    *t = dq->tasks[head % SNRT_TASK_DEQUE_DEPTH];
+    snrt_mutex_release(&dq->lock);
+    return 1;
+}
+
+/**
+ * @brief Run one task from the own queue or, failing that, from the first
+ * other core with queued work. Inside a task, only a child of that task is
+ * run. Any other task would nest on the stack, so a waiting core could pile
+ * up frames without bound.
+ */
+static int run_one(void) {
+    task_t t;
+    if (current_join != &own->pending) {
+        // the children of the current task were pushed last, above the tasks
+        // of its ancestors, and only the owner writes the tail
+        uint32_t tail = own->tail;
+        if ((int32_t)(tail - own->head) <= 0 ||
+            own->tasks[(tail - 1) % SNRT_TASK_DEQUE_DEPTH].join !=
+                current_join ||
+            !pop(own, &t))
+            return 0;
+        run(&t);
+        return 1;
+    }
+    if (pop(own, &t)) {
+        run(&t);
+        return 1;
+    }
+    uint32_t core_num = pool->core_num;
+    for (uint32_t i = 1; i < core_num; i++) {
+        uint32_t victim = own_idx + i;
+        if (victim >= core_num) victim -= core_num;
+        if (steal(&pool->deques[victim], &t)) {
+            own->stats.stolen++;
+            run(&t);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int work_available(void) {
+    for (uint32_t i = 0; i < pool->core_num; i++) {
+        task_deque_t *dq = &pool->deques[i];
+        if ((int32_t)(dq->tail - dq->head) > 0) return 1;
+    }
+    return 0;
+}
+
+static void run(const task_t *t) {
+    volatile uint32_t *parent = current_join;
+    volatile uint32_t children = 0;
+
+    own->stats.executed++;
+    current_join = &children;
+    t->fn(t->arg);
+    // the children counter lives on this stack frame
+    snrt_task_wait();
+    current_join = parent;
+
+    __atomic_add_fetch(t->join, -1, __ATOMIC_RELEASE);
+}
+
+static void wake_workers(uint32_t mask) {
+    // the cluster interrupt stays pending for cores that are about to sleep
+    if (pool->core_num < 32) mask &= (1u << pool->core_num) - 1;
+    snrt_int_cluster_set(mask);
+}
+
+/**
+ * @brief Sleep until a core spawns a task or the runtime exits
+ */
+static void worker_sleep(void) {
+    uint32_t mask = 1u << own_idx;
+
+    // announce the sleep before the last look for work, so a spawner either
+    // sees the bit or the worker sees the task
+    __atomic_fetch_or(&pool->sleeping, mask, __ATOMIC_SEQ_CST);
+    if (!work_available() && !pool->exit_flag) {
+        own->stats.sleeps++;
+        snrt_wfi();
+    }
+    snrt_int_cluster_clr(mask);
+    __atomic_fetch_and(&pool->sleeping, ~mask, __ATOMIC_RELAXED);
+}
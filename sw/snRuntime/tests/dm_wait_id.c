@@ -0,0 +1,88 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#include <dm.h>
+#include <snrt.h>
+
+#define CHUNK_WORDS 32
+#define CHUNKS 40
+// Transfers in flight while double buffering
+#define BUFFERS 8
+// More transfers than fit in the DM queue of a core (16)
+#define BURST 24
+
+// Source chunks in main memory
+static uint32_t src[CHUNKS][CHUNK_WORDS] __attribute__((aligned(8)));
+
+static volatile uint32_t errors;
+
+// Stream all chunks through the TCDM buffers, refilling each buffer as soon
+// as dm_wait_id says its transfer completed
+static void double_buffer(uint32_t *buf) {
+    dm_handle_t h[BUFFERS];
+
+    for (uint32_t i = 0; i < BUFFERS; i++)
+        h[i] = dm_memcpy_async(&buf[i * CHUNK_WORDS], src[i], sizeof(src[i]));
+    dm_start();
+
+    for (uint32_t i = 0; i < CHUNKS; i++) {
+        uint32_t b = i % BUFFERS;
+        dm_wait_id(h[b]);
+        for (uint32_t j = 0; j < CHUNK_WORDS; j++)
+            errors += buf[b * CHUNK_WORDS + j] != src[i][j];
+        if (i + BUFFERS < CHUNKS) {
+            h[b] = dm_memcpy_async(&buf[b * CHUNK_WORDS], src[i + BUFFERS],
+                                   sizeof(src[i]));
+            dm_start();
+        }
+    }
+}
+
+// Queue more transfers than the queue holds, so queueing blocks until the DM
+// core issued the oldest ones and their slots are reused
+static void burst(uint32_t *buf) {
+    dm_handle_t h[BURST];
+
+    for (uint32_t i = 0; i < BURST; i++) {
+        h[i] = dm_memcpy_async(&buf[2 * i], &src[i][0], 2 * sizeof(uint32_t));
+        errors += h[i].core != snrt_cluster_core_idx();
+        errors += i && h[i].seq != h[i - 1].seq + 1;
+    }
+
+    // The slot of the first transfer was reused, its handle waits for the
+    // newer transfer instead
+    dm_wait_id(h[0]);
+    dm_wait_id(h[BURST - 1]);
+    for (uint32_t i = 0; i < BURST; i++)
+        errors += buf[2 * i] != src[i][0] || buf[2 * i + 1] != src[i][1];
+}
+
+int main() {
+    uint32_t core_idx = snrt_cluster_core_idx();
+
+    dm_init();
+    snrt_cluster_hw_barrier();
+
+    // The DM core serves the queues until the test is done
+    if (snrt_is_dm_core()) {
+        dm_main();
+        return errors;
+    }
+    if (core_idx != 1) return 0;
+
+    for (uint32_t i = 0; i < CHUNKS; i++)
+        for (uint32_t j = 0; j < CHUNK_WORDS; j++)
+            src[i][j] = i * CHUNK_WORDS + j + 1;
+    // The DMA reads the chunks from main memory
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    uint32_t *buf = snrt_l1alloc(BUFFERS * sizeof(src[0]));
+    for (uint32_t i = 0; i < BUFFERS * CHUNK_WORDS; i++) buf[i] = 0;
+    double_buffer(buf);
+
+    for (uint32_t i = 0; i < 2 * BURST; i++) buf[i] = 0;
+    burst(buf);
+
+    dm_exit();
+    return 0;
+}
@@ -0,0 +1,28 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#include <snrt.h>
+
+// Shared by all clusters in the main memory.
+static volatile uint32_t arrived;
+static volatile uint32_t slots[64];
+
+int main() {
+    uint32_t core_idx = snrt_global_core_idx();
+    uint32_t core_num = snrt_global_core_num();
+    uint32_t errors = 0;
+
+    // Every core of every cluster checks in, and the global barrier must only
+    // release them once all of them did.
+    __atomic_add_fetch(&arrived, 1, __ATOMIC_RELAXED);
+    if (core_idx < 64) slots[core_idx] = snrt_cluster_idx() + 1;
+    snrt_global_barrier();
+    if (arrived != core_num) errors++;
+
+    // Each core sees the check-in of the cores of the other clusters.
+    uint32_t other = (core_idx + snrt_cluster_core_num()) % core_num;
+    if (other < 64 && slots[other] != other / snrt_cluster_core_num() + 1)
+        errors++;
+
+    return errors;
+}
@@ -0,0 +1,50 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#include <snrt.h>
+#include <task.h>
+
+static volatile uint32_t sum;
+
+static void add(void *arg) {
+    __atomic_add_fetch(&sum, (uint32_t)arg, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+    uint32_t n;
+    uint32_t res;
+} fib_t;
+
+// Nested tasks, each waiting on its two children
+static void fib(void *arg) {
+    fib_t *f = arg;
+    if (f->n < 2) {
+        f->res = f->n;
+        return;
+    }
+    fib_t a = {f->n - 1, 0}, b = {f->n - 2, 0};
+    snrt_task_spawn(fib, &a);
+    snrt_task_spawn(fib, &b);
+    snrt_task_wait();
+    f->res = a.res + b.res;
+}
+
+int main() {
+    uint32_t core_idx = snrt_cluster_core_idx();
+    uint32_t errors = 0;
+
+    __snrt_task_bootstrap(core_idx);
+
+    // More tasks than fit in a queue, the overflow runs in place
+    for (uint32_t i = 1; i <= 100; i++) snrt_task_spawn(add, (void *)i);
+    snrt_task_wait();
+    if (sum != 5050) errors++;
+
+    fib_t f = {12, 0};
+    snrt_task_spawn(fib, &f);
+    snrt_task_wait();
+    if (f.res != 144) errors++;
+
+    __snrt_task_destroy(core_idx);
+    return errors;
+}
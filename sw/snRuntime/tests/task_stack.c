@@ -0,0 +1,73 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#include <snrt.h>
+#include <task.h>
+
+#define MAX_CORES 32
+#define OUTER_TASKS 64
+#define LEAF_TASKS 4
+
+extern const uint32_t snrt_stack_size;
+extern char __tdata_start[], __tdata_end[], __tbss_start[], __tbss_end[];
+
+// Tasks nested on each core and the lowest stack pointer seen in a task
+static __thread uint32_t depth;
+static volatile uint32_t max_depth[MAX_CORES];
+static volatile uint32_t min_sp[MAX_CORES];
+static volatile uint32_t sum;
+
+static void enter(void) {
+    uint32_t core_idx = snrt_cluster_core_idx();
+    uint32_t sp;
+    asm volatile("mv %0, sp" : "=r"(sp));
+    if (++depth > max_depth[core_idx]) max_depth[core_idx] = depth;
+    if (!min_sp[core_idx] || sp < min_sp[core_idx]) min_sp[core_idx] = sp;
+}
+
+static void leaf(void *arg) {
+    enter();
+    // Long enough for idle cores to steal the siblings
+    for (volatile uint32_t i = 0; i < 50; i++)
+        ;
+    __atomic_add_fetch(&sum, (uint32_t)arg, __ATOMIC_RELAXED);
+    depth--;
+}
+
+// Waits on children that other cores may have stolen, while unrelated
+// outer tasks are still queued
+static void outer(void *arg) {
+    enter();
+    for (uint32_t i = 0; i < LEAF_TASKS; i++) snrt_task_spawn(leaf, arg);
+    snrt_task_wait();
+    depth--;
+}
+
+int main() {
+    uint32_t core_idx = snrt_cluster_core_idx();
+    uint32_t core_num = snrt_cluster_core_num();
+    uint32_t errors = 0;
+
+    __snrt_task_bootstrap(core_idx);
+
+    for (uint32_t i = 1; i <= OUTER_TASKS; i++)
+        snrt_task_spawn(outer, (void *)i);
+    snrt_task_wait();
+    if (sum != LEAF_TASKS * OUTER_TASKS * (OUTER_TASKS + 1) / 2) errors++;
+
+    // A core nests at most an outer task and one of its leaves, and stays
+    // within its stack. The thread-local storage sits at the top of the stack.
+    uint32_t tp;
+    asm volatile("mv %0, tp" : "=r"(tp));
+    uint32_t tls = (__tdata_end - __tdata_start) + (__tbss_end - __tbss_start);
+    uint32_t stack = (1u << snrt_stack_size) - tls;
+    for (uint32_t i = 0; i < core_num && i < MAX_CORES; i++) {
+        if (max_depth[i] > 2) errors++;
+        // Stacks of higher cores lie below, 8 B apart to spread the banks
+        uint32_t top = tp - i * ((1u << snrt_stack_size) + 8);
+        if (min_sp[i] && top - min_sp[i] >= stack) errors++;
+    }
+
+    __snrt_task_destroy(core_idx);
+    return errors;
+}
@@ -0,0 +1,173 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Cycles of the runtime's copy and fill routines against a byte loop, over
+// sizes and source/destination alignments within the TCDM, and of copies
+// between the main memory and the TCDM. Those go through the cluster DMA from
+// 2 KiB on when the DM core copies, and word by word otherwise.
+
+#include <benchmark.h>
+#include <debug.h>
+#include <snrt.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_SIZE 4096
+
+static const uint32_t sizes[] = {16, 64, 256, 1024, 4096};
+static const uint32_t l3_sizes[] = {128, 512, 1024, 2048, 4096};
+
+// Placed in the main memory
+static uint8_t l3_buf[MAX_SIZE];
+
+static uint8_t *src, *dst;
+
+static void byte_copy(uint8_t *d, const uint8_t *s, uint32_t n) {
+  volatile uint8_t *vd = d;
+  for (uint32_t i = 0; i < n; i++)
+    vd[i] = s[i];
+}
+
+static void fill(uint8_t *p, uint32_t n, uint32_t seed) {
+  for (uint32_t i = 0; i < n; i++)
+    p[i] = (uint8_t)(i * 7 + seed);
+}
+
+static int check(const uint8_t *p, uint32_t n, uint32_t seed) {
+  for (uint32_t i = 0; i < n; i++)
+    if (p[i] != (uint8_t)(i * 7 + seed))
+      return 1;
+  return 0;
+}
+
+static int check_set(const uint8_t *p, uint32_t n, uint8_t c) {
+  for (uint32_t i = 0; i < n; i++)
+    if (p[i] != c)
+      return 1;
+  return 0;
+}
+
+// Copies between the main memory and the TCDM, in both directions
+static int l3_rows(unsigned int cid) {
+  int errors = 0;
+
+  for (unsigned s = 0; s < sizeof(l3_sizes) / sizeof(l3_sizes[0]); s++) {
+    uint32_t n = l3_sizes[s];
+    for (uint32_t to_l3 = 0; to_l3 < 2; to_l3++) {
+      uint8_t *d = to_l3 ? l3_buf : dst;
+      uint8_t *a = to_l3 ? src : l3_buf;
+      uint32_t seed = n + to_l3;
+      fill(a, n, seed);
+
+      uint32_t start = benchmark_get_cycle();
+      byte_copy(d, a, n);
+      uint32_t t_byte = benchmark_get_cycle() - start;
+      errors += check(d, n, seed);
+
+      start = benchmark_get_cycle();
+      memcpy(d, a, n);
+      uint32_t t_libc = benchmark_get_cycle() - start;
+      errors += check(d, n, seed);
+
+      start = benchmark_get_cycle();
+      snrt_memcpy(d, a, n);
+      uint32_t t_snrt = benchmark_get_cycle() - start;
+      errors += check(d, n, seed);
+
+      PRINTF("%4d %6d %4s %8d %8d %8d\n", cid, n, to_l3 ? "out" : "in",
+             t_byte, t_libc, t_snrt);
+    }
+  }
+
+  return errors;
+}
+
+int main() {
+  const unsigned int cid = snrt_cluster_core_idx();
+  int errors = 0;
+
+  if (cid == 0) {
+    src = (uint8_t *)snrt_l1alloc(MAX_SIZE + 8);
+    dst = (uint8_t *)snrt_l1alloc(MAX_SIZE + 8);
+  }
+  snrt_cluster_hw_barrier();
+
+  // The routines run on a single core
+  if (cid == 0) {
+    PRINTF("\n----- memcpy (TCDM) -----\n");
+    PRINTF("%6s %4s %4s %8s %8s %8s %8s %8s\n", "size", "src", "dst",
+           "loop", "memcpy", "snrt", "memmove", "memset");
+
+    start_kernel();
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      uint32_t n = sizes[s];
+      for (uint32_t sa = 0; sa < 4; sa++) {
+        for (uint32_t da = 0; da < 4; da++) {
+          uint32_t seed = n + sa * 4 + da;
+          fill(src + sa, n, seed);
+
+          uint32_t start = benchmark_get_cycle();
+          byte_copy(dst + da, src + sa, n);
+          uint32_t t_byte = benchmark_get_cycle() - start;
+          errors += check(dst + da, n, seed);
+
+          start = benchmark_get_cycle();
+          memcpy(dst + da, src + sa, n);
+          uint32_t t_libc = benchmark_get_cycle() - start;
+          errors += check(dst + da, n, seed);
+
+          start = benchmark_get_cycle();
+          snrt_memcpy(dst + da, src + sa, n);
+          uint32_t t_snrt = benchmark_get_cycle() - start;
+          errors += check(dst + da, n, seed);
+
+          // Overlapping move up by a few bytes, copied from the end
+          fill(dst, n, seed);
+          start = benchmark_get_cycle();
+          snrt_memmove(dst + 1 + da, dst, n);
+          uint32_t t_move = benchmark_get_cycle() - start;
+          errors += check(dst + 1 + da, n, seed);
+
+          start = benchmark_get_cycle();
+          snrt_memset(dst + da, (int)seed, n);
+          uint32_t t_set = benchmark_get_cycle() - start;
+          errors += check_set(dst + da, n, (uint8_t)seed);
+
+          PRINTF("%6d %4d %4d %8d %8d %8d %8d %8d\n", n, sa, da, t_byte, t_libc,
+                 t_snrt, t_move, t_set);
+        }
+      }
+    }
+
+    PRINTF("\n----- memcpy (L3 <-> TCDM) -----\n");
+    PRINTF("%4s %6s %4s %8s %8s %8s\n", "core", "size", "dir", "loop",
+           "memcpy", "snrt");
+    errors += l3_rows(cid);
+    stop_kernel();
+  }
+  snrt_cluster_hw_barrier();
+
+  // The same copies from a core without the DMA
+  if (cid == 1)
+    errors += l3_rows(cid);
+  snrt_cluster_hw_barrier();
+
+  if (errors)
+    PRINTF("core %d: %d errors\n", cid, errors);
+
+  return errors;
+}
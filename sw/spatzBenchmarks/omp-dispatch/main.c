@@ -0,0 +1,134 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Overhead of handing out the chunks of a dynamically scheduled OpenMP loop,
+// per schedule and number of threads. The loop body is empty, so the time
+// spent in a loop beyond an empty one is the cost of the chunk requests.
+
+#include <benchmark.h>
+#include <debug.h>
+#include <dm.h>
+#include <omp.h>
+#include <snrt.h>
+#include <stdio.h>
+
+#define ITERATIONS 256
+#define REPETITIONS 4
+
+typedef struct {
+  const char *name;
+  enum sched_type sched;
+  kmp_int32 chunk;
+  int locked;
+} schedule_t;
+
+static const schedule_t schedules[] = {
+    {"dynamic,1", kmp_sch_dynamic_chunked, 1, 0},
+    {"dynamic,4", kmp_sch_dynamic_chunked, 4, 0},
+    {"nonmonotonic,1",
+     (enum sched_type)(kmp_sch_dynamic_chunked | kmp_sch_modifier_nonmonotonic),
+     1, 0},
+    {"guided,1", kmp_sch_guided_chunked, 1, 0},
+    // The old runtime: every chunk request takes a spin lock
+    {"locked,1", kmp_sch_dynamic_chunked, 1, 1},
+};
+
+static const schedule_t *volatile current;
+static volatile kmp_int32 iterations;
+static uint32_t chunks[16];
+
+static uint32_t lock;
+static volatile kmp_int32 locked_next;
+
+static void loop_task(void *data, uint32_t argc) {
+  (void)data;
+  (void)argc;
+  unsigned tid = omp_get_thread_num();
+  kmp_int32 last, lb, ub, st;
+
+  if (current->locked) {
+    // Claim chunks behind a lock, like the runtime did before
+    while (1) {
+      snrt_mutex_lock(&lock);
+      lb = locked_next;
+      locked_next = lb + current->chunk;
+      snrt_mutex_release(&lock);
+      if (lb >= iterations)
+        break;
+      chunks[tid]++;
+    }
+    return;
+  }
+
+  __kmpc_dispatch_init_4(NULL, tid, current->sched, 0, iterations - 1, 1,
+                         current->chunk);
+  while (__kmpc_dispatch_next_4(NULL, tid, &last, &lb, &ub, &st))
+    chunks[tid]++;
+}
+
+// Best time of a loop over `n` iterations on `nthreads` threads
+static uint32_t run(const schedule_t *s, kmp_int32 n, uint32_t nthreads,
+                    uint32_t *nchunks) {
+  uint32_t best = (uint32_t)-1;
+  current = s;
+  iterations = n;
+  for (int r = 0; r < REPETITIONS; r++) {
+    locked_next = 0;
+    for (unsigned i = 0; i < nthreads; i++)
+      chunks[i] = 0;
+    uint32_t start = benchmark_get_cycle();
+    parallelRegion(0, NULL, loop_task, nthreads);
+    uint32_t cycles = benchmark_get_cycle() - start;
+    if (cycles < best)
+      best = cycles;
+  }
+  *nchunks = 0;
+  for (unsigned i = 0; i < nthreads; i++)
+    *nchunks += chunks[i];
+  return best;
+}
+
+int main() {
+  const unsigned int cid = snrt_cluster_core_idx();
+  __snrt_omp_bootstrap(cid);
+
+  const unsigned int num_cores = snrt_cluster_core_num();
+  const unsigned int max_threads = num_cores < 16 ? num_cores : 16;
+  int errors = 0;
+
+  PRINTF("\n----- OpenMP chunk overhead (%d iterations) -----\n", ITERATIONS);
+  PRINTF("%-16s %8s %8s %8s %14s\n", "schedule", "threads", "chunks",
+         "cycles", "cycles/chunk");
+
+  start_kernel();
+  for (unsigned s = 0; s < sizeof(schedules) / sizeof(schedules[0]); s++) {
+    for (unsigned t = 1; t <= max_threads; t++) {
+      uint32_t empty_chunks, nchunks;
+      uint32_t empty = run(&schedules[s], 0, t, &empty_chunks);
+      uint32_t cycles = run(&schedules[s], ITERATIONS, t, &nchunks);
+      // Chunks run in parallel on all threads
+      uint32_t per_chunk =
+          nchunks ? (cycles > empty ? cycles - empty : 0) * t / nchunks : 0;
+      PRINTF("%-16s %8d %8d %8d %14d\n", schedules[s].name, t, nchunks,
+             cycles, per_chunk);
+      errors += empty_chunks != 0 || nchunks == 0;
+    }
+  }
+  stop_kernel();
+
+  __snrt_omp_destroy(cid);
+  return errors;
+}
@@ -0,0 +1,96 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Cost of back-to-back parallel regions. Each region is joined before the next
+// one is forked, or all of them are forked with parallelRegionNowait and joined
+// once, so the master forks region N+1 while the workers finish region N.
+
+#include <benchmark.h>
+#include <debug.h>
+#include <dm.h>
+#include <omp.h>
+#include <snrt.h>
+#include <stdio.h>
+
+#define REGIONS 64
+#define REPETITIONS 4
+
+static volatile uint32_t work = 0;
+static uint32_t ran[16];
+
+static void region(void *data, uint32_t argc) {
+  (void)data;
+  (void)argc;
+  for (uint32_t i = 0; i < work; i++)
+    asm volatile("nop");
+  ran[omp_get_thread_num()]++;
+}
+
+// Best time of REGIONS back-to-back regions on `nthreads` threads
+static uint32_t run(uint32_t nthreads, int nowait) {
+  uint32_t best = (uint32_t)-1;
+  for (int r = 0; r < REPETITIONS; r++) {
+    uint32_t start = benchmark_get_cycle();
+    for (int i = 0; i < REGIONS; i++) {
+      if (nowait)
+        parallelRegionNowait(0, NULL, region, nthreads);
+      else
+        parallelRegion(0, NULL, region, nthreads);
+    }
+    if (nowait)
+      parallelRegionJoin();
+    uint32_t cycles = benchmark_get_cycle() - start;
+    if (cycles < best)
+      best = cycles;
+  }
+  return best;
+}
+
+int main() {
+  const unsigned int cid = snrt_cluster_core_idx();
+  __snrt_omp_bootstrap(cid);
+
+  const unsigned int num_cores = snrt_cluster_core_num();
+  const unsigned int max_threads = num_cores < 16 ? num_cores : 16;
+  int errors = 0;
+
+  PRINTF("\n----- OpenMP back-to-back regions (%d regions) -----\n", REGIONS);
+  PRINTF("%8s %8s %14s %14s\n", "threads", "work", "joined/region",
+         "nowait/region");
+
+  start_kernel();
+  for (unsigned t = 2; t <= max_threads; t++) {
+    for (work = 0; work <= 256; work += 128) {
+      for (unsigned i = 0; i < t; i++)
+        ran[i] = 0;
+      uint32_t joined = run(t, 0);
+      uint32_t nowait = run(t, 1);
+      PRINTF("%8d %8d %14d %14d\n", t, work, joined / REGIONS,
+             nowait / REGIONS);
+      for (unsigned i = 0; i < t; i++)
+        errors += ran[i] != 2 * REPETITIONS * REGIONS;
+    }
+  }
+  stop_kernel();
+
+#ifdef OPENMP_PROFILE
+  omp_print_prof();
+#endif
+
+  __snrt_omp_destroy(cid);
+  return errors;
+}
@@ -0,0 +1,171 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Sparse matrix-vector product with a skewed row length distribution, split
+// statically across the cores and as tasks on the work-stealing runtime. The
+// first rows of the matrix are much denser than the rest, as in the pruned
+// layers the sparse kernels run on, so an even split of the rows leaves the
+// first core with most of the work.
+
+#include <benchmark.h>
+#include <debug.h>
+#include <snrt.h>
+#include <stdio.h>
+#include <task.h>
+
+#define ROWS 128
+#define COLS 128
+#define HEAVY_ROWS 32
+#define HEAVY_NNZ 96
+#define LIGHT_NNZ 16
+
+typedef struct {
+  uint32_t first;
+  uint32_t last;
+} block_t;
+
+static uint32_t *row_ptr;
+static uint16_t *col_idx;
+static float *val;
+static float *x;
+static float *y;
+static float *golden;
+
+static block_t blocks[ROWS];
+
+static void spmv_rows(uint32_t first, uint32_t last) {
+  for (uint32_t r = first; r < last; r++) {
+    float acc = 0;
+    for (uint32_t k = row_ptr[r]; k < row_ptr[r + 1]; k++)
+      acc += val[k] * x[col_idx[k]];
+    y[r] = acc;
+  }
+}
+
+static void spmv_task(void *arg) {
+  block_t *b = arg;
+  spmv_rows(b->first, b->last);
+}
+
+// Small integer values keep the sums exact in any order
+static void init_matrix(void) {
+  uint32_t seed = 42, nnz = 0;
+  for (uint32_t r = 0; r < ROWS; r++) {
+    row_ptr[r] = nnz;
+    uint32_t n = r < HEAVY_ROWS ? HEAVY_NNZ : LIGHT_NNZ;
+    for (uint32_t k = 0; k < n; k++, nnz++) {
+      seed = seed * 1664525 + 1013904223;
+      col_idx[nnz] = (seed >> 8) % COLS;
+      val[nnz] = (float)((int)((seed >> 20) % 7) - 3);
+    }
+  }
+  row_ptr[ROWS] = nnz;
+  for (uint32_t c = 0; c < COLS; c++)
+    x[c] = (float)((int)(c % 5) - 2);
+}
+
+static int check(void) {
+  int errors = 0;
+  for (uint32_t r = 0; r < ROWS; r++) {
+    errors += y[r] != golden[r];
+    y[r] = 0;
+  }
+  return errors;
+}
+
+int main() {
+  const unsigned int cid = snrt_cluster_core_idx();
+  const unsigned int num_cores = snrt_cluster_core_num();
+  const uint32_t nnz =
+      HEAVY_ROWS * HEAVY_NNZ + (ROWS - HEAVY_ROWS) * LIGHT_NNZ;
+  int errors = 0;
+
+  if (cid == 0) {
+    row_ptr = (uint32_t *)snrt_l1alloc((ROWS + 1) * sizeof(uint32_t));
+    col_idx = (uint16_t *)snrt_l1alloc(nnz * sizeof(uint16_t));
+    val = (float *)snrt_l1alloc(nnz * sizeof(float));
+    x = (float *)snrt_l1alloc(COLS * sizeof(float));
+    y = (float *)snrt_l1alloc(ROWS * sizeof(float));
+    golden = (float *)snrt_l1alloc(ROWS * sizeof(float));
+    init_matrix();
+  }
+
+  snrt_cluster_hw_barrier();
+
+  // Single core reference
+  uint32_t serial = 0;
+  if (cid == 0) {
+    serial = benchmark_get_cycle();
+    spmv_rows(0, ROWS);
+    serial = benchmark_get_cycle() - serial;
+    for (uint32_t r = 0; r < ROWS; r++)
+      golden[r] = y[r];
+    check();
+    start_kernel();
+  }
+
+  // Static partitioning, an even share of the rows per core
+  snrt_cluster_hw_barrier();
+  uint32_t cycles = benchmark_get_cycle();
+  spmv_rows(cid * ROWS / num_cores, (cid + 1) * ROWS / num_cores);
+  snrt_cluster_hw_barrier();
+  cycles = benchmark_get_cycle() - cycles;
+
+  if (cid == 0) {
+    errors += check();
+    PRINTF("\n----- (%dx%d, %d nnz) SpMV - tasks vs static -----\n", ROWS,
+           COLS, nnz);
+    PRINTF("%-12s %8s %8s %10s\n", "split", "tasks", "cycles", "speedup");
+    PRINTF("%-12s %8d %8d %10d%%\n", "serial", 0, serial, 100);
+    PRINTF("%-12s %8d %8d %10d%%\n", "static", num_cores, cycles,
+           serial * 100 / cycles);
+  }
+
+  // The other cores steal the row blocks spawned by core 0
+  __snrt_task_bootstrap(cid);
+
+  for (uint32_t rows = 16; rows >= 1; rows /= 4) {
+    uint32_t ntasks = ROWS / rows;
+    for (uint32_t b = 0; b < ntasks; b++) {
+      blocks[b].first = b * rows;
+      blocks[b].last = (b + 1) * rows;
+    }
+    snrt_task_reset_stats();
+
+    cycles = benchmark_get_cycle();
+    for (uint32_t b = 0; b < ntasks; b++)
+      snrt_task_spawn(spmv_task, &blocks[b]);
+    snrt_task_wait();
+    cycles = benchmark_get_cycle() - cycles;
+
+    errors += check();
+    PRINTF("%-9s%3d %8d %8d %10d%%\n", "tasks of", rows, ntasks, cycles,
+           serial * 100 / cycles);
+    for (unsigned c = 0; c < num_cores; c++) {
+      snrt_task_stats_t s;
+      snrt_task_get_stats(c, &s);
+      PRINTF("  core %2d: %4d executed, %4d stolen, %4d inlined\n", c,
+             s.executed, s.stolen, s.inlined);
+    }
+  }
+
+  stop_kernel();
+  if (errors)
+    PRINTF("WRONG! %d errors\n", errors);
+
+  __snrt_task_destroy(cid);
+  return errors;
+}
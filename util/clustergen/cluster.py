@@ -392,10 +392,14 @@ class SnitchClusterTB(Generator):
             self.cfg["dram"]["length"],
             self.cfg["cluster"]["addr_width"],
         )
+        # Several clusters share the hart and address space, each one needs
+        # its own base hart ID and base address.
         if "tie_ports" not in self.cfg["cluster"]:
-            self.cfg["cluster"]["tie_ports"] = True
+            self.cfg["cluster"]["tie_ports"] = self.cfg["nr_clusters"] == 1
         # Store Snitch cluster config in separate variable
         self.cluster = SnitchCluster(cfg["cluster"], pma_cfg)
+        if self.cfg["nr_clusters"] > 1 and self.multi_cluster_validate():
+            exit("Failed multi-cluster parameter validation.")
 
     def render_wrapper(self):
         return self.cluster.render_wrapper()
@@ -404,7 +408,38 @@ class SnitchClusterTB(Generator):
         return self.cluster.render_spatzpkg()
 
     def render_testbench(self):
-        return self.cluster.render_testbench()
+        if self.cfg["nr_clusters"] == 1:
+            return self.cluster.render_testbench()
+        cfg_template = self.templates.get_template("tb/testbench_multi.sv.tpl")
+        return cfg_template.render_unicode(
+            cfg=self.cluster.cfg,
+            tb=self.cfg,
+            to_sv_hex=to_sv_hex,
+            disclaimer=self.DISCLAIMER,
+        )
+
+    def multi_cluster_validate(self):
+        """Check that the clusters of a multi-cluster testbench fit side by side."""
+        cluster = self.cluster.cfg
+        tcdm_size = cluster["tcdm"]["size"] * 1024
+        region = tcdm_size + cluster["cluster_periph_size"] * 1024
+        offset = cluster["cluster_base_offset"]
+        if cluster["axi_cdc_enable"]:
+            log.error("The multi-cluster testbench does not support `axi_cdc_enable`.")
+        elif cluster["tie_ports"]:
+            log.error("The clusters of a multi-cluster testbench need `tie_ports: false`.")
+        elif offset < region or offset % tcdm_size:
+            log.error(
+                "`cluster_base_offset` must be a multiple of the TCDM size and "
+                "cover the TCDM and peripherals ({:#x} bytes).".format(region)
+            )
+        elif cluster["cluster_base_hartid"] + self.cfg["nr_clusters"] * cluster[
+            "nr_cores"
+        ] > 2**10:
+            log.error("The clusters need more than 10 bits of hart IDs.")
+        else:
+            return False
+        return True
 
     def render_linker_script(self):
         """Generate a linker script for the cluster testbench"""
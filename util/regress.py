@@ -0,0 +1,391 @@
+#!/usr/bin/env python3
+# Copyright 2020 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Build the Verilator model and the test binaries of several cluster
+# configurations, run all binaries of all configurations in parallel, and
+# collect their cycle counts, utilization and (optionally) the trace
+# performance metrics in a SQLite database. Results can be stored as a
+# baseline and later runs compared against it.
+
+import argparse
+import concurrent.futures
+import hashlib
+import json
+import os
+import pathlib
+import re
+import shutil
+import sqlite3
+import subprocess
+import sys
+import time
+
+SPATZ_DIR = pathlib.Path(__file__).resolve().parent.parent
+CLUSTER_DIR = SPATZ_DIR / "hw" / "system" / "spatz_cluster"
+CFG_DIR = CLUSTER_DIR / "cfg"
+
+# `PRINTF` lines of the benchmarks.
+CYCLES_REGEX = re.compile(r"The (.+?) (?:took|takes) (\d+) cycles")
+PERF_REGEX = re.compile(
+    r"The performance is (-?\d+) OP/1000cycle \((-?\d+)%o utilization\)"
+)
+EXIT_REGEX = re.compile(r"\[FAILURE\] Finished with exit code\s*(-?\d+)")
+
+# Metrics where a larger value is a regression, and where a smaller one is.
+LOWER_IS_BETTER = re.compile(r"(^|[._])cycles$")
+HIGHER_IS_BETTER = re.compile(r"(^|[._])(performance|utilization|total_ipc)$")
+
+SCHEMA = """
+CREATE TABLE IF NOT EXISTS runs (
+    id INTEGER PRIMARY KEY,
+    session TEXT,
+    git_rev TEXT,
+    config TEXT,
+    binary TEXT,
+    status TEXT,
+    exit_code INTEGER,
+    seconds REAL
+);
+CREATE TABLE IF NOT EXISTS metrics (
+    run_id INTEGER REFERENCES runs(id),
+    name TEXT,
+    value REAL
+);
+"""
+
+
+def config_file(name):
+    """Map a short configuration name (`default`, `mempool`, ...) to its file."""
+    if name.endswith(".hjson"):
+        return name
+    for suffix in ("dram", "l2"):
+        path = CFG_DIR / f"spatz_cluster.{name}.{suffix}.hjson"
+        if path.exists():
+            return path.name
+    sys.exit(f"Unknown configuration `{name}`")
+
+
+def all_configs():
+    return sorted(
+        p.name.split(".")[1] for p in CFG_DIR.glob("spatz_cluster.*.dram.hjson")
+    )
+
+
+def git_rev():
+    try:
+        return subprocess.run(
+            ["git", "-C", str(SPATZ_DIR), "describe", "--always", "--dirty"],
+            capture_output=True,
+            text=True,
+            check=True,
+        ).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def build_key(cfg):
+    """Identify a build by the configuration file and the source revision."""
+    digest = hashlib.sha1((CFG_DIR / cfg).read_bytes())
+    digest.update(git_rev().encode())
+    return digest.hexdigest()
+
+
+def build(name, outdir, make_args, rebuild):
+    """Build one configuration in the cluster directory and copy the simulator
+    and all test binaries to `outdir/name`. Builds share the cluster
+    directory, so they run one after the other; each one is parallel itself."""
+    cfg = config_file(name)
+    dest = outdir / name
+    stamp = dest / ".build"
+    key = build_key(cfg)
+    if not rebuild and stamp.exists() and stamp.read_text() == key:
+        print(f"[regress] {name}: up to date", flush=True)
+        return
+    print(f"[regress] {name}: building {cfg}", flush=True)
+    make = ["make", "-C", str(CLUSTER_DIR), f"SPATZ_CLUSTER_CFG={cfg}"] + make_args
+    log = outdir / f"build-{name}.log"
+    outdir.mkdir(parents=True, exist_ok=True)
+    with open(log, "w") as f:
+        # The generated sources and the model of the previous configuration
+        # are not tracked as dependencies of the configuration name.
+        for target in (["-B", "generate"], ["clean.vlt"], ["sw.vlt"]):
+            if subprocess.run(make + target, stdout=f, stderr=f).returncode:
+                sys.exit(f"[regress] {name}: build failed, see {log}")
+    if dest.exists():
+        shutil.rmtree(dest)
+    (dest / "bin").mkdir(parents=True)
+    shutil.copy2(CLUSTER_DIR / "bin" / "spatz_cluster.vlt", dest / "bin")
+    sw = CLUSTER_DIR / "sw" / "build"
+    for binary in sw.rglob("test-*"):
+        if binary.is_file() and os.access(binary, os.X_OK):
+            target = dest / "sw" / binary.relative_to(sw)
+            target.parent.mkdir(parents=True, exist_ok=True)
+            shutil.copy2(binary, target)
+    stamp.write_text(key)
+
+
+def parse_output(text):
+    metrics = {}
+    for what, cycles in CYCLES_REGEX.findall(text):
+        key = re.sub(r"\W+", "_", what.strip().lower()).strip("_")
+        metrics[f"{key}_cycles"] = int(cycles)
+    match = PERF_REGEX.search(text)
+    if match:
+        metrics["performance"] = int(match.group(1))
+        metrics["utilization"] = int(match.group(2))
+    return metrics
+
+
+def trace_metrics(rundir, dasm):
+    """Run `gen_trace.py` on all hart traces and return their per-section
+    performance metrics."""
+    metrics = {}
+    for trace in sorted((rundir / "logs").glob("trace_hart_*.dasm")):
+        hart = int(trace.stem.split("_")[-1])
+        perf = rundir / "logs" / f"{trace.stem}.json"
+        with open(trace) as f:
+            disasm = subprocess.Popen([dasm], stdin=f, stdout=subprocess.PIPE)
+            subprocess.run(
+                [sys.executable, str(SPATZ_DIR / "util" / "gen_trace.py"),
+                 "-p", "-d", str(perf)],
+                stdin=disasm.stdout,
+                stdout=subprocess.DEVNULL,
+                stderr=subprocess.DEVNULL,
+            )
+            disasm.wait()
+        if not perf.exists():
+            continue
+        for idx, section in enumerate(json.loads(perf.read_text())):
+            for key, value in section.items():
+                if isinstance(value, (int, float)):
+                    metrics[f"hart{hart}.s{idx}.{key}"] = value
+    return metrics
+
+
+def run(name, binary, outdir, sim_args, timeout, dasm):
+    """Run one binary in its own directory, so that the logs do not clash."""
+    dest = outdir / name
+    rundir = dest / "runs" / binary.name
+    if rundir.exists():
+        shutil.rmtree(rundir)
+    (rundir / "logs").mkdir(parents=True)
+    cmd = [str(dest / "bin" / "spatz_cluster.vlt"), str(binary)] + sim_args
+    t0 = time.monotonic()
+    try:
+        proc = subprocess.run(
+            cmd,
+            cwd=rundir,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.STDOUT,
+            text=True,
+            errors="replace",
+            timeout=timeout,
+        )
+        output, exit_code = proc.stdout, proc.returncode
+        status = "pass" if "[SUCCESS]" in output else "fail"
+        match = EXIT_REGEX.search(output)
+        if match:
+            exit_code = int(match.group(1))
+    except subprocess.TimeoutExpired as e:
+        output = e.stdout or ""
+        if isinstance(output, bytes):
+            output = output.decode(errors="replace")
+        status, exit_code = "timeout", None
+    seconds = time.monotonic() - t0
+    (rundir / "run.log").write_text(output)
+    metrics = parse_output(output)
+    if dasm:
+        metrics.update(trace_metrics(rundir, dasm))
+    return {
+        "config": name,
+        "binary": binary.name,
+        "status": status,
+        "exit_code": exit_code,
+        "seconds": seconds,
+        "metrics": metrics,
+    }
+
+
+def store(db, results, session):
+    con = sqlite3.connect(db)
+    con.executescript(SCHEMA)
+    rev = git_rev()
+    for r in results:
+        cur = con.execute(
+            "INSERT INTO runs (session, git_rev, config, binary, status, "
+            "exit_code, seconds) VALUES (?, ?, ?, ?, ?, ?, ?)",
+            (session, rev, r["config"], r["binary"], r["status"],
+             r["exit_code"], r["seconds"]),
+        )
+        con.executemany(
+            "INSERT INTO metrics (run_id, name, value) VALUES (?, ?, ?)",
+            [(cur.lastrowid, k, v) for k, v in r["metrics"].items()],
+        )
+    con.commit()
+    con.close()
+
+
+def baseline_of(results):
+    base = {}
+    for r in results:
+        base.setdefault(r["config"], {})[r["binary"]] = {
+            "status": r["status"],
+            "metrics": r["metrics"],
+        }
+    return base
+
+
+def compare(results, baseline, threshold):
+    """Return `(config, binary, metric, old, new)` for every regression of more
+    than `threshold` percent, and for every binary that no longer passes."""
+    regressions = []
+    for r in results:
+        old = baseline.get(r["config"], {}).get(r["binary"])
+        if old is None:
+            continue
+        if old["status"] == "pass" and r["status"] != "pass":
+            regressions.append(
+                (r["config"], r["binary"], "status", "pass", r["status"])
+            )
+        for key, new in r["metrics"].items():
+            prev = old["metrics"].get(key)
+            if not prev:
+                continue
+            change = 100.0 * (new - prev) / abs(prev)
+            if (LOWER_IS_BETTER.search(key) and change > threshold) or (
+                HIGHER_IS_BETTER.search(key) and change < -threshold
+            ):
+                regressions.append((r["config"], r["binary"], key, prev, new))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(prog="regress")
+    parser.add_argument(
+        "-c",
+        "--configs",
+        default=",".join(all_configs()),
+        help="Comma-separated configurations, e.g., `default,mempool` "
+        "(default: all `*.dram.hjson` configurations)",
+    )
+    parser.add_argument(
+        "-o",
+        "--outdir",
+        type=pathlib.Path,
+        default=CLUSTER_DIR / "regress",
+        help="Directory for the builds, the runs and the database",
+    )
+    parser.add_argument(
+        "-j",
+        "--jobs",
+        type=int,
+        default=os.cpu_count(),
+        help="Simulations to run in parallel (default: all host cores)",
+    )
+    parser.add_argument(
+        "-f", "--filter", default=".*", help="Only run binaries matching this regex"
+    )
+    parser.add_argument(
+        "-t", "--timeout", type=float, default=3600, help="Seconds per simulation"
+    )
+    parser.add_argument(
+        "--rebuild", action="store_true", help="Rebuild configurations up to date"
+    )
+    parser.add_argument(
+        "--no-build", action="store_true", help="Only run the existing builds"
+    )
+    parser.add_argument(
+        "--make-arg",
+        action="append",
+        default=[],
+        help="Extra argument for the builds, e.g., `PRINT=ON`",
+    )
+    parser.add_argument(
+        "--sim-arg",
+        action="append",
+        default=[],
+        help="Extra testbench argument, e.g., `--htif-policy=watch`",
+    )
+    parser.add_argument(
+        "--trace-metrics",
+        metavar="spike-dasm",
+        help="Collect the gen_trace.py metrics of all harts using this "
+        "spike-dasm; needs builds with `TRACE=ON`",
+    )
+    parser.add_argument(
+        "--db", type=pathlib.Path, help="SQLite database (default: outdir/results.db)"
+    )
+    parser.add_argument("--csv", type=pathlib.Path, help="Also write the results as CSV")
+    parser.add_argument(
+        "-b", "--baseline", type=pathlib.Path, help="Baseline to compare against"
+    )
+    parser.add_argument(
+        "--save-baseline", type=pathlib.Path, help="Store the results as baseline"
+    )
+    parser.add_argument(
+        "--threshold",
+        type=float,
+        default=2.0,
+        help="Flag metrics that got worse by more than this percentage",
+    )
+    args = parser.parse_args()
+
+    configs = [c for c in args.configs.split(",") if c]
+    outdir = args.outdir.resolve()
+    if not args.no_build:
+        for name in configs:
+            build(name, outdir, args.make_arg, args.rebuild)
+
+    pattern = re.compile(args.filter)
+    jobs = []
+    for name in configs:
+        binaries = sorted((outdir / name / "sw").rglob("test-*"))
+        jobs += [(name, b) for b in binaries if pattern.search(b.name)]
+    print(f"[regress] Running {len(jobs)} simulations on {args.jobs} cores",
+          flush=True)
+
+    results = []
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        futures = [
+            pool.submit(run, name, binary, outdir, args.sim_arg, args.timeout,
+                        args.trace_metrics)
+            for name, binary in jobs
+        ]
+        for future in concurrent.futures.as_completed(futures):
+            r = future.result()
+            results.append(r)
+            cycles = r["metrics"].get("execution_cycles", "-")
+            print(f"[regress] {r['status']:7} {r['config']:10} {r['binary']:40} "
+                  f"{cycles} cycles", flush=True)
+    results.sort(key=lambda r: (r["config"], r["binary"]))
+
+    session = time.strftime("%Y-%m-%dT%H:%M:%S")
+    store(args.db or outdir / "results.db", results, session)
+    if args.csv:
+        with open(args.csv, "w") as f:
+            f.write("config,binary,status,exit_code,seconds,metric,value\n")
+            for r in results:
+                head = (f"{r['config']},{r['binary']},{r['status']},"
+                        f"{'' if r['exit_code'] is None else r['exit_code']},"
+                        f"{r['seconds']:.3f}")
+                for key, value in r["metrics"].items() or [("", "")]:
+                    f.write(f"{head},{key},{value}\n")
+    if args.save_baseline:
+        args.save_baseline.write_text(json.dumps(baseline_of(results), indent=2))
+
+    failed = sum(r["status"] != "pass" for r in results)
+    print(f"[regress] {len(results) - failed} passed, {failed} failed")
+    regressions = []
+    if args.baseline:
+        baseline = json.loads(args.baseline.read_text())
+        regressions = compare(results, baseline, args.threshold)
+        for cfg, binary, key, old, new in regressions:
+            print(f"[regress] REGRESSION {cfg} {binary} {key}: {old} -> {new}")
+        print(f"[regress] {len(regressions)} regressions against {args.baseline}")
+    return 1 if failed or regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,500 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Solderpad Hardware License, Version 0.51, see LICENSE for details.
+// SPDX-License-Identifier: SHL-0.51
+
+// Decoder of the binary instruction traces written with `TB_TRACE_BINARY`.
+//
+// By default, it produces the same annotated trace and performance metrics
+// as `spike-dasm < trace.dasm | gen_trace.py`, and accepts the same options.
+// Instructions are disassembled by running `spike-dasm` once on all distinct
+// instruction words of the trace. With `--dasm`, it instead prints the text
+// lines the RTL tracer writes without `TB_TRACE_BINARY`.
+//
+// Build: c++ -std=c++17 -O2 -I<spatz>/hw/ip/snitch_test/src -o tracedec tracedec.cc
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tb_trace.hh"
+
+using namespace sim::trace;
+
+static const char *REG_ABI_NAMES_I[32] = {
+    "zero", "ra", "sp", "gp", "tp",  "t0",  "t1", "t2", "s0", "s1", "a0",
+    "a1",   "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3", "s4", "s5",
+    "s6",   "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+
+static const char *LS_SIZES[4] = {"Byte", "Half", "Word", "Doub"};
+
+enum { OperGpr = 1, OperCsr = 8 };
+
+// Metrics only used to compute others, omitted unless `--allkeys` is given.
+static const char *PERF_EVAL_KEYS_OMIT[] = {
+    "start",        "end",           "end_fpss",
+    "snitch_issues", "snitch_load_latency", "snitch_fseq_offloads",
+    "fseq_issues",  "fpss_issues",   "fpss_fpu_issues",
+    "fpss_load_latency", "fpss_fpu_latency"};
+
+static const char *GENERAL_WARN =
+    "WARNING: Inconsistent final state; performance metrics\n"
+    "may be inaccurate. Is this trace complete?\n";
+
+static std::string csr_name(uint32_t addr) {
+    static const std::unordered_map<uint32_t, const char *> names = {
+        {0x100, "sstatus"},    {0x104, "sie"},          {0x105, "stvec"},
+        {0x106, "scounteren"}, {0x140, "sscratch"},     {0x141, "sepc"},
+        {0x142, "scause"},     {0x143, "stval"},        {0x144, "sip"},
+        {0x180, "satp"},       {0x200, "bsstatus"},     {0x204, "bsie"},
+        {0x205, "bstvec"},     {0x240, "bsscratch"},    {0x241, "bsepc"},
+        {0x242, "bscause"},    {0x243, "bstval"},       {0x244, "bsip"},
+        {0x280, "bsatp"},      {0xA00, "hstatus"},      {0xA02, "hedeleg"},
+        {0xA03, "hideleg"},    {0xA80, "hgatp"},        {0x7, "utvt"},
+        {0x45, "unxti"},       {0x46, "uintstatus"},    {0x48, "uscratchcsw"},
+        {0x49, "uscratchcswl"}, {0x107, "stvt"},        {0x145, "snxti"},
+        {0x146, "sintstatus"}, {0x148, "sscratchcsw"},  {0x149, "sscratchcswl"},
+        {0x307, "mtvt"},       {0x345, "mnxti"},        {0x346, "mintstatus"},
+        {0x348, "mscratchcsw"}, {0x349, "mscratchcswl"}, {0x300, "mstatus"},
+        {0x301, "misa"},       {0x302, "medeleg"},      {0x303, "mideleg"},
+        {0x304, "mie"},        {0x305, "mtvec"},        {0x306, "mcounteren"},
+        {0x340, "mscratch"},   {0x341, "mepc"},         {0x342, "mcause"},
+        {0x343, "mtval"},      {0x344, "mip"},          {0x7A0, "tselect"},
+        {0x7A1, "tdata1"},     {0x7A2, "tdata2"},       {0x7A3, "tdata3"},
+        {0x7B0, "dcsr"},       {0x7B1, "dpc"},          {0x7B2, "dscratch"},
+        {0xB00, "mcycle"},     {0xB02, "minstret"},     {0xB80, "mcycleh"},
+        {0xB82, "minstreth"},  {0xC00, "cycle"},        {0xC01, "time"},
+        {0xC02, "instret"},    {0xC80, "cycleh"},       {0xC81, "timeh"},
+        {0xC82, "instreth"},   {0xF11, "mvendorid"},    {0xF12, "marchid"},
+        {0xF13, "mimpid"},     {0xF14, "mhartid"}};
+    auto it = names.find(addr);
+    if (it != names.end()) return it->second;
+    unsigned n = addr & 0x1f;
+    if (n >= 3) {
+        if ((addr & ~0x1fu) == 0xC00) return "hpmcounter" + std::to_string(n);
+        if ((addr & ~0x1fu) == 0xC80)
+            return "hpmcounter" + std::to_string(n) + "h";
+        if ((addr & ~0x1fu) == 0xB00) return "mhpmcounter" + std::to_string(n);
+        if ((addr & ~0x1fu) == 0xB80)
+            return "mhpmcounter" + std::to_string(n) + "h";
+        if ((addr & ~0x1fu) == 0x320) return "mhpmevent" + std::to_string(n);
+    }
+    if (addr >= 0x3A0 && addr <= 0x3A3) return "pmpcfg" + std::to_string(addr - 0x3A0);
+    if (addr >= 0x3B0 && addr <= 0x3BF) return "pmpaddr" + std::to_string(addr - 0x3B0);
+    char buf[16];
+    snprintf(buf, sizeof(buf), "csr@%x", addr);
+    return buf;
+}
+
+// Format an integer like `gen_trace.py`'s `int_lit`: signed decimal for
+// small values, zero-padded hex otherwise.
+static std::string int_lit(uint64_t num, bool force_hex = false) {
+    char buf[24];
+    uint32_t val = num;
+    int32_t val_signed = (int32_t)val;
+    if (force_hex || val_signed > 0xFFFF || val_signed < -0xFFFF)
+        snprintf(buf, sizeof(buf), "0x%08x", val);
+    else
+        snprintf(buf, sizeof(buf), "%d", val_signed);
+    return buf;
+}
+
+// Left-align `str` in a field of `width` characters.
+static std::string ljust(const std::string &str, size_t width) {
+    return str.size() >= width ? str : str + std::string(width - str.size(), ' ');
+}
+
+// Performance metrics of one section, in insertion order like the Python
+// dictionaries they mirror. A value of `NONE` prints as `None`.
+struct Section {
+    static constexpr int64_t NONE = INT64_MIN;
+    std::vector<std::pair<std::string, int64_t>> values;
+
+    int64_t &operator[](const char *key) {
+        for (auto &kv : values)
+            if (kv.first == key) return kv.second;
+        values.emplace_back(key, 0);
+        return values.back().second;
+    }
+};
+
+struct Options {
+    bool offl = false;
+    bool saddr = false;
+    bool allkeys = false;
+    bool permissive = false;
+    bool dasm = false;
+    const char *dump_perf = nullptr;
+    std::string dasm_tool = "spike-dasm";
+};
+
+// Disassemble all distinct instruction words in one `spike-dasm` run.
+static std::unordered_map<uint64_t, std::string> disassemble(
+    const std::vector<uint64_t> &insns, const std::string &tool) {
+    std::unordered_map<uint64_t, std::string> result;
+    char path[] = "/tmp/tracedec.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return result;
+    FILE *tmp = fdopen(fd, "w");
+    for (auto insn : insns) fprintf(tmp, "DASM(%08lx)\n", insn);
+    fclose(tmp);
+    std::string cmd = tool + " < " + path;
+    FILE *pipe = popen(cmd.c_str(), "r");
+    if (pipe) {
+        char *line = nullptr;
+        size_t cap = 0;
+        ssize_t len;
+        for (size_t i = 0; i < insns.size() && (len = getline(&line, &cap, pipe)) > 0; i++) {
+            while (len && line[len - 1] == '\n') line[--len] = 0;
+            result[insns[i]] = line;
+        }
+        free(line);
+        if (pclose(pipe) != 0) result.clear();
+    }
+    unlink(path);
+    if (result.size() != insns.size()) {
+        fprintf(stderr, "WARNING: `%s` failed, instructions are not disassembled\n",
+                tool.c_str());
+        result.clear();
+    }
+    return result;
+}
+
+// Print the text line the RTL tracer writes for this record.
+static void print_dasm(const Record &rec, const TraceReader &reader,
+                       std::string &out) {
+    char buf[128];
+    if (rec.pc_valid)
+        snprintf(buf, sizeof(buf), "%20lu %lu %8u 0x%08lx DASM(%08lx) #; {",
+                 rec.time, rec.cycle, rec.priv, rec.pc, rec.insn);
+    else
+        snprintf(buf, sizeof(buf), "%20lu %lu %8u 0xzzzzzzzz DASM(%016lx) #; {",
+                 rec.time, rec.cycle, rec.priv, rec.insn);
+    out += buf;
+    auto &names = reader.fields[rec.source];
+    for (size_t i = 0; i < names.size(); i++) {
+        snprintf(buf, sizeof(buf), "': 0x%lx, ", rec.fields[i]);
+        out += '\'';
+        out += names[i];
+        out += buf;
+    }
+    out += "}\n";
+}
+
+static void print_json(FILE *file, const std::vector<Section> &sections) {
+    if (sections.empty()) {
+        fprintf(file, "[]");
+        return;
+    }
+    fprintf(file, "[\n");
+    for (size_t i = 0; i < sections.size(); i++) {
+        auto &values = sections[i].values;
+        if (values.empty()) {
+            fprintf(file, "    {}");
+        } else {
+            fprintf(file, "    {\n");
+            for (size_t j = 0; j < values.size(); j++) {
+                fprintf(file, "        \"%s\": ", values[j].first.c_str());
+                if (values[j].second == Section::NONE)
+                    fprintf(file, "null");
+                else
+                    fprintf(file, "%ld", values[j].second);
+                fprintf(file, j + 1 < values.size() ? ",\n" : "\n");
+            }
+            fprintf(file, "    }");
+        }
+        fprintf(file, i + 1 < sections.size() ? ",\n" : "\n");
+    }
+    fprintf(file, "]");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options] trace_hart_XXXXX.bin\n"
+            "  --dasm               Print the text trace of the RTL tracer\n"
+            "  --dasm-tool=<path>   Disassembler (default: spike-dasm, `none` "
+            "to skip)\n"
+            "  -o, --offl           Annotate FPSS and sequencer offloads\n"
+            "  -s, --saddr          Signed decimal for small addresses\n"
+            "  -a, --allkeys        Include all performance metrics\n"
+            "  -p, --permissive     Ignore some state-related issues\n"
+            "  -d, --dump-perf=<f>  Dump performance metrics as JSON\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    static const struct option longopts[] = {
+        {"dasm", no_argument, nullptr, 'D'},
+        {"dasm-tool", required_argument, nullptr, 'T'},
+        {"offl", no_argument, nullptr, 'o'},
+        {"saddr", no_argument, nullptr, 's'},
+        {"allkeys", no_argument, nullptr, 'a'},
+        {"permissive", no_argument, nullptr, 'p'},
+        {"dump-perf", required_argument, nullptr, 'd'},
+        {nullptr, 0, nullptr, 0}};
+    for (int c; (c = getopt_long(argc, argv, "osapd:", longopts, nullptr)) != -1;) {
+        switch (c) {
+            case 'D': opt.dasm = true; break;
+            case 'T': opt.dasm_tool = optarg; break;
+            case 'o': opt.offl = true; break;
+            case 's': opt.saddr = true; break;
+            case 'a': opt.allkeys = true; break;
+            case 'p': opt.permissive = true; break;
+            case 'd': opt.dump_perf = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind + 1 != argc) usage(argv[0]);
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    size_t size = st.st_size;
+    auto data = (const uint8_t *)mmap(nullptr, size ? size : 1, PROT_READ,
+                                      MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+    TraceReader reader(data, size);
+    if (!reader.valid) {
+        fprintf(stderr, "%s is not a binary trace\n", argv[optind]);
+        return 1;
+    }
+
+    std::string out;
+    out.reserve(1 << 21);
+    auto flush = [&](bool force) {
+        if (force || out.size() >= (1 << 20)) {
+            fwrite(out.data(), 1, out.size(), stdout);
+            out.clear();
+        }
+    };
+    Record rec;
+
+    if (opt.dasm) {
+        while (reader.next(rec)) {
+            print_dasm(rec, reader, out);
+            flush(false);
+        }
+        flush(true);
+        return 0;
+    }
+
+    SnitchFields f(reader.fields[SrcSnitch]);
+    if (f.missing) {
+        fprintf(stderr, "Trace lacks the snitch field `%s`\n", f.missing);
+        return 1;
+    }
+
+    // Disassemble the instructions that show up in the annotated trace.
+    std::unordered_map<uint64_t, std::string> dasm;
+    if (opt.dasm_tool != "none") {
+        TraceReader scan(data, size);
+        std::vector<uint64_t> insns;
+        std::unordered_map<uint64_t, bool> seen;
+        while (scan.next(rec)) {
+            if (rec.source != SrcSnitch || rec.fields[f.stall] ||
+                rec.fields[f.fpu_offload])
+                continue;
+            if (seen.emplace(rec.insn, true).second) insns.push_back(rec.insn);
+        }
+        dasm = disassemble(insns, opt.dasm_tool);
+    }
+
+    std::vector<Section> perf(1);
+    perf[0]["start"] = Section::NONE;
+    std::deque<uint64_t> gpr_wb_info[32];
+    size_t fpss_pcs = 0, fseq_pcs = 0;
+    bool have_time = false;
+    uint64_t last_time = 0, last_cycle = 0;
+    bool force_hex_addr = !opt.saddr;
+    char buf[256];
+
+    while (reader.next(rec)) {
+        if (rec.source != SrcSnitch) {
+            fprintf(stderr, "Unknown trace source: %u\n", rec.source);
+            return 1;
+        }
+        const uint64_t *x = rec.fields;
+        uint64_t cycle = rec.cycle;
+        std::vector<std::string> annot;
+
+        // Compound annotations in datapath order, as in `annotate_snitch`.
+        if (opt.offl && x[f.fpu_offload]) {
+            snprintf(buf, sizeof(buf), "%s <~~ 0x%08lx",
+                     x[f.is_seq_insn] ? "FSEQ" : "FPSS", rec.pc);
+            annot.push_back(buf);
+        }
+        if (!x[f.stall] && x[f.exception]) annot.push_back("exception");
+        if (!(x[f.stall] || x[f.fpu_offload])) {
+            if (x[f.opa_select] == OperGpr && x[f.rs1] != 0)
+                annot.push_back(ljust(REG_ABI_NAMES_I[x[f.rs1] & 31], 3) +
+                                " = " + int_lit(x[f.opa]));
+            if (x[f.opb_select] == OperGpr && x[f.rs2] != 0)
+                annot.push_back(ljust(REG_ABI_NAMES_I[x[f.rs2] & 31], 3) +
+                                " = " + int_lit(x[f.opb]));
+            if (x[f.opb_select] == OperCsr) {
+                std::string name = csr_name(x[f.csr_addr]);
+                if (name == "mcycle") {
+                    perf.back()["end"] = x[f.opb];
+                    perf.emplace_back();
+                    perf.back()["start"] = x[f.opb] + 2;
+                }
+                annot.push_back(name + " = " + int_lit(x[f.opb]));
+            }
+            if (x[f.is_load]) {
+                perf.back()["snitch_loads"] += 1;
+                gpr_wb_info[x[f.rd] & 31].push_front(cycle);
+                annot.push_back(ljust(REG_ABI_NAMES_I[x[f.rd] & 31], 3) +
+                                " <~~ " + LS_SIZES[x[f.ls_size] & 3] + "[" +
+                                int_lit(x[f.alu_result], force_hex_addr) + "]");
+            } else if (x[f.is_store]) {
+                perf.back()["snitch_stores"] += 1;
+                annot.push_back(int_lit(x[f.gpr_rdata_1]) + " ~~> " +
+                                LS_SIZES[x[f.ls_size] & 3] + "[" +
+                                int_lit(x[f.alu_result], force_hex_addr) + "]");
+            } else if (x[f.is_branch]) {
+                annot.push_back(x[f.alu_result] ? "taken" : "not taken");
+            }
+            if (x[f.write_rd] && x[f.rd] != 0)
+                annot.push_back("(wrb) " + ljust(REG_ABI_NAMES_I[x[f.rd] & 31], 3) +
+                                " <-- " + int_lit(x[f.writeback]));
+        }
+        if (x[f.retire_load] && x[f.lsu_rd] != 0) {
+            auto &que = gpr_wb_info[x[f.lsu_rd] & 31];
+            if (que.empty()) {
+                fprintf(stderr,
+                        "%s: In cycle %lu, LSU attempts writeback to %s, but "
+                        "none in flight.\n",
+                        opt.permissive ? "WARNING" : "FATAL", cycle,
+                        REG_ABI_NAMES_I[x[f.lsu_rd] & 31]);
+                if (!opt.permissive) return 1;
+            } else {
+                perf.back()["snitch_load_latency"] += cycle - que.back();
+                que.pop_back();
+            }
+            annot.push_back("(lsu) " + ljust(REG_ABI_NAMES_I[x[f.lsu_rd] & 31], 3) +
+                            " <-- " + int_lit(x[f.ld_result_32]));
+        }
+        if (x[f.retire_acc] && x[f.acc_pid] != 0)
+            annot.push_back("(acc) " + ljust(REG_ABI_NAMES_I[x[f.acc_pid] & 31], 3) +
+                            " <-- " + int_lit(x[f.acc_pdata_32]));
+        if (!x[f.stall] && x[f.pc_d] != rec.pc + 4)
+            annot.push_back("goto " + int_lit(x[f.pc_d]));
+
+        // Bookkeeping of `annotate_insn`.
+        if (x[f.fpu_offload]) {
+            perf.back()["snitch_fseq_offloads"] += 1;
+            fpss_pcs++;
+            if (x[f.is_seq_insn]) fseq_pcs++;
+        }
+        std::string insn, pc_str;
+        if (!(x[f.stall] || x[f.fpu_offload])) {
+            perf.back()["snitch_issues"] += 1;
+            auto it = dasm.find(rec.insn);
+            if (it != dasm.end()) {
+                insn = it->second + " ";
+            } else {
+                snprintf(buf, sizeof(buf), "DASM(%08lx) ", rec.insn);
+                insn = buf;
+            }
+            snprintf(buf, sizeof(buf), "0x%08lx", rec.pc);
+            pc_str = buf;
+        }
+        std::string annot_str;
+        for (size_t i = 0; i < annot.size(); i++) {
+            if (i) annot_str += ", ";
+            annot_str += annot[i];
+        }
+        if (!insn.empty() || !annot_str.empty()) {
+            bool show_time =
+                !have_time || rec.time != last_time || cycle != last_cycle;
+            std::string time_str, cycle_str;
+            if (show_time) {
+                time_str = std::to_string(rec.time);
+                cycle_str = std::to_string(cycle);
+            }
+            static const char *priv_lvl[4] = {"U", "S", "?", "M"};
+            snprintf(buf, sizeof(buf), "%8s %8s %8s %10s ", time_str.c_str(),
+                     cycle_str.c_str(), priv_lvl[rec.priv & 3], pc_str.c_str());
+            out += buf;
+            out += ljust(insn, 30);
+            out += " #; ";
+            out += annot_str;
+            out += '\n';
+            have_time = true;
+            last_time = rec.time;
+            last_cycle = cycle;
+            flush(false);
+        }
+        if (perf[0]["start"] == Section::NONE && have_time)
+            perf[0]["start"] = last_cycle;
+    }
+    perf.back()["end"] = have_time ? (int64_t)last_cycle : Section::NONE;
+
+    // Emit metrics.
+    out += "\n## Performance metrics\n";
+    for (size_t idx = 0; idx < perf.size(); idx++) {
+        auto fmt = [](int64_t val) {
+            return val == Section::NONE ? std::string("None") : int_lit(val);
+        };
+        auto &sec = perf[idx];
+        out += "\nPerformance metrics for section " + std::to_string(idx) +
+               " @ (" + (sec["start"] == Section::NONE ? "None" : std::to_string(sec["start"])) +
+               ", " + (sec["end"] == Section::NONE ? "None" : std::to_string(sec["end"])) +
+               "):";
+        for (auto &kv : sec.values) {
+            bool omit = false;
+            for (auto key : PERF_EVAL_KEYS_OMIT) omit |= kv.first == key;
+            if (omit && !opt.allkeys) continue;
+            snprintf(buf, sizeof(buf), "\n%-40s%10s", kv.first.c_str(),
+                     fmt(kv.second).c_str());
+            out += buf;
+        }
+        out += '\n';
+    }
+    flush(true);
+
+    if (opt.dump_perf) {
+        FILE *file = fopen(opt.dump_perf, "w");
+        if (!file) {
+            perror(opt.dump_perf);
+            return 1;
+        }
+        print_json(file, perf);
+        fclose(file);
+    }
+
+    // Check for any loose ends and warn before exiting.
+    bool warn_trip = false;
+    if (fseq_pcs) {
+        warn_trip = true;
+        fprintf(stderr, "WARNING: %zu Sequencer instructions were not issued.\n",
+                fseq_pcs);
+    }
+    if (fpss_pcs != fseq_pcs) {
+        warn_trip = true;
+        fprintf(stderr,
+                "WARNING: %zu unsequenced FPSS instructions were not issued.\n",
+                fpss_pcs - fseq_pcs);
+    }
+    if (warn_trip) fputs(GENERAL_WARN, stderr);
+    return 0;
+}
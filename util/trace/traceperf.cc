@@ -0,0 +1,509 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Solderpad Hardware License, Version 0.51, see LICENSE for details.
+// SPDX-License-Identifier: SHL-0.51
+
+// Streaming performance analysis of instruction traces.
+//
+// Reads binary traces (`trace_hart_*.bin`) and text traces as written by the
+// RTL tracer (`trace_hart_*.dasm`, raw or piped through `spike-dasm`), one
+// thread per hart, and writes the per-section metrics as JSON. Sections are
+// delimited by reads of `mcycle`, as in `gen_trace.py`. Memory use does not
+// depend on the trace length.
+//
+// Build: c++ -std=c++17 -O2 -pthread -I<spatz>/hw/ip/snitch_test/src -o traceperf traceperf.cc
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tb_trace.hh"
+
+using namespace sim::trace;
+
+static const uint32_t CSR_MCYCLE = 0xB00;
+enum { OperGpr = 1 };
+
+// Class of an instruction offloaded to Spatz.
+enum Offload { VecArith, VecMem, VecCfg, FpArith, FpMem, OtherOffload };
+
+// Class of the instruction whose issue the core waited for.
+enum Stall { LoadUse, Lsu, Acc, Control, Csr, OtherStall, NumStalls };
+static const char *STALL_NAMES[NumStalls] = {"load_use", "lsu",  "acc",
+                                             "control",  "csr", "other"};
+
+static Offload classify_insn(uint32_t insn) {
+    uint32_t funct3 = (insn >> 12) & 7;
+    switch (insn & 0x7f) {
+        case 0x57:  // OP-V
+            return funct3 == 7 ? VecCfg : VecArith;
+        case 0x07:  // LOAD-FP
+        case 0x27:  // STORE-FP
+            return (funct3 == 0 || funct3 >= 5) ? VecMem : FpMem;
+        case 0x53:  // OP-FP
+        case 0x43:  // FMADD
+        case 0x47:  // FMSUB
+        case 0x4b:  // FNMSUB
+        case 0x4f:  // FNMADD
+            return FpArith;
+        default:
+            return OtherOffload;
+    }
+}
+
+// Classify a `spike-dasm` mnemonic, for text traces that lost the words.
+static Offload classify_mnemonic(const char *m) {
+    auto digit = [](char c) { return c >= '0' && c <= '9'; };
+    if (m[0] == 'v') {
+        if (!strncmp(m, "vset", 4)) return VecCfg;
+        if (m[1] == 'l' || m[1] == 's') {
+            const char *r = m + 2;
+            if ((r[0] == 'e' && digit(r[1])) ||
+                (r[0] == 's' && r[1] == 'e' && digit(r[2])) ||
+                !strncmp(r, "uxei", 4) || !strncmp(r, "oxei", 4) ||
+                !strncmp(r, "m.", 2) || (digit(r[0]) && r[1] == 'r'))
+                return VecMem;
+        }
+        return VecArith;
+    }
+    if (m[0] == 'f' && strncmp(m, "fence", 5)) {
+        if ((m[1] == 'l' || m[1] == 's') &&
+            (m[2] == 'w' || m[2] == 'd' || m[2] == 'h') &&
+            (m[3] == 0 || m[3] == ' ' || m[3] == '\t'))
+            return FpMem;
+        return FpArith;
+    }
+    return OtherOffload;
+}
+
+struct Section {
+    // Bounds as `gen_trace.py` reports them.
+    bool has_start = false, has_end = false;
+    uint64_t start = 0, end = 0;
+    // Both bounds read from `mcycle`.
+    bool mcycle_start = false, mcycle_end = false;
+    uint64_t first_time = 0, last_time = 0;
+    bool has_time = false;
+    uint64_t loads = 0, stores = 0, load_latency = 0, retired_loads = 0;
+    uint64_t offloads = 0, issues = 0, seq_offloads = 0;
+    uint64_t offload_class[OtherOffload + 1] = {0};
+    // Stalled time before an issue, in time units, and number of such gaps.
+    uint64_t stall_time[NumStalls] = {0}, stall_gaps[NumStalls] = {0};
+};
+
+struct Hart {
+    std::string path;
+    uint32_t hart = 0;
+    std::string error;
+    uint64_t period = 0;
+    uint64_t records = 0;
+    std::vector<Section> sections;
+};
+
+// Incremental state of one hart, fed one record at a time.
+class Analyzer {
+   public:
+    Analyzer(Hart &out, const SnitchFields &f) : out(out), f(f) {
+        out.sections.emplace_back();
+    }
+
+    // `mnemonic` is only set for disassembled text traces.
+    void record(const Record &rec, const char *mnemonic) {
+        out.records++;
+        if (prev_time_valid && rec.time > prev_time &&
+            (!out.period || rec.time - prev_time < out.period))
+            out.period = rec.time - prev_time;
+        prev_time = rec.time;
+        prev_time_valid = true;
+        if (rec.source != SrcSnitch) return;
+
+        const uint64_t *x = rec.fields;
+        bool issue = !x[f.stall];
+        bool offload = x[f.fpu_offload];
+        Section *sec = &out.sections.back();
+
+        if (issue && !offload && x[f.opb_select] == 8 &&
+            x[f.csr_addr] == CSR_MCYCLE) {
+            sec->end = x[f.opb];
+            sec->has_end = sec->mcycle_end = true;
+            out.sections.emplace_back();
+            sec = &out.sections.back();
+            sec->start = x[f.opb] + 2;
+            sec->has_start = sec->mcycle_start = true;
+        }
+        if (!sec->has_time) sec->first_time = rec.time;
+        sec->has_time = true;
+        sec->last_time = rec.time;
+        if (!out.sections[0].has_start) {
+            out.sections[0].start = rec.cycle;
+            out.sections[0].has_start = true;
+        }
+        last_cycle = rec.cycle;
+
+        if (x[f.retire_load] && x[f.lsu_rd] != 0) {
+            unsigned rd = x[f.lsu_rd] & 31;
+            if (pending_loads[rd]) {
+                pending_loads[rd]--;
+                sec->load_latency += rec.time - load_issue[rd];
+                sec->retired_loads++;
+            }
+            retire_time[rd] = rec.time;
+        }
+        if (!issue) return;
+
+        // Attribute the cycles the core waited to the instruction it waited
+        // to issue.
+        if (last_issue_valid && rec.time > last_issue) {
+            Stall cause = OtherStall;
+            auto raw = [&](int reg_field, int sel_field) {
+                unsigned reg = x[reg_field] & 31;
+                return reg && x[sel_field] == OperGpr &&
+                       retire_time[reg] > last_issue;
+            };
+            if (!offload && (raw(f.rs1, f.opa_select) || raw(f.rs2, f.opb_select)))
+                cause = LoadUse;
+            else if (offload)
+                cause = Acc;
+            else if (x[f.is_load] || x[f.is_store])
+                cause = Lsu;
+            else if (last_redirect)
+                cause = Control;
+            else if (x[f.opb_select] == 8)
+                cause = Csr;
+            sec->stall_time[cause] += rec.time - last_issue;
+            sec->stall_gaps[cause]++;
+        }
+        last_issue = rec.time;
+        last_issue_valid = true;
+        last_redirect = x[f.pc_d] != rec.pc + 4;
+
+        if (offload) {
+            sec->seq_offloads++;
+            sec->offloads++;
+            Offload cls = mnemonic ? classify_mnemonic(mnemonic)
+                                   : classify_insn(rec.insn);
+            sec->offload_class[cls]++;
+            return;
+        }
+        sec->issues++;
+        if (x[f.is_load]) {
+            sec->loads++;
+            unsigned rd = x[f.rd] & 31;
+            // Loads to the same register retire in order; keep the oldest.
+            if (!pending_loads[rd]++) load_issue[rd] = rec.time;
+        } else if (x[f.is_store]) {
+            sec->stores++;
+        }
+    }
+
+    void finish() {
+        auto &last = out.sections.back();
+        last.end = last_cycle;
+        last.has_end = out.records != 0;
+    }
+
+   private:
+    Hart &out;
+    const SnitchFields &f;
+    bool prev_time_valid = false;
+    uint64_t prev_time = 0;
+    uint64_t last_cycle = 0;
+    bool last_issue_valid = false;
+    uint64_t last_issue = 0;
+    bool last_redirect = false;
+    unsigned pending_loads[32] = {0};
+    uint64_t load_issue[32] = {0};
+    uint64_t retire_time[32] = {0};
+};
+
+static uint32_t hart_from_path(const std::string &path) {
+    auto pos = path.rfind("trace_hart_");
+    return pos == std::string::npos
+               ? 0
+               : strtoul(path.c_str() + pos + strlen("trace_hart_"), nullptr, 16);
+}
+
+static void analyze_binary(Hart &hart, const uint8_t *data, size_t size) {
+    TraceReader reader(data, size);
+    if (!reader.valid) {
+        hart.error = "not a binary trace";
+        return;
+    }
+    hart.hart = reader.hart;
+    SnitchFields f(reader.fields[SrcSnitch]);
+    if (f.missing) {
+        hart.error = std::string("no snitch field `") + f.missing + "`";
+        return;
+    }
+    Analyzer analyzer(hart, f);
+    Record rec;
+    while (reader.next(rec)) analyzer.record(rec, nullptr);
+    analyzer.finish();
+}
+
+// Parse one line of a text trace. Field names are checked against the ones
+// seen on the previous line before they are looked up.
+static bool parse_line(char *line, Record &rec, std::vector<std::string> &names,
+                       const char *&mnemonic) {
+    char *p = line;
+    rec.time = strtoull(p, &p, 10);
+    rec.cycle = strtoull(p, &p, 10);
+    rec.priv = strtoul(p, &p, 10);
+    while (*p == ' ') p++;
+    if (strncmp(p, "0x", 2)) return false;
+    p += 2;
+    rec.pc_valid = *p != 'z';
+    rec.pc = rec.pc_valid ? strtoull(p, &p, 16) : 0;
+    while (*p && *p != ' ') p++;
+    while (*p == ' ') p++;
+    char *extras = strstr(p, "#;");
+    if (!extras) return false;
+    char *fields = strchr(extras, '{');
+    if (!fields) return false;
+    mnemonic = nullptr;
+    rec.insn = 0;
+    if (!strncmp(p, "DASM(", 5)) {
+        rec.insn = strtoull(p + 5, nullptr, 16);
+    } else {
+        mnemonic = p;
+        char *e = extras;
+        while (e > p && e[-1] == ' ') e--;
+        *e = 0;
+    }
+    p = fields + 1;
+    size_t i = 0;
+    while (true) {
+        char *key = strchr(p, '\'');
+        if (!key) break;
+        char *key_end = strchr(key + 1, '\'');
+        if (!key_end || key_end[1] != ':') return false;
+        size_t len = key_end - key - 1;
+        if (i == names.size()) {
+            if (i == 64) return false;
+            names.emplace_back(key + 1, len);
+        } else if (names[i].compare(0, std::string::npos, key + 1, len)) {
+            names[i].assign(key + 1, len);
+        }
+        rec.fields[i++] = strtoull(key_end + 2, &p, 16);
+    }
+    names.resize(i);
+    rec.source = i && names[0] == "source" ? static_cast<Source>(rec.fields[0])
+                                           : SrcSnitch;
+    return true;
+}
+
+static void analyze_text(Hart &hart, FILE *file) {
+    hart.hart = hart_from_path(hart.path);
+    std::vector<std::string> names, snitch_names;
+    SnitchFields *f = nullptr;
+    std::unique_ptr<Analyzer> analyzer;
+    char *line = nullptr;
+    size_t cap = 0;
+    Record rec;
+    const char *mnemonic;
+    while (getline(&line, &cap, file) > 0) {
+        if (!parse_line(line, rec, names, mnemonic)) continue;
+        if (rec.source == SrcSnitch && names != snitch_names) {
+            // Field names of a new layout: look up the indices again.
+            if (analyzer) {
+                hart.error = "inconsistent snitch fields";
+                break;
+            }
+            snitch_names = names;
+            f = new SnitchFields(snitch_names);
+            if (f->missing) {
+                hart.error = std::string("no snitch field `") + f->missing + "`";
+                break;
+            }
+            analyzer = std::make_unique<Analyzer>(hart, *f);
+        }
+        if (analyzer) analyzer->record(rec, mnemonic);
+    }
+    if (analyzer) analyzer->finish();
+    free(line);
+    delete f;
+}
+
+static void analyze(Hart &hart) {
+    const char *path = hart.path.c_str();
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        hart.error = strerror(errno);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    char magic[sizeof(TRACE_MAGIC)] = {0};
+    ssize_t got = pread(fd, magic, sizeof(magic), 0);
+    if (got == sizeof(magic) && !memcmp(magic, TRACE_MAGIC, sizeof(magic))) {
+        auto data = (const uint8_t *)mmap(nullptr, st.st_size, PROT_READ,
+                                          MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            hart.error = strerror(errno);
+            return;
+        }
+        // Pages already decoded are dropped behind the reader.
+        madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+        analyze_binary(hart, data, st.st_size);
+        munmap((void *)data, st.st_size);
+    } else {
+        FILE *file = fdopen(fd, "r");
+        analyze_text(hart, file);
+        fclose(file);
+    }
+}
+
+static void print_ratio(FILE *out, const char *key, uint64_t num,
+                        uint64_t den) {
+    if (den)
+        fprintf(out, ",\n                    \"%s\": %.4f", key, (double)num / den);
+    else
+        fprintf(out, ",\n                    \"%s\": null", key);
+}
+
+static void print_json(FILE *out, const std::vector<Hart> &harts) {
+    const char *offload_names[] = {"vector_arith", "vector_mem", "vector_cfg",
+                                   "fp_arith",     "fp_mem",     "other"};
+    fprintf(out, "{\n    \"harts\": [");
+    for (size_t h = 0; h < harts.size(); h++) {
+        auto &hart = harts[h];
+        fprintf(out, "%s\n        {\n", h ? "," : "");
+        fprintf(out, "            \"hart\": %u,\n", hart.hart);
+        fprintf(out, "            \"file\": \"%s\",\n", hart.path.c_str());
+        if (!hart.error.empty()) {
+            fprintf(out, "            \"error\": \"%s\"\n        }", hart.error.c_str());
+            continue;
+        }
+        fprintf(out, "            \"period\": %lu,\n", hart.period);
+        fprintf(out, "            \"records\": %lu,\n", hart.records);
+        fprintf(out, "            \"sections\": [");
+        uint64_t period = hart.period ? hart.period : 1;
+        for (size_t i = 0; i < hart.sections.size(); i++) {
+            auto &s = hart.sections[i];
+            // Prefer the exact bounds read from `mcycle`, otherwise derive
+            // the length from the time stamps.
+            uint64_t cycles = s.mcycle_start && s.mcycle_end && s.end >= s.start
+                                  ? s.end - s.start
+                              : s.has_time
+                                  ? (s.last_time - s.first_time) / period + 1
+                                  : 0;
+            uint64_t stall_cycles[NumStalls], stalls = 0;
+            for (int k = 0; k < NumStalls; k++) {
+                uint64_t gap = s.stall_time[k] / period;
+                stall_cycles[k] = gap > s.stall_gaps[k] ? gap - s.stall_gaps[k] : 0;
+                stalls += stall_cycles[k];
+            }
+            uint64_t vector = s.offload_class[VecArith] + s.offload_class[VecMem];
+            fprintf(out, "%s\n                {\n", i ? "," : "");
+            fprintf(out, "                    \"section\": %zu", i);
+            if (s.has_start)
+                fprintf(out, ",\n                    \"start\": %lu", s.start);
+            else
+                fprintf(out, ",\n                    \"start\": null");
+            if (s.has_end)
+                fprintf(out, ",\n                    \"end\": %lu", s.end);
+            else
+                fprintf(out, ",\n                    \"end\": null");
+            fprintf(out, ",\n                    \"cycles\": %lu", cycles);
+            fprintf(out, ",\n                    \"snitch_issues\": %lu", s.issues);
+            fprintf(out, ",\n                    \"snitch_fseq_offloads\": %lu", s.seq_offloads);
+            fprintf(out, ",\n                    \"snitch_loads\": %lu", s.loads);
+            fprintf(out, ",\n                    \"snitch_stores\": %lu", s.stores);
+            fprintf(out, ",\n                    \"snitch_load_latency\": %lu",
+                    s.load_latency / period);
+            print_ratio(out, "snitch_avg_load_latency", s.load_latency / period,
+                        s.retired_loads);
+            print_ratio(out, "ipc", s.issues + s.offloads, cycles);
+            print_ratio(out, "snitch_occupancy", s.issues, cycles);
+            fprintf(out, ",\n                    \"offloads\": {");
+            for (int k = 0; k <= OtherOffload; k++)
+                fprintf(out, "%s\"%s\": %lu", k ? ", " : "", offload_names[k],
+                        s.offload_class[k]);
+            fprintf(out, "}");
+            print_ratio(out, "vector_utilization", vector, cycles);
+            print_ratio(out, "fpu_utilization", s.offload_class[FpArith], cycles);
+            fprintf(out, ",\n                    \"stall_cycles\": %lu", stalls);
+            fprintf(out, ",\n                    \"stalls\": {");
+            for (int k = 0; k < NumStalls; k++)
+                fprintf(out, "%s\"%s\": %lu", k ? ", " : "", STALL_NAMES[k],
+                        stall_cycles[k]);
+            fprintf(out, "}\n                }");
+        }
+        fprintf(out, "\n            ]\n        }");
+    }
+    fprintf(out, "\n    ]\n}\n");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options] trace_hart_XXXXX.{bin,dasm,txt}...\n"
+            "  -o, --output=<file>  Write the JSON to <file> instead of stdout\n"
+            "  -j, --jobs=<n>       Analyze <n> traces in parallel (default: "
+            "all cores)\n"
+            "  --period=<time>      Clock period in trace time units (default: "
+            "smallest step)\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *output = nullptr;
+    unsigned jobs = std::thread::hardware_concurrency();
+    uint64_t period = 0;
+    static const struct option longopts[] = {
+        {"output", required_argument, nullptr, 'o'},
+        {"jobs", required_argument, nullptr, 'j'},
+        {"period", required_argument, nullptr, 'P'},
+        {nullptr, 0, nullptr, 0}};
+    for (int c; (c = getopt_long(argc, argv, "o:j:", longopts, nullptr)) != -1;) {
+        switch (c) {
+            case 'o': output = optarg; break;
+            case 'j': jobs = atoi(optarg); break;
+            case 'P': period = strtoull(optarg, nullptr, 0); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind == argc) usage(argv[0]);
+
+    std::vector<Hart> harts(argc - optind);
+    for (size_t i = 0; i < harts.size(); i++) harts[i].path = argv[optind + i];
+
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i; (i = next++) < harts.size();) {
+            analyze(harts[i]);
+            if (period) harts[i].period = period;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < std::max(1u, std::min<unsigned>(jobs, harts.size())); i++)
+        threads.emplace_back(worker);
+    for (auto &t : threads) t.join();
+
+    bool ok = true;
+    for (auto &hart : harts) {
+        if (hart.error.empty()) continue;
+        fprintf(stderr, "%s: %s\n", hart.path.c_str(), hart.error.c_str());
+        ok = false;
+    }
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+    print_json(out, harts);
+    if (output) fclose(out);
+    return ok ? 0 : 1;
+}